@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <likwid.h>
 
 #include "dvfs_config.h"
@@ -52,7 +53,11 @@ void apply_dvfs_policy(double CPI, double Math_Intensity, double Stall_Ratio, do
 
     int ret = system(cmd);
     if (ret == 0) {
-        printf("[DVFS] Switching to Level %d (%lu kHz)\n", level, target_freq_khz);
+        // CLOCK_MONOTONIC stamp lines up with the benchmarks' --trace-every/--trace-interval-us series.
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        printf("[DVFS] Switching to Level %d (%lu kHz) at %.6f\n", level, target_freq_khz,
+               (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9);
         current_freq_khz = target_freq_khz;
     } else {
         fprintf(stderr, "[DVFS] Failed to set frequency to %lu kHz (ret=%d)\n", target_freq_khz, ret);
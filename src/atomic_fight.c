@@ -7,52 +7,63 @@
 #include <omp.h>
 #include <stdio.h>
 #include "bench_args.h"
+// Each timed sample opens a parallel region; keep samples coarse so the
+// fork/join cost stays negligible next to the contended increments.
+#define DEFAULT_MAX_SAMPLES 1000ULL
+
+typedef struct {
+    long shared_counter;
+} atomic_ctx_t;
+
+static void atomic_run(void *arg, unsigned long long iters) {
+    atomic_ctx_t *ctx = (atomic_ctx_t*)arg;
+    #pragma omp parallel
+    {
+        for (unsigned long long iter = 0; iter < iters; iter++) {
+            // Force atomic contention
+            // Threads fight for exclusive access to the cache line containing 'shared_counter'
+            #pragma omp atomic
+            ctx->shared_counter++;
+        }
+    }
+}
+
 int main(int argc, char **argv) {
     double t0 = bench_now_sec();
 
     BENCH_PRINTF("Atomic fight start\n");
 
+    bench_results_t res;
+    bench_results_init(&res, "atomic_fight", argc, argv);
+    res.max_samples = bench_parse_ull(argc, argv, "--max-samples", DEFAULT_MAX_SAMPLES);
+    // Every thread performs one increment per iteration.
+    res.threads = omp_get_max_threads();
+    bench_results_set_rate(&res, (double)res.threads * 1e-6, "Mops/s");
+
     unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 100000ULL);
-    long shared_counter = 0;
-    unsigned long long iterations = bench_parse_iterations(argc, argv, 40000000ULL);
+    atomic_ctx_t ctx = { 0 };
 
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("Atomic fight warmup start\n");
 
-        #pragma omp parallel
-        {
-            for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-                #pragma omp atomic
-                shared_counter++;
-            }
-        }
-        shared_counter = 0;
+        atomic_run(&ctx, warmup_iters);
     }
 
-    double start = omp_get_wtime();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, 40000000ULL, atomic_run, &ctx);
+    ctx.shared_counter = 0;
 
     BENCH_PRINTF("Atomic fight loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-
-    #pragma omp parallel
-    {
-        for (unsigned long long iter = 0; iter < iterations; iter++) {
-            // Force atomic contention
-            // Threads fight for exclusive access to the cache line containing 'shared_counter'
-            #pragma omp atomic
-            shared_counter++;
-        }
-    }
+    bench_results_run(&res, atomic_run, &ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
-    double end = omp_get_wtime();
-    BENCH_PRINTF("Final Count: %ld\n", shared_counter);
+    BENCH_PRINTF("Final Count: %ld\n", ctx.shared_counter);
     BENCH_PRINTF("Atomic fight complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", (unsigned long long)shared_counter);
-    BENCH_PRINTF("Loop time: %f seconds\n", end - start);
+    bench_results_report(&res);
+    bench_results_free(&res);
     
     return 0;
 }
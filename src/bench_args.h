@@ -1,10 +1,20 @@
 #ifndef BENCH_ARGS_H
 #define BENCH_ARGS_H
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
+#include "bench_perf.h"
+#include "bench_rapl.h"
+#include "bench_mem.h"
+#include "bench_trace.h"
+
+// Upper bound on the number of per-sample timings kept for one run.
+// Kernels with more iterations than this time them in equal-sized chunks.
+#define BENCH_DEFAULT_MAX_SAMPLES 65536ULL
 
 static inline double bench_now_sec(void) {
     struct timespec ts;
@@ -12,43 +22,56 @@ static inline double bench_now_sec(void) {
     return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
 }
 
-static inline unsigned long long bench_parse_warmup_iterations(int argc, char **argv, unsigned long long def) {
+static inline const char *bench_find_arg(int argc, char **argv, const char *flag) {
     for (int i = 1; i < argc - 1; i++) {
-        if (strcmp(argv[i], "--warmup-iterations") == 0) {
-            return strtoull(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], flag) == 0) {
+            return argv[i + 1];
         }
     }
-    return def;
+    return NULL;
+}
+
+static inline const char *bench_parse_string(int argc, char **argv, const char *flag, const char *def) {
+    const char *value = bench_find_arg(argc, argv, flag);
+    return value ? value : def;
+}
+
+static inline unsigned long long bench_parse_ull(int argc, char **argv, const char *flag, unsigned long long def) {
+    const char *value = bench_find_arg(argc, argv, flag);
+    return value ? strtoull(value, NULL, 10) : def;
+}
+
+static inline unsigned long long bench_parse_warmup_iterations(int argc, char **argv, unsigned long long def) {
+    return bench_parse_ull(argc, argv, "--warmup-iterations", def);
 }
 
 static inline unsigned long long bench_parse_iterations(int argc, char **argv, unsigned long long def) {
-    for (int i = 1; i < argc - 1; i++) {
-        if (strcmp(argv[i], "--iterations") == 0) {
-            return strtoull(argv[i + 1], NULL, 10);
-        }
-    }
-    return def;
+    return bench_parse_ull(argc, argv, "--iterations", def);
 }
 
 static inline unsigned int bench_parse_seed(int argc, char **argv, unsigned int def) {
-    for (int i = 1; i < argc - 1; i++) {
-        if (strcmp(argv[i], "--seed") == 0) {
-            return (unsigned int)strtoul(argv[i + 1], NULL, 10);
-        }
+    return (unsigned int)bench_parse_ull(argc, argv, "--seed", def);
+}
+
+// Byte count with an optional binary suffix: 4096, 32K, 1.5M, 2G.
+static inline unsigned long long bench_parse_bytes_text(const char *text) {
+    char *end = NULL;
+    double value = strtod(text, &end);
+    switch (end ? *end : '\0') {
+        case 'k': case 'K': value *= 1024.0; break;
+        case 'm': case 'M': value *= 1024.0 * 1024.0; break;
+        case 'g': case 'G': value *= 1024.0 * 1024.0 * 1024.0; break;
+        default: break;
     }
-    return def;
+    return value > 0.0 ? (unsigned long long)value : 0ULL;
 }
 
 static inline size_t bench_parse_size(int argc, char **argv, size_t def) {
-    for (int i = 1; i < argc - 1; i++) {
-        if (strcmp(argv[i], "--size") == 0) {
-            return (size_t)strtoull(argv[i + 1], NULL, 10);
-        }
-    }
-    return def;
+    const char *value = bench_find_arg(argc, argv, "--size");
+    return value ? (size_t)bench_parse_bytes_text(value) : def;
 }
 
-static inline int bench_is_root(void) {
+static inline int bench_rank(void) {
     const char *rank = getenv("SLURM_PROCID");
     if (!rank || rank[0] == '\0') {
         rank = getenv("PMI_RANK");
@@ -60,12 +83,705 @@ static inline int bench_is_root(void) {
         rank = getenv("MV2_COMM_WORLD_RANK");
     }
     if (!rank || rank[0] == '\0') {
-        return 1;
+        return 0;
     }
-    return atoi(rank) == 0;
+    return atoi(rank);
+}
+
+static inline int bench_is_root(void) {
+    return bench_rank() == 0;
 }
 
 #define BENCH_PRINTF(...) do { if (bench_is_root()) printf(__VA_ARGS__); } while (0)
 #define BENCH_EPRINTF(...) do { if (bench_is_root()) fprintf(stderr, __VA_ARGS__); } while (0)
 
+/*
+ * Shared results layer.
+ *
+ * A kernel exposes its hot loop as a bench_run_fn_t that executes `iters`
+ * iterations on its context. bench_results_run() drives the timed loop in
+ * chunks of iters_per_sample iterations, storing the per-iteration time of
+ * each chunk in a buffer allocated before timing starts. The report prints
+ * the classic "Loop iterations"/"Loop time" lines, the latency distribution
+ * and throughput in the kernel's unit, and optionally a JSON or CSV record
+ * selected with --report json|csv (written to --report-file, where "%r" is
+ * replaced by the launcher rank, or to stdout on the root rank).
+ */
+typedef void (*bench_run_fn_t)(void *ctx, unsigned long long iters);
+
+// Combines a per-process measurement across ranks (e.g. an MPI max-reduction)
+// so that every rank derives the same calibrated iteration count.
+typedef double (*bench_agree_fn_t)(double value);
+
+// Upper bound on the time spent in a single calibration probe.
+#define BENCH_CALIBRATION_SEC 0.5
+
+static inline double bench_parse_duration(int argc, char **argv) {
+    const char *value = bench_find_arg(argc, argv, "--duration");
+    return value ? strtod(value, NULL) : 0.0;
+}
+
+/*
+ * Runs geometrically growing probes of `run` until one takes at least
+ * min(BENCH_CALIBRATION_SEC, target_sec / 10), then scales the probe to
+ * the iteration count that fills `target_sec` at the current frequency.
+ * Stores the measured seconds per iteration in *per_iter.
+ */
+static inline unsigned long long bench_calibrate_probe(bench_run_fn_t run, void *ctx, double target_sec,
+                                                       bench_agree_fn_t agree, double *per_iter) {
+    double probe_sec = target_sec / 10.0;
+    if (probe_sec > BENCH_CALIBRATION_SEC) {
+        probe_sec = BENCH_CALIBRATION_SEC;
+    }
+    unsigned long long n = 1ULL;
+    double elapsed = 0.0;
+    for (;;) {
+        double start = bench_now_sec();
+        run(ctx, n);
+        elapsed = bench_now_sec() - start;
+        if (agree) {
+            elapsed = agree(elapsed);
+        }
+        if (elapsed >= probe_sec || n >= (1ULL << 60)) {
+            break;
+        }
+        n *= (elapsed < probe_sec / 8.0) ? 8ULL : 2ULL;
+    }
+    *per_iter = elapsed / (double)n;
+    double iters = *per_iter > 0.0 ? target_sec / *per_iter : (double)n;
+    return iters < 1.0 ? 1ULL : (unsigned long long)(iters + 0.5);
+}
+
+static inline void bench_print_calibration(unsigned long long iterations, double target_sec, double per_iter) {
+    BENCH_PRINTF("Calibrated iterations: %llu (target %.3f s, %.6e s/iter; rerun with --iterations %llu for fixed work)\n",
+                 iterations, target_sec, per_iter, iterations);
+}
+
+static inline unsigned long long bench_calibrate_iterations(bench_run_fn_t run, void *ctx, double target_sec,
+                                                            bench_agree_fn_t agree) {
+    double per_iter = 0.0;
+    unsigned long long iterations = bench_calibrate_probe(run, ctx, target_sec, agree, &per_iter);
+    bench_print_calibration(iterations, target_sec, per_iter);
+    return iterations;
+}
+
+// --duration <sec> takes precedence over --iterations; otherwise the fixed count is used.
+static inline unsigned long long bench_resolve_iterations(int argc, char **argv, unsigned long long def,
+                                                          bench_run_fn_t run, void *ctx) {
+    double duration = bench_parse_duration(argc, argv);
+    if (duration > 0.0) {
+        return bench_calibrate_iterations(run, ctx, duration, NULL);
+    }
+    return bench_parse_iterations(argc, argv, def);
+}
+
+// Kernel-specific result (e.g. per-kernel bandwidth) added to the --report record.
+#define BENCH_MAX_METRICS 64
+
+typedef struct {
+    char key[48];
+    double value;
+} bench_metric_t;
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    double work_per_iter;       // units of work (already scaled to `unit`) per iteration
+    int latency;                // report time per unit of work instead of work per second
+    const char *report_format;  // "text", "json" or "csv"
+    const char *report_file;
+    unsigned long long max_samples;
+    unsigned long long iterations;
+    unsigned long long iters_per_sample;
+    double *samples;            // seconds per iteration, one entry per chunk
+    size_t nsamples;
+    double seconds;
+    int threads;                // worker threads aggregated into this result
+    double *per_thread;         // per-thread throughput (or latency); NULL for single-threaded runs
+    bench_perf_t perf;          // --counters perf: hardware counters over the timed loop
+    bench_rapl_t rapl;          // --energy: RAPL package/DRAM energy over the timed loop
+    size_t working_set;         // footprint in bytes for sized memory kernels; 0 otherwise
+    bench_trace_t trace;        // --trace-every/--trace-interval-us progress series
+    const char *trace_file;
+    bench_metric_t metrics[BENCH_MAX_METRICS];
+    int nmetrics;
+} bench_results_t;
+
+static inline void bench_results_init(bench_results_t *res, const char *name, int argc, char **argv) {
+    memset(res, 0, sizeof(*res));
+    res->name = name;
+    res->unit = "iter/s";
+    res->work_per_iter = 1.0;
+    res->threads = 1;
+    res->report_format = bench_parse_string(argc, argv, "--report", "text");
+    res->report_file = bench_find_arg(argc, argv, "--report-file");
+    res->max_samples = bench_parse_ull(argc, argv, "--max-samples", BENCH_DEFAULT_MAX_SAMPLES);
+    if (res->max_samples == 0ULL) {
+        res->max_samples = 1ULL;
+    }
+    bench_perf_init(&res->perf, bench_find_arg(argc, argv, "--counters"));
+    bench_rapl_init(&res->rapl, bench_find_arg(argc, argv, "--energy"),
+                    bench_parse_string(argc, argv, "--powercap-root", BENCH_POWERCAP_ROOT));
+    const char *trace_interval = bench_find_arg(argc, argv, "--trace-interval-us");
+    bench_trace_init(&res->trace, bench_parse_ull(argc, argv, "--trace-every", 0ULL),
+                     trace_interval ? strtod(trace_interval, NULL) : 0.0,
+                     bench_parse_ull(argc, argv, "--trace-samples", BENCH_TRACE_DEFAULT_CAPACITY));
+    res->trace_file = bench_find_arg(argc, argv, "--trace-file");
+    const char *numa_remote = bench_find_arg(argc, argv, "--numa-remote");
+    bench_mem_init(bench_find_arg(argc, argv, "--pages"), bench_find_arg(argc, argv, "--numa"),
+                   numa_remote ? atoi(numa_remote) : -1);
+}
+
+// Throughput: `work_per_iter` units of `unit` per second (e.g. 24e-9 * N, "GB/s").
+static inline void bench_results_set_rate(bench_results_t *res, double work_per_iter, const char *unit) {
+    res->work_per_iter = work_per_iter;
+    res->unit = unit;
+    res->latency = 0;
+}
+
+// Latency: nanoseconds per operation, with `ops_per_iter` operations per iteration (e.g. "ns/load").
+static inline void bench_results_set_latency(bench_results_t *res, double ops_per_iter, const char *unit) {
+    res->work_per_iter = ops_per_iter;
+    res->unit = unit;
+    res->latency = 1;
+}
+
+static inline void bench_results_add_metric(bench_results_t *res, const char *key, double value) {
+    if (res->nmetrics < BENCH_MAX_METRICS) {
+        snprintf(res->metrics[res->nmetrics].key, sizeof(res->metrics[0].key), "%s", key);
+        res->metrics[res->nmetrics].value = value;
+        res->nmetrics++;
+    }
+}
+
+// Runs `n` iterations in trace-sized steps, recording progress after each step.
+static inline void bench_results_run_traced(bench_results_t *res, bench_run_fn_t run, void *ctx,
+                                            unsigned long long n, unsigned long long done, double prev) {
+    bench_trace_t *tr = &res->trace;
+    while (n > 0ULL) {
+        unsigned long long step = bench_trace_next_step(tr, done, n);
+        run(ctx, step);
+        double now = bench_now_sec();
+        n -= step;
+        done += step;
+        bench_trace_step(tr, prev, now, step, done);
+        prev = now;
+    }
+}
+
+static inline void bench_results_run(bench_results_t *res, bench_run_fn_t run, void *ctx, unsigned long long iterations) {
+    unsigned long long chunk = (iterations + res->max_samples - 1ULL) / res->max_samples;
+    if (chunk == 0ULL) {
+        chunk = 1ULL;
+    }
+    size_t capacity = (size_t)((iterations + chunk - 1ULL) / chunk);
+    free(res->samples);
+    res->samples = (double*)malloc((capacity ? capacity : 1) * sizeof(double));
+    if (!res->samples) {
+        fprintf(stderr, "Failed to allocate %zu timing samples\n", capacity);
+        exit(1);
+    }
+    res->iterations = iterations;
+    res->iters_per_sample = chunk;
+    res->nsamples = 0;
+
+    bench_mem_scan();
+    bench_perf_open(&res->perf);
+    bench_rapl_start(&res->rapl, bench_now_sec());
+    bench_perf_start(&res->perf);
+    int traced = bench_trace_enabled(&res->trace);
+    double start = bench_now_sec();
+    double last = start;
+    bench_trace_start(&res->trace, start);
+    for (unsigned long long done = 0; done < iterations; done += chunk) {
+        unsigned long long n = (iterations - done < chunk) ? iterations - done : chunk;
+        if (traced) {
+            bench_results_run_traced(res, run, ctx, n, done, last);
+        } else {
+            run(ctx, n);
+        }
+        double now = bench_now_sec();
+        res->samples[res->nsamples++] = (now - last) / (double)n;
+        last = now;
+        bench_rapl_poll(&res->rapl, now);
+    }
+    bench_perf_stop(&res->perf);
+    bench_rapl_stop(&res->rapl);
+    bench_trace_finish(&res->trace, last, iterations);
+    res->seconds = last - start;
+}
+
+static inline int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of an ascending array.
+static inline double bench_percentile(const double *sorted, size_t n, double pct) {
+    if (n == 0) {
+        return 0.0;
+    }
+    size_t rank = (size_t)ceil(pct / 100.0 * (double)n);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[(rank > n ? n : rank) - 1];
+}
+
+typedef struct {
+    double min, p50, p90, p99, max, mean, stddev;
+    double value;  // throughput (or latency) over the whole loop
+    double best;   // throughput (or latency) of the fastest sample
+} bench_summary_t;
+
+static inline double bench_results_convert(const bench_results_t *res, double sec_per_iter) {
+    if (sec_per_iter <= 0.0 || res->work_per_iter <= 0.0) {
+        return 0.0;
+    }
+    return res->latency ? sec_per_iter * 1e9 / res->work_per_iter
+                        : res->work_per_iter / sec_per_iter;
+}
+
+static inline bench_summary_t bench_results_summarize(const bench_results_t *res) {
+    bench_summary_t s;
+    memset(&s, 0, sizeof(s));
+    size_t n = res->nsamples;
+    if (n == 0) {
+        return s;
+    }
+    double *sorted = (double*)malloc(n * sizeof(double));
+    memcpy(sorted, res->samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), bench_cmp_double);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+    s.mean = sum / (double)n;
+    double var = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        var += (sorted[i] - s.mean) * (sorted[i] - s.mean);
+    }
+    s.stddev = n > 1 ? sqrt(var / (double)(n - 1)) : 0.0;
+    s.min = sorted[0];
+    s.p50 = bench_percentile(sorted, n, 50.0);
+    s.p90 = bench_percentile(sorted, n, 90.0);
+    s.p99 = bench_percentile(sorted, n, 99.0);
+    s.max = sorted[n - 1];
+    s.value = bench_results_convert(res, res->iterations ? res->seconds / (double)res->iterations : 0.0);
+    s.best = bench_results_convert(res, s.min);
+    free(sorted);
+    return s;
+}
+
+// State shared with the --sweep-bytes driver (bench_sweep.h): after the
+// first point, report files are appended to and CSV headers are skipped.
+typedef struct {
+    int active;
+    int points;             // points reported so far
+    bench_summary_t last;   // summary of the most recent report
+    const char *unit;
+    int latency;
+    const char *column;     // optional extra summary column set by the kernel (e.g. "MLP")
+    double column_value;
+} bench_sweep_state_t;
+
+static bench_sweep_state_t bench_sweep_state;
+
+/*
+ * Flat key/value record used for the --report json|csv output. JSON emits
+ * one object per line; CSV emits a header row followed by a value row.
+ */
+#define BENCH_RECORD_BYTES 16384
+
+typedef struct {
+    int json;
+    size_t nfields;
+    char header[BENCH_RECORD_BYTES];
+    char row[BENCH_RECORD_BYTES];
+    size_t hlen, rlen;
+} bench_record_t;
+
+static inline void bench_record_append(char *buf, size_t *len, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static inline void bench_record_append(char *buf, size_t *len, const char *fmt, ...) {
+    if (*len >= BENCH_RECORD_BYTES - 1) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *len, BENCH_RECORD_BYTES - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        *len += (size_t)n;
+        if (*len >= BENCH_RECORD_BYTES) {
+            *len = BENCH_RECORD_BYTES - 1;
+        }
+    }
+}
+
+// `json_value` is emitted verbatim into JSON, `csv_value` into the CSV row.
+static inline void bench_record_raw(bench_record_t *rec, const char *key, const char *json_value, const char *csv_value) {
+    const char *sep = rec->nfields++ ? "," : "";
+    if (rec->json) {
+        bench_record_append(rec->row, &rec->rlen, "%s\"%s\":%s", sep, key, json_value);
+    } else {
+        bench_record_append(rec->header, &rec->hlen, "%s%s", sep, key);
+        bench_record_append(rec->row, &rec->rlen, "%s%s", sep, csv_value);
+    }
+}
+
+static inline void bench_record_str(bench_record_t *rec, const char *key, const char *value) {
+    char quoted[512];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", value);
+    bench_record_raw(rec, key, quoted, value);
+}
+
+static inline void bench_record_num(bench_record_t *rec, const char *key, double value) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.9g", value);
+    bench_record_raw(rec, key, text, text);
+}
+
+static inline void bench_record_list(bench_record_t *rec, const char *key, const double *values, size_t n) {
+    char json[BENCH_RECORD_BYTES / 4];
+    char csv[BENCH_RECORD_BYTES / 4];
+    size_t jlen = 0, clen = 0;
+    json[0] = csv[0] = '\0';
+    bench_record_append(json, &jlen, "[");
+    for (size_t i = 0; i < n && jlen + 32 < sizeof(json) && clen + 32 < sizeof(csv); i++) {
+        bench_record_append(json, &jlen, "%s%.9g", i ? "," : "", values[i]);
+        bench_record_append(csv, &clen, "%s%.9g", i ? ";" : "", values[i]);
+    }
+    bench_record_append(json, &jlen, "]");
+    bench_record_raw(rec, key, json, csv);
+}
+
+static inline void bench_record_write(const bench_record_t *rec, FILE *fp) {
+    if (rec->json) {
+        fprintf(fp, "{%s}\n", rec->row);
+    } else if (bench_sweep_state.points > 0) {
+        fprintf(fp, "%s\n", rec->row);
+    } else {
+        fprintf(fp, "%s\n%s\n", rec->header, rec->row);
+    }
+}
+
+// Counter features use the DVFS dataset column names; unavailable ones are omitted.
+static inline void bench_results_fill_counters(const bench_results_t *res, bench_record_t *rec) {
+    const bench_perf_t *perf = &res->perf;
+    bench_record_num(rec, "counters_available", perf->available);
+    if (!perf->available) {
+        return;
+    }
+    for (int i = 0; i < perf->nevents; i++) {
+        if (perf->valid[i]) {
+            char key[64];
+            snprintf(key, sizeof(key), "ctr_%s", perf->events[i].name);
+            bench_record_num(rec, key, perf->counts[i]);
+        }
+    }
+    bench_perf_metrics_t m = bench_perf_metrics(perf, res->seconds);
+    const char *keys[] = {"CPI", "Math_Intensity", "Stall_Ratio", "System_BW_Proxy",
+                          "Branch_MPKI", "GFLOPS_Approx", "Clock_Ratio"};
+    const double values[] = {m.cpi, m.math_intensity, m.stall_ratio, m.system_bw_proxy,
+                             m.branch_mpki, m.gflops_approx, m.clock_ratio};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (!isnan(values[i])) {
+            bench_record_num(rec, keys[i], values[i]);
+        }
+    }
+}
+
+typedef struct {
+    double package, dram;      // joules; dram < 0 when there is no DRAM zone
+    double total, watts, per_iter, edp, ed2p;
+} bench_energy_t;
+
+// Energy over the loop; per_iter counts every thread's iterations.
+static inline bench_energy_t bench_results_energy(const bench_results_t *res) {
+    bench_energy_t e;
+    e.package = bench_rapl_joules(&res->rapl, BENCH_RAPL_PACKAGE);
+    e.dram = bench_rapl_joules(&res->rapl, BENCH_RAPL_DRAM);
+    e.total = (e.package > 0.0 ? e.package : 0.0) + (e.dram > 0.0 ? e.dram : 0.0);
+    e.watts = res->seconds > 0.0 ? e.total / res->seconds : 0.0;
+    double iters = (double)res->iterations * (double)res->threads;
+    e.per_iter = iters > 0.0 ? e.total / iters : 0.0;
+    e.edp = e.total * res->seconds;
+    e.ed2p = e.edp * res->seconds;
+    return e;
+}
+
+static inline void bench_results_fill_energy(const bench_results_t *res, bench_record_t *rec) {
+    bench_energy_t e = bench_results_energy(res);
+    if (e.package >= 0.0) {
+        bench_record_num(rec, "energy_pkg_j", e.package);
+    }
+    if (e.dram >= 0.0) {
+        bench_record_num(rec, "energy_dram_j", e.dram);
+    }
+    bench_record_num(rec, "energy_j", e.total);
+    bench_record_num(rec, "power_w", e.watts);
+    bench_record_num(rec, "energy_per_iter_j", e.per_iter);
+    bench_record_num(rec, "edp_js", e.edp);
+    bench_record_num(rec, "ed2p_js2", e.ed2p);
+}
+
+static inline void bench_results_fill_record(const bench_results_t *res, const bench_summary_t *s, bench_record_t *rec) {
+    bench_record_str(rec, "benchmark", res->name);
+    bench_record_num(rec, "rank", bench_rank());
+    bench_record_num(rec, "threads", res->threads);
+    bench_record_num(rec, "iterations", (double)res->iterations);
+    bench_record_num(rec, "iters_per_sample", (double)res->iters_per_sample);
+    bench_record_num(rec, "samples", (double)res->nsamples);
+    bench_record_num(rec, "loop_time_s", res->seconds);
+    bench_record_num(rec, "iter_min_s", s->min);
+    bench_record_num(rec, "iter_p50_s", s->p50);
+    bench_record_num(rec, "iter_p90_s", s->p90);
+    bench_record_num(rec, "iter_p99_s", s->p99);
+    bench_record_num(rec, "iter_max_s", s->max);
+    bench_record_num(rec, "iter_mean_s", s->mean);
+    bench_record_num(rec, "iter_stddev_s", s->stddev);
+    bench_record_str(rec, "metric", res->latency ? "latency" : "throughput");
+    bench_record_num(rec, "value", s->value);
+    bench_record_num(rec, "best", s->best);
+    bench_record_str(rec, "unit", res->unit);
+    if (res->working_set) {
+        bench_record_num(rec, "bytes", (double)res->working_set);
+    }
+    if (res->per_thread) {
+        bench_record_list(rec, "per_thread", res->per_thread, (size_t)res->threads);
+    }
+    for (int i = 0; i < res->nmetrics; i++) {
+        bench_record_num(rec, res->metrics[i].key, res->metrics[i].value);
+    }
+    if (res->perf.enabled) {
+        bench_results_fill_counters(res, rec);
+    }
+    if (res->rapl.available) {
+        bench_results_fill_energy(res, rec);
+    }
+    if (bench_mem_state.requested && bench_mem_state.scanned) {
+        bench_record_str(rec, "pages_requested", bench_mem_state.requested);
+        bench_record_str(rec, "pages_obtained", bench_mem_state.obtained);
+        bench_record_num(rec, "huge_page_fraction", bench_mem_huge_fraction());
+    }
+    if (bench_mem_state.numa_name && bench_mem_state.scanned) {
+        bench_record_str(rec, "numa_policy", bench_mem_state.numa_name);
+        const char *keys[2] = {"numa_input_local_fraction", "numa_output_local_fraction"};
+        for (int role = 0; role < 2; role++) {
+            if (bench_mem_state.numa_pages[role] > 0.0) {
+                bench_record_num(rec, keys[role], bench_mem_state.numa_local[role] / bench_mem_state.numa_pages[role]);
+            }
+        }
+    }
+}
+
+// Expand "%r" in the --report-file template to the launcher rank.
+static inline void bench_report_path(const char *tmpl, char *out, size_t out_size) {
+    size_t o = 0;
+    for (const char *p = tmpl; *p && o + 1 < out_size; p++) {
+        if (p[0] == '%' && p[1] == 'r') {
+            o += (size_t)snprintf(out + o, out_size - o, "%d", bench_rank());
+            if (o >= out_size) {
+                o = out_size - 1;
+            }
+            p++;
+        } else {
+            out[o++] = *p;
+        }
+    }
+    out[o] = '\0';
+}
+
+static inline void bench_print_metric(const char *name, double value) {
+    if (isnan(value)) {
+        BENCH_PRINTF(" %s n/a", name);
+    } else {
+        BENCH_PRINTF(" %s %.4f", name, value);
+    }
+}
+
+static inline void bench_results_print_counters(const bench_results_t *res) {
+    const bench_perf_t *perf = &res->perf;
+    if (!perf->available) {
+        BENCH_PRINTF("Counters: unavailable (%s)\n", perf->status[0] ? perf->status : "not opened");
+        return;
+    }
+    BENCH_PRINTF("Counters:");
+    for (int i = 0; i < perf->nevents; i++) {
+        if (perf->valid[i]) {
+            BENCH_PRINTF(" %s %.0f", perf->events[i].name, perf->counts[i]);
+        } else {
+            BENCH_PRINTF(" %s n/a", perf->events[i].name);
+        }
+    }
+    BENCH_PRINTF("\n");
+    bench_perf_metrics_t m = bench_perf_metrics(perf, res->seconds);
+    BENCH_PRINTF("Counter metrics:");
+    bench_print_metric("CPI", m.cpi);
+    bench_print_metric("Math_Intensity", m.math_intensity);
+    bench_print_metric("Stall_Ratio", m.stall_ratio);
+    bench_print_metric("System_BW_Proxy", m.system_bw_proxy);
+    bench_print_metric("Branch_MPKI", m.branch_mpki);
+    bench_print_metric("GFLOPS_Approx", m.gflops_approx);
+    bench_print_metric("Clock_Ratio", m.clock_ratio);
+    BENCH_PRINTF("\n");
+}
+
+static inline void bench_results_print_energy(const bench_results_t *res) {
+    if (!res->rapl.available) {
+        if (res->rapl.mode == BENCH_RAPL_REQUIRED) {
+            BENCH_PRINTF("Energy: unavailable (%s)\n", res->rapl.status[0] ? res->rapl.status : "no readable zones");
+        }
+        return;
+    }
+    bench_energy_t e = bench_results_energy(res);
+    BENCH_PRINTF("Energy: package %.3f J", e.package > 0.0 ? e.package : 0.0);
+    if (e.dram >= 0.0) {
+        BENCH_PRINTF(" dram %.3f J", e.dram);
+    }
+    BENCH_PRINTF(" total %.3f J, average power %.3f W\n", e.total, e.watts);
+    BENCH_PRINTF("Energy per iteration: %.6e J, EDP %.6e J*s, ED2P %.6e J*s^2\n", e.per_iter, e.edp, e.ed2p);
+}
+
+// Sampled page placement per array role, relative to each allocating thread's node.
+static inline void bench_results_print_numa(void) {
+    BENCH_PRINTF("NUMA: policy %s", bench_mem_state.numa_name);
+    if (bench_mem_state.numa_single &&
+        (bench_mem_state.numa == BENCH_NUMA_REMOTE || bench_mem_state.numa == BENCH_NUMA_SPLIT)) {
+        BENCH_PRINTF(" (single node: placed locally)");
+    }
+    const char *names[2] = {"input", "output"};
+    for (int role = 1; role >= 0; role--) {
+        double pages = bench_mem_state.numa_pages[role];
+        if (pages <= 0.0) {
+            continue;
+        }
+        BENCH_PRINTF("; %s pages local %.1f%% [", names[role], 100.0 * bench_mem_state.numa_local[role] / pages);
+        const char *sep = "";
+        for (int n = 0; n < BENCH_NUMA_MAX_NODES; n++) {
+            if (bench_mem_state.numa_hist[role][n] > 0.0) {
+                BENCH_PRINTF("%snode%d %.1f%%", sep, n, 100.0 * bench_mem_state.numa_hist[role][n] / pages);
+                sep = " ";
+            }
+        }
+        BENCH_PRINTF("]");
+    }
+    BENCH_PRINTF("\n");
+}
+
+/*
+ * Dumps the progress series of one timing thread: to --trace-file as CSV
+ * (tid,mono_s,rel_s,iterations; "%r" expands to the rank, later dumps of
+ * the same process append), or as "TRACE" lines on stderr of the root rank.
+ */
+static inline void bench_results_dump_trace(const bench_results_t *res, int tid) {
+    static int written;
+    if (!res->trace.ring) {
+        return;
+    }
+    if (res->trace_file) {
+        char path[4096];
+        bench_report_path(res->trace_file, path, sizeof(path));
+        FILE *fp = fopen(path, written ? "a" : "w");
+        if (!fp) {
+            fprintf(stderr, "Cannot open trace file %s\n", path);
+            return;
+        }
+        if (!written) {
+            fprintf(fp, "tid,mono_s,rel_s,iterations\n");
+        }
+        bench_trace_write(&res->trace, fp, tid, 1);
+        fclose(fp);
+    } else if (bench_is_root()) {
+        if (!written) {
+            fprintf(stderr, "TRACE tid mono_s rel_s iterations\n");
+        }
+        bench_trace_write(&res->trace, stderr, tid, 0);
+    }
+    written = 1;
+}
+
+static inline void bench_results_report(const bench_results_t *res) {
+    bench_summary_t s = bench_results_summarize(res);
+    bench_results_dump_trace(res, 0);
+
+    // Team total, as the single-process loops always printed it.
+    if (res->threads > 1) {
+        BENCH_PRINTF("Loop iterations: %llu (%llu per thread)\n", res->iterations * (unsigned long long)res->threads,
+                     res->iterations);
+    } else {
+        BENCH_PRINTF("Loop iterations: %llu\n", res->iterations);
+    }
+    BENCH_PRINTF("Loop time: %f seconds\n", res->seconds);
+    BENCH_PRINTF("Iteration time (s): min %.9e p50 %.9e p90 %.9e p99 %.9e max %.9e (samples %zu x %llu iters)\n",
+                 s.min, s.p50, s.p90, s.p99, s.max, res->nsamples, res->iters_per_sample);
+    if (res->per_thread) {
+        for (int t = 0; t < res->threads; t++) {
+            BENCH_PRINTF("Thread %d %s: %f %s\n", t, res->latency ? "latency" : "throughput",
+                         res->per_thread[t], res->unit);
+        }
+    }
+    const char *label = res->latency ? (res->per_thread ? "Aggregate latency" : "Latency")
+                                     : (res->per_thread ? "Aggregate throughput" : "Throughput");
+    BENCH_PRINTF("%s: %f %s (best %f)\n", label, s.value, res->unit, s.best);
+    if (res->perf.enabled) {
+        bench_results_print_counters(res);
+    }
+    bench_results_print_energy(res);
+    if (bench_mem_state.requested && bench_mem_state.scanned) {
+        BENCH_PRINTF("Pages: requested %s, obtained %s (%.1f%% of %.1f MiB resident in huge pages)\n",
+                     bench_mem_state.requested, bench_mem_state.obtained, 100.0 * bench_mem_huge_fraction(),
+                     bench_mem_state.resident_kb / 1024.0);
+    }
+    if (bench_mem_state.numa_name && bench_mem_state.scanned) {
+        bench_results_print_numa();
+    }
+    if (bench_sweep_state.active) {
+        bench_sweep_state.last = s;
+        bench_sweep_state.unit = res->unit;
+        bench_sweep_state.latency = res->latency;
+    }
+
+    int json = strcmp(res->report_format, "json") == 0;
+    int csv = strcmp(res->report_format, "csv") == 0;
+    if (!json && !csv) {
+        return;
+    }
+    FILE *fp = NULL;
+    if (res->report_file) {
+        char path[4096];
+        bench_report_path(res->report_file, path, sizeof(path));
+        fp = fopen(path, bench_sweep_state.points > 0 ? "a" : "w");
+        if (!fp) {
+            fprintf(stderr, "Cannot open report file %s\n", path);
+            return;
+        }
+    } else if (bench_is_root()) {
+        fp = stdout;
+    } else {
+        return;
+    }
+    bench_record_t *rec = (bench_record_t*)calloc(1, sizeof(bench_record_t));
+    rec->json = json;
+    bench_results_fill_record(res, &s, rec);
+    bench_record_write(rec, fp);
+    free(rec);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+}
+
+static inline void bench_results_free(bench_results_t *res) {
+    bench_trace_free(&res->trace);
+    free(res->samples);
+    free(res->per_thread);
+    res->samples = NULL;
+    res->per_thread = NULL;
+    res->nsamples = 0;
+}
+
 #endif
@@ -0,0 +1,75 @@
+#ifndef BENCH_ISA_H
+#define BENCH_ISA_H
+
+/*
+ * SIMD instruction-set selection for kernels written with explicit intrinsics.
+ *
+ * Such kernels are compiled once per ISA with target attributes, so a single
+ * binary carries every vector width regardless of -march. bench_isa_select()
+ * picks the widest ISA the CPU and OS support (CPUID and XGETBV, through
+ * __builtin_cpu_supports), or the one named by --isa scalar|sse2|avx2|avx512.
+ * This keeps the code path identical across platforms, e.g. AVX-512 on
+ * Sapphire Rapids and on Zen 4c (which executes it as two 256-bit halves).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_args.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_HAVE_X86_ISA 1
+#else
+#define BENCH_HAVE_X86_ISA 0
+#endif
+
+enum { BENCH_ISA_SCALAR, BENCH_ISA_SSE2, BENCH_ISA_AVX2, BENCH_ISA_AVX512, BENCH_ISA_COUNT };
+
+static const char *const bench_isa_names[BENCH_ISA_COUNT] = { "scalar", "sse2", "avx2", "avx512" };
+static const int bench_isa_bits[BENCH_ISA_COUNT] = { 64, 128, 256, 512 };
+
+static inline int bench_isa_supported(int isa) {
+#if BENCH_HAVE_X86_ISA
+    __builtin_cpu_init();
+    switch (isa) {
+    case BENCH_ISA_SCALAR: return 1;
+    case BENCH_ISA_SSE2: return __builtin_cpu_supports("sse2");
+    case BENCH_ISA_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case BENCH_ISA_AVX512: return __builtin_cpu_supports("avx512f");
+    default: return 0;
+    }
+#else
+    return isa == BENCH_ISA_SCALAR;
+#endif
+}
+
+// Widest supported ISA.
+static inline int bench_isa_detect(void) {
+    for (int isa = BENCH_ISA_COUNT - 1; isa > BENCH_ISA_SCALAR; isa--) {
+        if (bench_isa_supported(isa)) {
+            return isa;
+        }
+    }
+    return BENCH_ISA_SCALAR;
+}
+
+// --isa auto|scalar|sse2|avx2|avx512 (default auto); -1 when unknown or unsupported.
+static inline int bench_isa_select(int argc, char **argv) {
+    const char *name = bench_parse_string(argc, argv, "--isa", "auto");
+    if (strcmp(name, "auto") == 0) {
+        return bench_isa_detect();
+    }
+    for (int isa = 0; isa < BENCH_ISA_COUNT; isa++) {
+        if (strcmp(name, bench_isa_names[isa]) == 0) {
+            if (!bench_isa_supported(isa)) {
+                fprintf(stderr, "--isa %s is not supported by this CPU (widest: %s)\n", name,
+                        bench_isa_names[bench_isa_detect()]);
+                return -1;
+            }
+            return isa;
+        }
+    }
+    fprintf(stderr, "Unknown --isa %s (expected auto, scalar, sse2, avx2 or avx512)\n", name);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef BENCH_MEM_H
+#define BENCH_MEM_H
+
+/*
+ * Page-size controlled allocation for large benchmark arrays (--pages).
+ *
+ *   4k   anonymous mmap with MADV_NOHUGEPAGE (no THP, base pages only)
+ *   thp  2 MB-aligned anonymous mmap with MADV_HUGEPAGE
+ *   2m   MAP_HUGETLB | MAP_HUGE_2MB from the hugetlbfs pool
+ *   1g   MAP_HUGETLB | MAP_HUGE_1GB from the hugetlbfs pool
+ *
+ * Without --pages, bench_alloc() is plain malloc() and nothing changes. An
+ * empty hugetlb pool falls back to thp with a warning. The mapping is only
+ * advised here; the kernel first-touches it as before, and the harness then
+ * reads /proc/self/smaps before the timed loop to report the backing that
+ * was actually obtained (huge-page fraction of the resident set).
+ *
+ * --numa placement (bench_numa.h) also goes through this allocator: each
+ * array is mbind()-ed before first touch according to its role (input or
+ * output) and its pages are sampled with move_pages() in the same scan.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "bench_numa.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define BENCH_MEM_MIN_ALLOCS 64    // initial size of the allocation table, which doubles as needed
+#define BENCH_MEM_2MB (2UL * 1024 * 1024)
+#define BENCH_MEM_1GB (1024UL * 1024 * 1024)
+
+enum {
+    BENCH_MEM_INPUT,
+    BENCH_MEM_OUTPUT
+};
+
+typedef struct {
+    void *ptr;
+    size_t len;     // mapped length, for munmap
+    int role;       // BENCH_MEM_INPUT or BENCH_MEM_OUTPUT
+    int home;       // node of the allocating thread
+} bench_mem_alloc_t;
+
+typedef struct {
+    const char *requested;     // --pages value, NULL when not given
+    const char *numa_name;     // --numa value, NULL when not given
+    int numa;                  // BENCH_NUMA_* policy
+    int numa_remote;           // --numa-remote node, -1 for automatic
+    int numa_single;           // only one node: remote placement unavailable
+    bench_mem_alloc_t *allocs;      // every live mapping, so bench_free() can munmap it
+    int nallocs;
+    int capacity;
+    int lock;
+    int dirty;                 // allocations changed since the last smaps scan
+    // Last smaps scan over all live allocations.
+    int scanned;
+    double resident_kb, huge_kb;
+    const char *obtained;      // "4k", "thp", "hugetlb-2m", "hugetlb-1g"
+    // Last move_pages sample, per role: pages per node and pages on the home node.
+    double numa_hist[2][BENCH_NUMA_MAX_NODES];
+    double numa_pages[2], numa_local[2];
+} bench_mem_state_t;
+
+static bench_mem_state_t bench_mem_state;
+
+static inline void bench_mem_lock(void) {
+    while (__atomic_test_and_set(&bench_mem_state.lock, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static inline void bench_mem_unlock(void) {
+    __atomic_clear(&bench_mem_state.lock, __ATOMIC_RELEASE);
+}
+
+// Selects the page and NUMA policies for later bench_alloc() calls; NULL keeps malloc.
+static inline void bench_mem_init(const char *pages, const char *numa, int numa_remote) {
+    bench_mem_state.numa = bench_numa_parse_policy(numa);
+    bench_mem_state.numa_name = bench_mem_state.numa != BENCH_NUMA_NONE ? numa : NULL;
+    bench_mem_state.numa_remote = numa_remote;
+    int nodes[BENCH_NUMA_MAX_NODES];
+    bench_mem_state.numa_single = bench_numa_nodes(nodes, BENCH_NUMA_MAX_NODES) < 2 && numa_remote < 0;
+    if (!pages || (strcmp(pages, "4k") != 0 && strcmp(pages, "thp") != 0 &&
+                   strcmp(pages, "2m") != 0 && strcmp(pages, "1g") != 0)) {
+        if (pages) {
+            fprintf(stderr, "Unknown --pages %s (expected 4k, thp, 2m or 1g); using malloc\n", pages);
+        }
+        bench_mem_state.requested = NULL;
+        return;
+    }
+    bench_mem_state.requested = pages;
+}
+
+static inline size_t bench_mem_round(size_t bytes, size_t align) {
+    return (bytes + align - 1) / align * align;
+}
+
+// 2 MB-aligned anonymous mapping; the unaligned head and tail are unmapped.
+// `advice` < 0 leaves THP to the system default.
+static inline void *bench_mem_map_aligned(size_t len, int advice) {
+    size_t span = len + BENCH_MEM_2MB;
+    char *raw = (char*)mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (char*)MAP_FAILED) {
+        return NULL;
+    }
+    char *aligned = (char*)(((uintptr_t)raw + BENCH_MEM_2MB - 1) & ~(uintptr_t)(BENCH_MEM_2MB - 1));
+    if (aligned > raw) {
+        munmap(raw, (size_t)(aligned - raw));
+    }
+    size_t tail = (size_t)(raw + span - (aligned + len));
+    if (tail > 0) {
+        munmap(aligned + len, tail);
+    }
+    if (advice >= 0) {
+        madvise(aligned, len, advice);
+    }
+    return aligned;
+}
+
+static inline void *bench_alloc_role(size_t bytes, int role) {
+    const char *pages = bench_mem_state.requested;
+    if (!pages && bench_mem_state.numa == BENCH_NUMA_NONE) {
+        return malloc(bytes);
+    }
+    void *ptr = NULL;
+    size_t len = 0;
+    if (pages && (strcmp(pages, "2m") == 0 || strcmp(pages, "1g") == 0)) {
+        int is_1g = pages[0] == '1';
+        len = bench_mem_round(bytes, is_1g ? BENCH_MEM_1GB : BENCH_MEM_2MB);
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (is_1g ? MAP_HUGE_1GB : MAP_HUGE_2MB), -1, 0);
+        if (ptr == MAP_FAILED) {
+            ptr = NULL;
+            fprintf(stderr, "Warning: MAP_HUGETLB (%s) failed for %zu bytes; falling back to thp\n", pages, bytes);
+        }
+    }
+    if (!ptr) {
+        len = bench_mem_round(bytes ? bytes : 1, BENCH_MEM_2MB);
+        ptr = bench_mem_map_aligned(len, !pages ? -1 : strcmp(pages, "4k") == 0 ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    }
+    if (!ptr) {
+        return NULL;
+    }
+    int home = bench_numa_current_node();
+    bench_numa_bind(ptr, len, bench_mem_state.numa, role == BENCH_MEM_OUTPUT, home,
+                    bench_numa_remote_node(home, bench_mem_state.numa_remote));
+    bench_mem_lock();
+    if (bench_mem_state.nallocs == bench_mem_state.capacity) {
+        int capacity = bench_mem_state.capacity ? 2 * bench_mem_state.capacity : BENCH_MEM_MIN_ALLOCS;
+        bench_mem_alloc_t *allocs = (bench_mem_alloc_t*)realloc(bench_mem_state.allocs,
+                                                                (size_t)capacity * sizeof(bench_mem_alloc_t));
+        if (!allocs) {
+            // Untracked, the block could be neither freed nor scanned.
+            bench_mem_unlock();
+            munmap(ptr, len);
+            return NULL;
+        }
+        bench_mem_state.allocs = allocs;
+        bench_mem_state.capacity = capacity;
+    }
+    bench_mem_alloc_t *a = &bench_mem_state.allocs[bench_mem_state.nallocs++];
+    a->ptr = ptr;
+    a->len = len;
+    a->role = role;
+    a->home = home;
+    bench_mem_state.dirty = 1;
+    bench_mem_unlock();
+    return ptr;
+}
+
+// Arrays the kernel only reads (placed remote under --numa split).
+static inline void *bench_alloc(size_t bytes) {
+    return bench_alloc_role(bytes, BENCH_MEM_INPUT);
+}
+
+// Arrays the kernel writes (kept local under --numa split).
+static inline void *bench_alloc_output(size_t bytes) {
+    return bench_alloc_role(bytes, BENCH_MEM_OUTPUT);
+}
+
+// Every mapping is in the table; a block that is not came from malloc() (no --pages or --numa).
+static inline void bench_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    size_t len = 0;
+    bench_mem_lock();
+    for (int i = 0; i < bench_mem_state.nallocs; i++) {
+        if (bench_mem_state.allocs[i].ptr == ptr) {
+            len = bench_mem_state.allocs[i].len;
+            bench_mem_state.allocs[i] = bench_mem_state.allocs[--bench_mem_state.nallocs];
+            bench_mem_state.dirty = 1;
+            break;
+        }
+    }
+    bench_mem_unlock();
+    if (len) {
+        munmap(ptr, len);
+    } else {
+        free(ptr);
+    }
+}
+
+static inline int bench_mem_overlaps(unsigned long start, unsigned long end) {
+    for (int i = 0; i < bench_mem_state.nallocs; i++) {
+        unsigned long lo = (unsigned long)(uintptr_t)bench_mem_state.allocs[i].ptr;
+        unsigned long hi = lo + bench_mem_state.allocs[i].len;
+        if (start < hi && end > lo) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Node histogram of every live allocation, by role, via move_pages().
+static inline void bench_mem_scan_numa(void) {
+    memset(bench_mem_state.numa_hist, 0, sizeof(bench_mem_state.numa_hist));
+    memset(bench_mem_state.numa_pages, 0, sizeof(bench_mem_state.numa_pages));
+    memset(bench_mem_state.numa_local, 0, sizeof(bench_mem_state.numa_local));
+    for (int i = 0; i < bench_mem_state.nallocs; i++) {
+        const bench_mem_alloc_t *a = &bench_mem_state.allocs[i];
+        double hist[BENCH_NUMA_MAX_NODES];
+        memset(hist, 0, sizeof(hist));
+        bench_mem_state.numa_pages[a->role] += bench_numa_query(a->ptr, a->len, hist);
+        bench_mem_state.numa_local[a->role] += hist[a->home];
+        for (int n = 0; n < BENCH_NUMA_MAX_NODES; n++) {
+            bench_mem_state.numa_hist[a->role][n] += hist[n];
+        }
+    }
+}
+
+/*
+ * Sums Rss, AnonHugePages and hugetlb usage of every live allocation from
+ * /proc/self/smaps and samples their NUMA placement. Runs once per set of
+ * allocations (call after first touch, before timing); later calls are
+ * no-ops until memory changes.
+ */
+static inline void bench_mem_scan(void) {
+    if ((!bench_mem_state.requested && bench_mem_state.numa == BENCH_NUMA_NONE) ||
+        !__atomic_load_n(&bench_mem_state.dirty, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    bench_mem_lock();
+    if (!bench_mem_state.dirty) {
+        bench_mem_unlock();
+        return;
+    }
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    double rss = 0.0, thp = 0.0, hugetlb = 0.0, page_kb = 4.0;
+    if (fp) {
+        char line[512];
+        int match = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            unsigned long start = 0, end = 0;
+            double kb = 0.0;
+            if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+                match = bench_mem_overlaps(start, end);
+            } else if (!match) {
+                continue;
+            } else if (sscanf(line, "Rss: %lf", &kb) == 1) {
+                rss += kb;
+            } else if (sscanf(line, "AnonHugePages: %lf", &kb) == 1) {
+                thp += kb;
+            } else if (sscanf(line, "Private_Hugetlb: %lf", &kb) == 1 ||
+                       sscanf(line, "Shared_Hugetlb: %lf", &kb) == 1) {
+                hugetlb += kb;
+            } else if (sscanf(line, "KernelPageSize: %lf", &kb) == 1 && kb > page_kb) {
+                page_kb = kb;
+            }
+        }
+        fclose(fp);
+    }
+    bench_mem_state.resident_kb = rss + hugetlb;
+    bench_mem_state.huge_kb = thp + hugetlb;
+    bench_mem_state.obtained = hugetlb > 0.0 ? (page_kb >= 1024.0 * 1024.0 ? "hugetlb-1g" : "hugetlb-2m")
+                             : thp > 0.0 ? "thp" : "4k";
+    bench_mem_state.scanned = fp != NULL;
+    if (bench_mem_state.numa != BENCH_NUMA_NONE) {
+        bench_mem_scan_numa();
+    }
+    bench_mem_state.dirty = 0;
+    bench_mem_unlock();
+}
+
+// Fraction of the resident allocation backed by huge pages (THP or hugetlb).
+static inline double bench_mem_huge_fraction(void) {
+    return bench_mem_state.resident_kb > 0.0 ? bench_mem_state.huge_kb / bench_mem_state.resident_kb : 0.0;
+}
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef BENCH_MTX_H
+#define BENCH_MTX_H
+
+/*
+ * Matrix Market reader producing CSR (--matrix file.mtx).
+ *
+ * Supports "matrix coordinate" files with real, double, integer or pattern
+ * values (pattern entries become 1.0) and general, symmetric or
+ * skew-symmetric storage; the missing triangle of symmetric matrices is
+ * expanded. The file is mmap()-ed and parsed in a single pass into COO,
+ * then bucketed by row with columns sorted within each row.
+ *
+ * bench_csr_rcm() renumbers a square matrix with reverse Cuthill-McKee,
+ * pulling non-zeros towards the diagonal so that the x gathers of a
+ * multiply stay within a narrow window.
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    int nrows, ncols;
+    int nnz;
+    int *row_ptr;        // nrows + 1
+    int *col_indices;    // nnz, sorted within each row
+    double *values;      // nnz
+} bench_csr_t;
+
+static inline void bench_csr_free(bench_csr_t *csr) {
+    free(csr->row_ptr);
+    free(csr->col_indices);
+    free(csr->values);
+    memset(csr, 0, sizeof(*csr));
+}
+
+typedef struct {
+    int col;
+    double value;
+} bench_csr_entry_t;
+
+static inline int bench_csr_entry_cmp(const void *a, const void *b) {
+    const bench_csr_entry_t *x = (const bench_csr_entry_t*)a;
+    const bench_csr_entry_t *y = (const bench_csr_entry_t*)b;
+    return (x->col > y->col) - (x->col < y->col);
+}
+
+// Sorts the columns of every row (insertion sort for short rows, qsort otherwise).
+static inline void bench_csr_sort_rows(bench_csr_t *csr) {
+    bench_csr_entry_t *tmp = NULL;
+    size_t tmp_len = 0;
+    for (int r = 0; r < csr->nrows; r++) {
+        int lo = csr->row_ptr[r], hi = csr->row_ptr[r + 1];
+        int *c = csr->col_indices;
+        double *v = csr->values;
+        if (hi - lo <= 32) {
+            for (int i = lo + 1; i < hi; i++) {
+                int ci = c[i];
+                double vi = v[i];
+                int j = i - 1;
+                while (j >= lo && c[j] > ci) {
+                    c[j + 1] = c[j];
+                    v[j + 1] = v[j];
+                    j--;
+                }
+                c[j + 1] = ci;
+                v[j + 1] = vi;
+            }
+            continue;
+        }
+        if ((size_t)(hi - lo) > tmp_len) {
+            tmp_len = (size_t)(hi - lo);
+            tmp = (bench_csr_entry_t*)realloc(tmp, tmp_len * sizeof(bench_csr_entry_t));
+        }
+        for (int i = lo; i < hi; i++) {
+            tmp[i - lo].col = c[i];
+            tmp[i - lo].value = v[i];
+        }
+        qsort(tmp, (size_t)(hi - lo), sizeof(bench_csr_entry_t), bench_csr_entry_cmp);
+        for (int i = lo; i < hi; i++) {
+            c[i] = tmp[i - lo].col;
+            v[i] = tmp[i - lo].value;
+        }
+    }
+    free(tmp);
+}
+
+// Parsing cursor over the mapped file; `end` bounds every read.
+typedef struct {
+    const char *p, *end;
+} bench_mtx_cursor_t;
+
+static inline void bench_mtx_skip_line(bench_mtx_cursor_t *cur) {
+    while (cur->p < cur->end && *cur->p != '\n') cur->p++;
+    if (cur->p < cur->end) cur->p++;
+}
+
+static inline void bench_mtx_skip_space(bench_mtx_cursor_t *cur) {
+    while (cur->p < cur->end && isspace((unsigned char)*cur->p)) cur->p++;
+}
+
+static inline int bench_mtx_long(bench_mtx_cursor_t *cur, long *out) {
+    bench_mtx_skip_space(cur);
+    int neg = 0;
+    if (cur->p < cur->end && (*cur->p == '-' || *cur->p == '+')) {
+        neg = *cur->p == '-';
+        cur->p++;
+    }
+    if (cur->p >= cur->end || !isdigit((unsigned char)*cur->p)) {
+        return -1;
+    }
+    long v = 0;
+    while (cur->p < cur->end && isdigit((unsigned char)*cur->p)) {
+        v = v * 10 + (*cur->p - '0');
+        cur->p++;
+    }
+    *out = neg ? -v : v;
+    return 0;
+}
+
+static inline int bench_mtx_double(bench_mtx_cursor_t *cur, double *out) {
+    bench_mtx_skip_space(cur);
+    char buf[64];
+    size_t n = 0;
+    while (cur->p < cur->end && !isspace((unsigned char)*cur->p) && n + 1 < sizeof(buf)) {
+        buf[n++] = *cur->p++;
+    }
+    buf[n] = '\0';
+    char *stop = NULL;
+    *out = strtod(buf, &stop);
+    return (n > 0 && *stop == '\0') ? 0 : -1;
+}
+
+// Largest |row - column| over the non-zeros.
+static inline int bench_csr_bandwidth(const bench_csr_t *csr) {
+    int band = 0;
+    for (int r = 0; r < csr->nrows; r++) {
+        for (int j = csr->row_ptr[r]; j < csr->row_ptr[r + 1]; j++) {
+            int d = csr->col_indices[j] > r ? csr->col_indices[j] - r : r - csr->col_indices[j];
+            band = d > band ? d : band;
+        }
+    }
+    return band;
+}
+
+typedef struct {
+    int key, node;
+} bench_csr_rank_t;
+
+static inline int bench_csr_rank_cmp(const void *a, const void *b) {
+    const bench_csr_rank_t *x = (const bench_csr_rank_t*)a;
+    const bench_csr_rank_t *y = (const bench_csr_rank_t*)b;
+    if (x->key != y->key) {
+        return (x->key > y->key) - (x->key < y->key);
+    }
+    return (x->node > y->node) - (x->node < y->node);
+}
+
+/*
+ * Reverse Cuthill-McKee on the pattern of A + A^T: breadth-first from a
+ * minimum-degree node of each component, neighbours in increasing degree,
+ * order reversed. Rows and columns are renumbered alike (P A P^T). Returns
+ * -1 for a non-square matrix.
+ */
+static inline int bench_csr_rcm(bench_csr_t *csr) {
+    int n = csr->nrows;
+    if (n != csr->ncols) {
+        return -1;
+    }
+    int *deg = (int*)calloc((size_t)n + 1, sizeof(int));
+    for (int r = 0; r < n; r++) {
+        for (int j = csr->row_ptr[r]; j < csr->row_ptr[r + 1]; j++) {
+            if (csr->col_indices[j] != r) {
+                deg[r + 1]++;
+                deg[csr->col_indices[j] + 1]++;
+            }
+        }
+    }
+    for (int r = 0; r < n; r++) {
+        deg[r + 1] += deg[r];
+    }
+    int *adj = (int*)malloc((size_t)(deg[n] ? deg[n] : 1) * sizeof(int));
+    int *fill = (int*)malloc((size_t)n * sizeof(int));
+    memcpy(fill, deg, (size_t)n * sizeof(int));
+    for (int r = 0; r < n; r++) {
+        for (int j = csr->row_ptr[r]; j < csr->row_ptr[r + 1]; j++) {
+            int c = csr->col_indices[j];
+            if (c != r) {
+                adj[fill[r]++] = c;
+                adj[fill[c]++] = r;
+            }
+        }
+    }
+    free(fill);
+
+    // Nodes by increasing degree, to pick each component's start.
+    bench_csr_rank_t *by_degree = (bench_csr_rank_t*)malloc((size_t)n * sizeof(bench_csr_rank_t));
+    for (int r = 0; r < n; r++) {
+        by_degree[r].key = deg[r + 1] - deg[r];
+        by_degree[r].node = r;
+    }
+    qsort(by_degree, (size_t)n, sizeof(bench_csr_rank_t), bench_csr_rank_cmp);
+
+    int *order = (int*)malloc((size_t)n * sizeof(int));
+    char *visited = (char*)calloc((size_t)n, 1);
+    bench_csr_rank_t *nbrs = NULL;
+    size_t nbrs_len = 0;
+    int tail = 0, next_start = 0;
+    for (int head = 0; head < n; head++) {
+        if (head == tail) {
+            while (visited[by_degree[next_start].node]) next_start++;
+            order[tail++] = by_degree[next_start].node;
+            visited[by_degree[next_start].node] = 1;
+        }
+        int u = order[head];
+        int count = 0;
+        if ((size_t)(deg[u + 1] - deg[u]) > nbrs_len) {
+            nbrs_len = (size_t)(deg[u + 1] - deg[u]);
+            nbrs = (bench_csr_rank_t*)realloc(nbrs, nbrs_len * sizeof(bench_csr_rank_t));
+        }
+        for (int j = deg[u]; j < deg[u + 1]; j++) {
+            int v = adj[j];
+            if (!visited[v]) {
+                visited[v] = 1;
+                nbrs[count].key = deg[v + 1] - deg[v];
+                nbrs[count].node = v;
+                count++;
+            }
+        }
+        qsort(nbrs, (size_t)count, sizeof(bench_csr_rank_t), bench_csr_rank_cmp);
+        for (int k = 0; k < count; k++) {
+            order[tail++] = nbrs[k].node;
+        }
+    }
+    free(nbrs);
+    free(visited);
+    free(by_degree);
+    free(adj);
+    free(deg);
+
+    // New row i is old row order[n - 1 - i].
+    int *inv = (int*)malloc((size_t)n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        inv[order[n - 1 - i]] = i;
+    }
+    int *row_ptr = (int*)malloc(((size_t)n + 1) * sizeof(int));
+    int *cols = (int*)malloc((size_t)(csr->nnz ? csr->nnz : 1) * sizeof(int));
+    double *vals = (double*)malloc((size_t)(csr->nnz ? csr->nnz : 1) * sizeof(double));
+    row_ptr[0] = 0;
+    for (int i = 0; i < n; i++) {
+        int old = order[n - 1 - i];
+        int at = row_ptr[i];
+        for (int j = csr->row_ptr[old]; j < csr->row_ptr[old + 1]; j++, at++) {
+            cols[at] = inv[csr->col_indices[j]];
+            vals[at] = csr->values[j];
+        }
+        row_ptr[i + 1] = at;
+    }
+    free(inv);
+    free(order);
+    free(csr->row_ptr);
+    free(csr->col_indices);
+    free(csr->values);
+    csr->row_ptr = row_ptr;
+    csr->col_indices = cols;
+    csr->values = vals;
+    bench_csr_sort_rows(csr);
+    return 0;
+}
+
+/*
+ * Reads `path` into `csr` (arrays from malloc). Returns 0 on success or
+ * -1 after printing the reason.
+ */
+static inline int bench_mtx_read(const char *path, bench_csr_t *csr) {
+    memset(csr, 0, sizeof(*csr));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty or unreadable\n", path);
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    char *data = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    bench_mtx_cursor_t cur = { data, data + size };
+
+    char banner[5][32] = { "", "", "", "", "" };
+    {
+        const char *eol = memchr(cur.p, '\n', size);
+        size_t len = eol ? (size_t)(eol - cur.p) : size;
+        char line[256];
+        snprintf(line, sizeof(line), "%.*s", (int)(len < sizeof(line) - 1 ? len : sizeof(line) - 1), cur.p);
+        sscanf(line, "%31s %31s %31s %31s %31s", banner[0], banner[1], banner[2], banner[3], banner[4]);
+    }
+    int pattern = strcasecmp(banner[3], "pattern") == 0;
+    int symmetric = strcasecmp(banner[4], "symmetric") == 0;
+    int skew = strcasecmp(banner[4], "skew-symmetric") == 0;
+    if (strcasecmp(banner[0], "%%MatrixMarket") != 0 || strcasecmp(banner[1], "matrix") != 0 ||
+        strcasecmp(banner[2], "coordinate") != 0 ||
+        !(pattern || strcasecmp(banner[3], "real") == 0 || strcasecmp(banner[3], "double") == 0 ||
+          strcasecmp(banner[3], "integer") == 0) ||
+        !(symmetric || skew || strcasecmp(banner[4], "general") == 0)) {
+        fprintf(stderr, "%s: unsupported Matrix Market header (need matrix coordinate real|integer|pattern "
+                        "general|symmetric|skew-symmetric)\n", path);
+        munmap(data, size);
+        return -1;
+    }
+    while (cur.p < cur.end && *cur.p == '%') {
+        bench_mtx_skip_line(&cur);
+    }
+    long rows, cols, entries;
+    if (bench_mtx_long(&cur, &rows) != 0 || bench_mtx_long(&cur, &cols) != 0 || bench_mtx_long(&cur, &entries) != 0 ||
+        rows <= 0 || cols <= 0 || entries < 0 || rows > INT_MAX || cols > INT_MAX ||
+        entries * ((symmetric || skew) ? 2 : 1) > INT_MAX) {
+        fprintf(stderr, "%s: bad size line\n", path);
+        munmap(data, size);
+        return -1;
+    }
+
+    int *coo_row = (int*)malloc((size_t)entries * sizeof(int));
+    int *coo_col = (int*)malloc((size_t)entries * sizeof(int));
+    double *coo_val = (double*)malloc((size_t)entries * sizeof(double));
+    csr->nrows = (int)rows;
+    csr->ncols = (int)cols;
+    csr->row_ptr = (int*)calloc((size_t)rows + 1, sizeof(int));
+    long nnz = 0;
+    for (long e = 0; e < entries; e++) {
+        long r, c;
+        double v = 1.0;
+        if (bench_mtx_long(&cur, &r) != 0 || bench_mtx_long(&cur, &c) != 0 ||
+            (!pattern && bench_mtx_double(&cur, &v) != 0) || r < 1 || r > rows || c < 1 || c > cols) {
+            fprintf(stderr, "%s: bad entry %ld of %ld\n", path, e + 1, entries);
+            free(coo_row);
+            free(coo_col);
+            free(coo_val);
+            bench_csr_free(csr);
+            munmap(data, size);
+            return -1;
+        }
+        coo_row[e] = (int)(r - 1);
+        coo_col[e] = (int)(c - 1);
+        coo_val[e] = v;
+        csr->row_ptr[r - 1 + 1]++;
+        nnz++;
+        if ((symmetric || skew) && r != c) {
+            csr->row_ptr[c - 1 + 1]++;
+            nnz++;
+        }
+    }
+    munmap(data, size);
+
+    for (long r = 0; r < rows; r++) {
+        csr->row_ptr[r + 1] += csr->row_ptr[r];
+    }
+    csr->nnz = (int)nnz;
+    csr->col_indices = (int*)malloc((size_t)(nnz ? nnz : 1) * sizeof(int));
+    csr->values = (double*)malloc((size_t)(nnz ? nnz : 1) * sizeof(double));
+    int *fill = (int*)malloc((size_t)rows * sizeof(int));
+    memcpy(fill, csr->row_ptr, (size_t)rows * sizeof(int));
+    for (long e = 0; e < entries; e++) {
+        int r = coo_row[e], c = coo_col[e];
+        csr->col_indices[fill[r]] = c;
+        csr->values[fill[r]++] = coo_val[e];
+        if ((symmetric || skew) && r != c) {
+            csr->col_indices[fill[c]] = r;
+            csr->values[fill[c]++] = skew ? -coo_val[e] : coo_val[e];
+        }
+    }
+    free(fill);
+    free(coo_row);
+    free(coo_col);
+    free(coo_val);
+    bench_csr_sort_rows(csr);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef BENCH_NUMA_H
+#define BENCH_NUMA_H
+
+/*
+ * NUMA placement for harness allocations (--numa), replacing external
+ * `numactl --membind` so that placement can differ per array and per thread.
+ *
+ *   local       first touch by the allocating (pinned) thread, no policy
+ *   interleave  MPOL_INTERLEAVE across all online nodes
+ *   remote      MPOL_BIND to the remote node
+ *   split       output arrays local, input arrays bound to the remote node
+ *
+ * The remote node is --numa-remote <node>, or by default the next online
+ * node after the allocating thread's node. Policies are applied with mbind()
+ * before first touch; placement is verified afterwards by sampling pages with
+ * move_pages(). On a single-node machine remote and split fall back to local
+ * placement and say so. Raw syscalls are used so no libnuma link is needed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#define BENCH_HAVE_NUMA 1
+#else
+#define BENCH_HAVE_NUMA 0
+#endif
+
+#define BENCH_NUMA_MAX_NODES 64
+#define BENCH_NUMA_SAMPLES 4096   // pages sampled per allocation by move_pages
+
+enum {
+    BENCH_NUMA_NONE,
+    BENCH_NUMA_LOCAL,
+    BENCH_NUMA_INTERLEAVE,
+    BENCH_NUMA_REMOTE,
+    BENCH_NUMA_SPLIT
+};
+
+static inline int bench_numa_parse_policy(const char *name) {
+    if (!name) return BENCH_NUMA_NONE;
+    if (strcmp(name, "local") == 0) return BENCH_NUMA_LOCAL;
+    if (strcmp(name, "interleave") == 0) return BENCH_NUMA_INTERLEAVE;
+    if (strcmp(name, "remote") == 0) return BENCH_NUMA_REMOTE;
+    if (strcmp(name, "split") == 0) return BENCH_NUMA_SPLIT;
+    fprintf(stderr, "Unknown --numa %s (expected local, interleave, remote or split)\n", name);
+    return BENCH_NUMA_NONE;
+}
+
+// Online nodes from /sys/devices/system/node; returns the count (at least 1).
+static inline int bench_numa_nodes(int *nodes, int max) {
+    int n = 0;
+    for (int node = 0; node < BENCH_NUMA_MAX_NODES && n < max; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+        if (access(path, F_OK) == 0) {
+            nodes[n++] = node;
+        }
+    }
+    if (n == 0) {
+        nodes[n++] = 0;
+    }
+    return n;
+}
+
+// Node of the CPU the calling thread is running on.
+static inline int bench_numa_current_node(void) {
+#if BENCH_HAVE_NUMA
+    unsigned int cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+        return (int)node;
+    }
+#endif
+    return 0;
+}
+
+// --numa-remote, else the next online node after `home`; -1 on a single node.
+static inline int bench_numa_remote_node(int home, int requested) {
+    int nodes[BENCH_NUMA_MAX_NODES];
+    int n = bench_numa_nodes(nodes, BENCH_NUMA_MAX_NODES);
+    if (requested >= 0) {
+        return requested;
+    }
+    if (n < 2) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (nodes[i] == home) {
+            return nodes[(i + 1) % n];
+        }
+    }
+    return nodes[0] == home ? nodes[1] : nodes[0];
+}
+
+/*
+ * Applies the policy to a fresh, untouched mapping. `output` selects the
+ * split-policy role. Returns 0 on success (including no-op policies).
+ */
+static inline int bench_numa_bind(void *ptr, size_t len, int policy, int output, int home, int remote) {
+#if BENCH_HAVE_NUMA
+    unsigned long mask[BENCH_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    int mode;
+    if (policy == BENCH_NUMA_INTERLEAVE) {
+        int nodes[BENCH_NUMA_MAX_NODES];
+        int n = bench_numa_nodes(nodes, BENCH_NUMA_MAX_NODES);
+        for (int i = 0; i < n; i++) {
+            mask[nodes[i] / (8 * sizeof(unsigned long))] |= 1UL << (nodes[i] % (8 * sizeof(unsigned long)));
+        }
+        mode = MPOL_INTERLEAVE;
+    } else if ((policy == BENCH_NUMA_REMOTE || (policy == BENCH_NUMA_SPLIT && !output)) && remote >= 0 && remote != home) {
+        mask[remote / (8 * sizeof(unsigned long))] |= 1UL << (remote % (8 * sizeof(unsigned long)));
+        mode = MPOL_BIND;
+    } else {
+        return 0;
+    }
+    if (syscall(SYS_mbind, ptr, len, mode, mask, (unsigned long)BENCH_NUMA_MAX_NODES + 1, 0) != 0) {
+        perror("mbind");
+        return -1;
+    }
+#else
+    (void)ptr; (void)len; (void)policy; (void)output; (void)home; (void)remote;
+#endif
+    return 0;
+}
+
+/*
+ * Samples up to BENCH_NUMA_SAMPLES pages of a touched mapping and adds their
+ * nodes to hist[]. Returns the number of pages whose node was reported.
+ */
+static inline int bench_numa_query(void *ptr, size_t len, double *hist) {
+#if BENCH_HAVE_NUMA
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t npages = (len + page - 1) / page;
+    size_t count = npages < BENCH_NUMA_SAMPLES ? npages : BENCH_NUMA_SAMPLES;
+    if (count == 0) {
+        return 0;
+    }
+    void *pages[BENCH_NUMA_SAMPLES];
+    int status[BENCH_NUMA_SAMPLES];
+    for (size_t i = 0; i < count; i++) {
+        pages[i] = (char*)ptr + (i * npages / count) * page;
+        status[i] = -1;
+    }
+    if (syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) != 0) {
+        return 0;
+    }
+    int found = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (status[i] >= 0 && status[i] < BENCH_NUMA_MAX_NODES) {
+            hist[status[i]] += 1.0;
+            found++;
+        }
+    }
+    return found;
+#else
+    (void)ptr; (void)len; (void)hist;
+    return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef BENCH_PACE_H
+#define BENCH_PACE_H
+
+/*
+ * Bandwidth pacing for memory kernels (--duty / --target-bw).
+ *
+ * Each kernel iteration is a burst of memory traffic; after it the calling
+ * thread fills time until the next burst may start, holding DRAM traffic at
+ * a chosen point between idle and saturated:
+ *
+ *   --duty f          bursts take fraction f of the time (fill = burst * (1 - f) / f)
+ *   --target-bw G     bursts start every bytes_per_iter / G seconds (G in GB/s,
+ *                     for the whole process; split evenly across --threads workers)
+ *   --pace-fill compute|pause|sleep
+ *                     what fills the gap: a dependent FMA chain in chunks
+ *                     calibrated to about a microsecond (default; keeps the
+ *                     core busy without memory traffic), a pause-instruction
+ *                     spin, or clock_nanosleep (lets the core idle)
+ *
+ * Only the vDSO clock is read between bursts, except with sleep. Measured
+ * busy and fill time over the timed loop are reported as the achieved duty.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench_args.h"
+
+enum { BENCH_PACE_OFF, BENCH_PACE_DUTY, BENCH_PACE_BW };
+enum { BENCH_PACE_COMPUTE, BENCH_PACE_PAUSE, BENCH_PACE_SLEEP };
+
+static const char *const bench_pace_fill_names[] = { "compute", "pause", "sleep" };
+
+#define BENCH_PACE_CHUNK_SEC 1e-6
+
+typedef struct {
+    int mode;
+    int fill;
+    double duty;               // --duty
+    double target_gbs;         // --target-bw for this thread
+    double period;             // seconds per iteration at the target bandwidth
+    unsigned long long chunk;  // FMA steps per compute chunk
+    double sink;
+    double busy, idle;         // seconds since the last reset
+} bench_pace_t;
+
+// Totals over all threads, merged by bench_pace_merge().
+typedef struct {
+    int lock;
+    double busy, idle;
+} bench_pace_totals_t;
+
+static bench_pace_totals_t bench_pace_totals;
+
+// Dependent multiply-add chain: no loads or stores, latency bound.
+static inline double bench_pace_compute(double x, unsigned long long steps) {
+    for (unsigned long long i = 0; i < steps; i++) {
+        x = x * 0.999999999 + 1e-9;
+    }
+    return x;
+}
+
+static inline void bench_pace_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Parses the pacing flags for a kernel moving `bytes_per_iter` bytes per
+ * iteration, with `workers` threads pacing independently. Returns 0 (also
+ * when pacing is off) or -1 when invalid.
+ */
+static inline int bench_pace_init(bench_pace_t *pace, int argc, char **argv, double bytes_per_iter, int workers) {
+    memset(pace, 0, sizeof(*pace));
+    pace->sink = 1.0;
+    const char *duty = bench_find_arg(argc, argv, "--duty");
+    const char *target = bench_find_arg(argc, argv, "--target-bw");
+    const char *fill = bench_parse_string(argc, argv, "--pace-fill", "compute");
+    if (duty && target) {
+        fprintf(stderr, "--duty and --target-bw are mutually exclusive\n");
+        return -1;
+    }
+    if (duty) {
+        pace->duty = strtod(duty, NULL);
+        if (pace->duty <= 0.0 || pace->duty > 1.0) {
+            fprintf(stderr, "Invalid --duty %s (expected 0 < fraction <= 1)\n", duty);
+            return -1;
+        }
+        pace->mode = BENCH_PACE_DUTY;
+    } else if (target) {
+        pace->target_gbs = strtod(target, NULL) / (double)(workers > 0 ? workers : 1);
+        if (pace->target_gbs <= 0.0 || bytes_per_iter <= 0.0) {
+            fprintf(stderr, "Invalid --target-bw %s (expected GB/s > 0)\n", target);
+            return -1;
+        }
+        pace->period = bytes_per_iter * 1e-9 / pace->target_gbs;
+        pace->mode = BENCH_PACE_BW;
+    } else {
+        return 0;
+    }
+    pace->fill = -1;
+    for (int f = BENCH_PACE_COMPUTE; f <= BENCH_PACE_SLEEP; f++) {
+        if (strcmp(fill, bench_pace_fill_names[f]) == 0) {
+            pace->fill = f;
+        }
+    }
+    if (pace->fill < 0) {
+        fprintf(stderr, "Unknown --pace-fill %s (expected compute, pause or sleep)\n", fill);
+        return -1;
+    }
+    if (pace->fill == BENCH_PACE_COMPUTE) {
+        // Size one chunk to about BENCH_PACE_CHUNK_SEC so the deadline is checked often enough.
+        unsigned long long steps = 1ULL << 16;
+        double start = bench_now_sec();
+        pace->sink = bench_pace_compute(pace->sink, steps);
+        double per_step = (bench_now_sec() - start) / (double)steps;
+        pace->chunk = per_step > 0.0 ? (unsigned long long)(BENCH_PACE_CHUNK_SEC / per_step) : 1000ULL;
+        if (pace->chunk == 0ULL) {
+            pace->chunk = 1ULL;
+        }
+    }
+    return 0;
+}
+
+static inline int bench_pace_enabled(const bench_pace_t *pace) {
+    return pace->mode != BENCH_PACE_OFF;
+}
+
+static inline void bench_pace_reset(bench_pace_t *pace) {
+    pace->busy = 0.0;
+    pace->idle = 0.0;
+}
+
+// Fills time after a burst that ran from `start` to `end`.
+static inline void bench_pace_wait(bench_pace_t *pace, double start, double end) {
+    double deadline = pace->mode == BENCH_PACE_DUTY ? end + (end - start) * (1.0 - pace->duty) / pace->duty
+                                                    : start + pace->period;
+    double now = end;
+    if (pace->fill == BENCH_PACE_SLEEP && deadline > now) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)deadline;
+        ts.tv_nsec = (long)((deadline - (double)ts.tv_sec) * 1e9);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        now = bench_now_sec();
+    }
+    while (now < deadline) {
+        if (pace->fill == BENCH_PACE_COMPUTE) {
+            pace->sink = bench_pace_compute(pace->sink, pace->chunk);
+        } else {
+            bench_pace_relax();
+        }
+        now = bench_now_sec();
+    }
+    pace->busy += end - start;
+    pace->idle += now - end;
+}
+
+// Adds this thread's busy/fill time to the process totals.
+static inline void bench_pace_merge(const bench_pace_t *pace) {
+    while (__atomic_test_and_set(&bench_pace_totals.lock, __ATOMIC_ACQUIRE)) {
+    }
+    bench_pace_totals.busy += pace->busy;
+    bench_pace_totals.idle += pace->idle;
+    __atomic_clear(&bench_pace_totals.lock, __ATOMIC_RELEASE);
+}
+
+// Prints the achieved duty over the merged totals and adds pace_* record fields.
+static inline void bench_pace_report(const bench_pace_t *pace, bench_results_t *res, int workers) {
+    if (!bench_pace_enabled(pace)) {
+        return;
+    }
+    double total = bench_pace_totals.busy + bench_pace_totals.idle;
+    double achieved = total > 0.0 ? bench_pace_totals.busy / total : 0.0;
+    if (pace->mode == BENCH_PACE_DUTY) {
+        BENCH_PRINTF("Pacing: duty %.3f requested, %.3f achieved (fill %s)\n", pace->duty, achieved,
+                     bench_pace_fill_names[pace->fill]);
+        bench_results_add_metric(res, "pace_duty", pace->duty);
+    } else {
+        double target = pace->target_gbs * (double)workers;
+        BENCH_PRINTF("Pacing: target %.3f GB/s, duty %.3f achieved (fill %s)\n", target, achieved,
+                     bench_pace_fill_names[pace->fill]);
+        bench_results_add_metric(res, "pace_target_gbs", target);
+    }
+    bench_results_add_metric(res, "pace_duty_achieved", achieved);
+    bench_pace_totals.busy = 0.0;
+    bench_pace_totals.idle = 0.0;
+}
+
+#endif
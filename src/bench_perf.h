@@ -0,0 +1,436 @@
+#ifndef BENCH_PERF_H
+#define BENCH_PERF_H
+
+/*
+ * Optional in-process hardware counters (--counters perf).
+ *
+ * The events behind the DVFS feature set (txt/hpc_dvfs_*.txt) are opened
+ * with perf_event_open on the calling thread, enabled immediately before
+ * the timed loop and disabled right after it, so setup and warm-up are not
+ * counted. From the counts the harness derives CPI, Math_Intensity,
+ * Stall_Ratio, System_BW_Proxy, Branch_MPKI, GFLOPS_Approx and Clock_Ratio
+ * with the same formulas as the likwid-perfctr groups (event encodings as in
+ * txt/likwid_events_*.txt).
+ *
+ * Events are split into small groups that fit the general-purpose counters
+ * even with SMT enabled; groups the kernel multiplexes are scaled by
+ * time_enabled / time_running. Only user-space cycles are counted, which
+ * works with the default perf_event_paranoid = 2. OpenMP kernels count the
+ * calling (master) thread only, like `likwid-perfctr -c 0`.
+ *
+ * When the PMU is not accessible (containers, VMs, non-Linux builds or
+ * -DBENCH_NO_PERF) the run continues and the report states why counters
+ * are unavailable.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__) && !defined(BENCH_NO_PERF)
+#define BENCH_HAVE_PERF 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define BENCH_HAVE_PERF 0
+#endif
+
+#define BENCH_PERF_MAX_EVENTS 12
+
+// What an event contributes to the derived metrics.
+enum {
+    BENCH_PERF_CYCLES,        // unhalted core cycles (ACTUAL_CPU_CLOCK / CPU_CLK_UNHALTED_CORE)
+    BENCH_PERF_INSTRUCTIONS,  // retired instructions
+    BENCH_PERF_MAX_CLOCK,     // cycles at nominal frequency (MPERF / CPU_CLK_UNHALTED_REF)
+    BENCH_PERF_BRANCH_MISSES, // retired mispredicted branches
+    BENCH_PERF_MEM_LINES,     // 64-byte lines brought into L2 (System_BW_Proxy)
+    BENCH_PERF_STALLS,        // cycles stalled on L3 misses
+    BENCH_PERF_FLOPS          // FP event weighted by intensity_weight / flop_weight
+};
+
+enum {
+    BENCH_VENDOR_OTHER,
+    BENCH_VENDOR_INTEL,
+    BENCH_VENDOR_AMD
+};
+
+typedef struct {
+    const char *name;
+    int role;
+    uint32_t type;            // PERF_TYPE_* or a dynamic PMU type from sysfs
+    uint64_t config;
+    int group;                // events sharing a group are scheduled together
+    int exclude_kernel;
+    double intensity_weight;  // contribution to Math_Intensity
+    double flop_weight;       // contribution to GFLOPS_Approx
+} bench_perf_event_t;
+
+typedef struct {
+    int enabled;              // --counters perf was given
+    int available;            // at least the cycle counter opened
+    int vendor;
+    char status[128];         // reason when unavailable
+    int nevents;
+    bench_perf_event_t events[BENCH_PERF_MAX_EVENTS];
+    int fd[BENCH_PERF_MAX_EVENTS];
+    int valid[BENCH_PERF_MAX_EVENTS];
+    double counts[BENCH_PERF_MAX_EVENTS];
+    double nominal_hz;        // Clock_Ratio fallback when no reference-cycle event opens
+} bench_perf_t;
+
+typedef struct {
+    double cpi, math_intensity, stall_ratio, system_bw_proxy, branch_mpki, gflops_approx, clock_ratio;
+} bench_perf_metrics_t;
+
+static inline int bench_perf_vendor(void) {
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    if (!fp) {
+        return BENCH_VENDOR_OTHER;
+    }
+    char line[256];
+    int vendor = BENCH_VENDOR_OTHER;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, "vendor_id")) {
+            if (strstr(line, "AuthenticAMD")) {
+                vendor = BENCH_VENDOR_AMD;
+            } else if (strstr(line, "GenuineIntel")) {
+                vendor = BENCH_VENDOR_INTEL;
+            }
+            break;
+        }
+    }
+    fclose(fp);
+    return vendor;
+}
+
+// Nominal frequency in Hz from cpufreq (base_frequency, else cpuinfo_max_freq), or 0.
+static inline double bench_perf_nominal_hz(void) {
+    static const char *paths[] = {
+        "/sys/devices/system/cpu/cpu0/cpufreq/base_frequency",
+        "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+    };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        FILE *fp = fopen(paths[i], "r");
+        if (!fp) {
+            continue;
+        }
+        double khz = 0.0;
+        int ok = fscanf(fp, "%lf", &khz) == 1 && khz > 0.0;
+        fclose(fp);
+        if (ok) {
+            return khz * 1e3;
+        }
+    }
+    return 0.0;
+}
+
+// Resolves "<pmu>/<event>" from /sys/bus/event_source (e.g. msr/mperf).
+static inline int bench_perf_sysfs_event(const char *pmu, const char *event, uint32_t *type, uint64_t *config) {
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/type", pmu);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+    unsigned int t = 0;
+    int ok = fscanf(fp, "%u", &t) == 1;
+    fclose(fp);
+    snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/events/%s", pmu, event);
+    fp = fopen(path, "r");
+    if (!ok || !fp) {
+        if (fp) {
+            fclose(fp);
+        }
+        return 0;
+    }
+    unsigned long long c = 0;
+    ok = fscanf(fp, "event=%llx", &c) == 1;
+    fclose(fp);
+    if (ok) {
+        *type = t;
+        *config = c;
+    }
+    return ok;
+}
+
+static inline void bench_perf_add(bench_perf_t *perf, const char *name, int role, uint32_t type, uint64_t config,
+                                  int group, double intensity_weight, double flop_weight) {
+    if (perf->nevents >= BENCH_PERF_MAX_EVENTS) {
+        return;
+    }
+    bench_perf_event_t *ev = &perf->events[perf->nevents++];
+    ev->name = name;
+    ev->role = role;
+    ev->type = type;
+    ev->config = config;
+    ev->group = group;
+    ev->exclude_kernel = 1;
+    ev->intensity_weight = intensity_weight;
+    ev->flop_weight = flop_weight;
+}
+
+// Raw x86 PMU encoding: event select | umask << 8 | cmask << 24.
+#define BENCH_PERF_RAW(event, umask, cmask) \
+    ((uint64_t)(event) | ((uint64_t)(umask) << 8) | ((uint64_t)(cmask) << 24))
+
+/*
+ * Selects the event table for this CPU. `mode` is the --counters value;
+ * anything other than "perf" leaves the module disabled.
+ */
+static inline void bench_perf_init(bench_perf_t *perf, const char *mode) {
+    memset(perf, 0, sizeof(*perf));
+    for (int i = 0; i < BENCH_PERF_MAX_EVENTS; i++) {
+        perf->fd[i] = -1;
+    }
+    if (!mode || strcmp(mode, "perf") != 0) {
+        return;
+    }
+    perf->enabled = 1;
+#if BENCH_HAVE_PERF
+    perf->vendor = bench_perf_vendor();
+    perf->nominal_hz = bench_perf_nominal_hz();
+
+    bench_perf_add(perf, "cycles", BENCH_PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0, 0.0, 0.0);
+    bench_perf_add(perf, "instructions", BENCH_PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0, 0.0, 0.0);
+    bench_perf_add(perf, "branch_misses", BENCH_PERF_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0, 0.0, 0.0);
+
+    if (perf->vendor == BENCH_VENDOR_AMD) {
+        // Zen 4: CORE_TO_L2_CACHE_REQUESTS_MISSES, RETIRED_SSE_AVX_FLOPS_ALL,
+        // RETIRED_FP_OPS_BY_TYPE_SCALAR_ALL; MAX_CPU_CLOCK is MPERF.
+        bench_perf_add(perf, "l2_misses", BENCH_PERF_MEM_LINES, PERF_TYPE_RAW, BENCH_PERF_RAW(0x64, 0x09, 0), 0, 0.0, 0.0);
+        bench_perf_add(perf, "sse_avx_flops", BENCH_PERF_FLOPS, PERF_TYPE_RAW, BENCH_PERF_RAW(0x03, 0x1F, 0), 1, 1.0, 4.0);
+        bench_perf_add(perf, "fp_ops_scalar", BENCH_PERF_FLOPS, PERF_TYPE_RAW, BENCH_PERF_RAW(0x0A, 0x0F, 0), 1, 1.0, 1.0);
+        uint32_t type = 0;
+        uint64_t config = 0;
+        if (bench_perf_sysfs_event("msr", "mperf", &type, &config)) {
+            // The msr PMU rejects the exclude_* bits, so mperf counts kernel time too. Count cycles
+            // (events[0]) the same way, or Clock_Ratio = cycles / mperf reads low by any kernel time
+            // in the loop, such as first-touch page faults.
+            bench_perf_add(perf, "mperf", BENCH_PERF_MAX_CLOCK, type, config, 2, 0.0, 0.0);
+            perf->events[perf->nevents - 1].exclude_kernel = 0;
+            perf->events[0].exclude_kernel = 0;
+        }
+    } else {
+        bench_perf_add(perf, "ref_cycles", BENCH_PERF_MAX_CLOCK, PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES, 0, 0.0, 0.0);
+    }
+    if (perf->vendor == BENCH_VENDOR_INTEL) {
+        // Sapphire Rapids: L2_LINES_IN.ALL, MEMORY_ACTIVITY.STALLS_L3_MISS and
+        // FP_ARITH_INST_RETIRED.{512B,256B}_PACKED_DOUBLE / SCALAR_DOUBLE.
+        bench_perf_add(perf, "l2_lines_in", BENCH_PERF_MEM_LINES, PERF_TYPE_RAW, BENCH_PERF_RAW(0x25, 0x1F, 0), 0, 0.0, 0.0);
+        bench_perf_add(perf, "stalls_l3_miss", BENCH_PERF_STALLS, PERF_TYPE_RAW, BENCH_PERF_RAW(0x47, 0x09, 0x09), 0, 0.0, 0.0);
+        bench_perf_add(perf, "fp_512b_packed_double", BENCH_PERF_FLOPS, PERF_TYPE_RAW, BENCH_PERF_RAW(0xC7, 0x40, 0), 1, 8.0, 8.0);
+        bench_perf_add(perf, "fp_256b_packed_double", BENCH_PERF_FLOPS, PERF_TYPE_RAW, BENCH_PERF_RAW(0xC7, 0x10, 0), 1, 4.0, 4.0);
+        bench_perf_add(perf, "fp_scalar_double", BENCH_PERF_FLOPS, PERF_TYPE_RAW, BENCH_PERF_RAW(0xC7, 0x01, 0), 1, 1.0, 1.0);
+    }
+#else
+    snprintf(perf->status, sizeof(perf->status), "built without perf_event support");
+#endif
+}
+
+#if BENCH_HAVE_PERF
+static inline int bench_perf_open_event(const bench_perf_event_t *ev, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = ev->type;
+    attr.config = ev->config;
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = ev->exclude_kernel;
+    attr.exclude_hv = ev->exclude_kernel;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+/*
+ * Opens every group on the calling thread, disabled. Events that fail to
+ * open are dropped individually; the module reports unavailable only when
+ * the cycle counter itself cannot be opened.
+ */
+static inline void bench_perf_open(bench_perf_t *perf) {
+    if (!perf->enabled) {
+        return;
+    }
+    perf->available = 0;
+    for (int i = 0; i < perf->nevents; i++) {
+        perf->fd[i] = -1;
+        perf->valid[i] = 0;
+        perf->counts[i] = 0.0;
+    }
+#if BENCH_HAVE_PERF
+    for (int i = 0; i < perf->nevents; i++) {
+        int leader = -1;
+        for (int j = 0; j < i; j++) {
+            if (perf->events[j].group == perf->events[i].group && perf->fd[j] >= 0) {
+                leader = perf->fd[j];
+                break;
+            }
+        }
+        perf->fd[i] = bench_perf_open_event(&perf->events[i], leader);
+        if (perf->fd[i] < 0 && perf->events[i].role == BENCH_PERF_CYCLES && !perf->events[i].exclude_kernel) {
+            // perf_event_paranoid forbids kernel counting; mperf then fails to open as well.
+            perf->events[i].exclude_kernel = 1;
+            perf->fd[i] = bench_perf_open_event(&perf->events[i], leader);
+        }
+        if (perf->fd[i] < 0 && perf->events[i].role == BENCH_PERF_CYCLES) {
+            snprintf(perf->status, sizeof(perf->status), "perf_event_open: %s", strerror(errno));
+            for (int j = 0; j < i; j++) {
+                if (perf->fd[j] >= 0) {
+                    close(perf->fd[j]);
+                    perf->fd[j] = -1;
+                }
+            }
+            return;
+        }
+    }
+    perf->available = 1;
+#endif
+}
+
+static inline int bench_perf_is_leader(const bench_perf_t *perf, int i) {
+    if (perf->fd[i] < 0) {
+        return 0;
+    }
+    for (int j = 0; j < i; j++) {
+        if (perf->events[j].group == perf->events[i].group && perf->fd[j] >= 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline void bench_perf_start(bench_perf_t *perf) {
+#if BENCH_HAVE_PERF
+    if (!perf->available) {
+        return;
+    }
+    for (int i = 0; i < perf->nevents; i++) {
+        if (bench_perf_is_leader(perf, i)) {
+            ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+#else
+    (void)perf;
+#endif
+}
+
+// Disables, reads and closes every group; counts are scaled for multiplexing.
+static inline void bench_perf_stop(bench_perf_t *perf) {
+#if BENCH_HAVE_PERF
+    if (!perf->available) {
+        return;
+    }
+    for (int i = 0; i < perf->nevents; i++) {
+        if (bench_perf_is_leader(perf, i)) {
+            ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    for (int i = 0; i < perf->nevents; i++) {
+        if (!bench_perf_is_leader(perf, i)) {
+            continue;
+        }
+        // { nr, time_enabled, time_running, value[nr] }, values in open order.
+        uint64_t buf[3 + BENCH_PERF_MAX_EVENTS];
+        ssize_t n = read(perf->fd[i], buf, sizeof(buf));
+        if (n < (ssize_t)(3 * sizeof(uint64_t)) || buf[2] == 0) {
+            continue;
+        }
+        double scale = (double)buf[1] / (double)buf[2];
+        uint64_t k = 0;
+        for (int j = i; j < perf->nevents && k < buf[0]; j++) {
+            if (perf->events[j].group == perf->events[i].group && perf->fd[j] >= 0) {
+                perf->counts[j] = (double)buf[3 + k++] * scale;
+                perf->valid[j] = 1;
+            }
+        }
+    }
+    for (int i = 0; i < perf->nevents; i++) {
+        if (perf->fd[i] >= 0) {
+            close(perf->fd[i]);
+            perf->fd[i] = -1;
+        }
+    }
+#else
+    (void)perf;
+#endif
+}
+
+// Adds another thread's counts into `sum` (both built by bench_perf_init with the same mode).
+static inline void bench_perf_accumulate(bench_perf_t *sum, const bench_perf_t *perf) {
+    if (!perf->available) {
+        if (!sum->available) {
+            memcpy(sum->status, perf->status, sizeof(sum->status));
+        }
+        return;
+    }
+    if (!sum->available) {
+        sum->available = 1;
+        for (int i = 0; i < sum->nevents; i++) {
+            sum->valid[i] = 1;
+            sum->counts[i] = 0.0;
+        }
+    }
+    for (int i = 0; i < sum->nevents; i++) {
+        sum->valid[i] &= perf->valid[i];
+        sum->counts[i] += perf->counts[i];
+    }
+}
+
+// Sum of the valid counts with `role`; NAN when none of them was counted.
+static inline double bench_perf_sum(const bench_perf_t *perf, int role, int weight) {
+    double total = 0.0;
+    int found = 0;
+    for (int i = 0; i < perf->nevents; i++) {
+        const bench_perf_event_t *ev = &perf->events[i];
+        if (ev->role != role) {
+            continue;
+        }
+        if (!perf->valid[i]) {
+            return NAN;
+        }
+        double w = weight == 1 ? ev->intensity_weight : weight == 2 ? ev->flop_weight : 1.0;
+        total += perf->counts[i] * w;
+        found = 1;
+    }
+    return found ? total : NAN;
+}
+
+static inline double bench_perf_ratio(double num, double den) {
+    return (isnan(num) || isnan(den) || den <= 0.0) ? NAN : num / den;
+}
+
+/*
+ * Derived features over a region of `seconds`, matching the likwid groups:
+ * AMD Stall_Ratio is L2 misses per instruction, Intel Stall_Ratio is L3-miss
+ * stall cycles per cycle. Unavailable metrics are NAN.
+ */
+static inline bench_perf_metrics_t bench_perf_metrics(const bench_perf_t *perf, double seconds) {
+    double cycles = bench_perf_sum(perf, BENCH_PERF_CYCLES, 0);
+    double instr = bench_perf_sum(perf, BENCH_PERF_INSTRUCTIONS, 0);
+    double max_clock = bench_perf_sum(perf, BENCH_PERF_MAX_CLOCK, 0);
+    double lines = bench_perf_sum(perf, BENCH_PERF_MEM_LINES, 0);
+    double stalls = bench_perf_sum(perf, BENCH_PERF_STALLS, 0);
+    double misses = bench_perf_sum(perf, BENCH_PERF_BRANCH_MISSES, 0);
+    double fp_ops = bench_perf_sum(perf, BENCH_PERF_FLOPS, 1);
+    double flops = bench_perf_sum(perf, BENCH_PERF_FLOPS, 2);
+    if (isnan(max_clock) && perf->nominal_hz > 0.0) {
+        max_clock = perf->nominal_hz * seconds;
+    }
+
+    bench_perf_metrics_t m;
+    m.cpi = bench_perf_ratio(cycles, instr);
+    m.math_intensity = bench_perf_ratio(fp_ops, cycles);
+    m.stall_ratio = perf->vendor == BENCH_VENDOR_AMD ? bench_perf_ratio(lines, instr) : bench_perf_ratio(stalls, cycles);
+    m.system_bw_proxy = bench_perf_ratio(lines * 64.0, seconds * 1e9);
+    m.branch_mpki = bench_perf_ratio(misses * 1000.0, instr);
+    m.gflops_approx = bench_perf_ratio(flops, seconds * 1e9);
+    m.clock_ratio = bench_perf_ratio(cycles, max_clock);
+    return m;
+}
+
+#endif
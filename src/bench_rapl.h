@@ -0,0 +1,185 @@
+#ifndef BENCH_RAPL_H
+#define BENCH_RAPL_H
+
+/*
+ * RAPL energy over the timed loop, read from the Linux powercap tree.
+ *
+ * Every package-N zone and dram subzone under --powercap-root (default
+ * /sys/class/powercap, flat intel-rapl:* entries as the kernel exposes them;
+ * AMD RAPL uses the same names) is read at loop start and loop end. The
+ * counters are also polled about once a second between samples, so a loop
+ * longer than one counter range still accumulates correctly; each delta
+ * adds max_energy_range_uj when the counter wrapped.
+ *
+ * RAPL is package-wide: concurrent processes or ranks on the same socket
+ * all see the same energy.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_RAPL_MAX_DOMAINS 16
+#define BENCH_RAPL_POLL_SEC 1.0
+#define BENCH_POWERCAP_ROOT "/sys/class/powercap"
+
+enum {
+    BENCH_RAPL_OFF,
+    BENCH_RAPL_AUTO,      // report when readable, stay silent otherwise
+    BENCH_RAPL_REQUIRED   // --energy rapl: also report why it is unavailable
+};
+
+enum {
+    BENCH_RAPL_PACKAGE,
+    BENCH_RAPL_DRAM
+};
+
+typedef struct {
+    char path[256];           // .../energy_uj
+    int kind;
+    double max_range_uj;
+    double last_uj;
+    double joules;
+} bench_rapl_domain_t;
+
+typedef struct {
+    int mode;
+    int available;
+    char status[128];
+    int ndomains;
+    bench_rapl_domain_t domains[BENCH_RAPL_MAX_DOMAINS];
+    double last_poll;
+} bench_rapl_t;
+
+static inline int bench_rapl_read_uj(const char *path, double *value) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+    unsigned long long uj = 0;
+    int ok = fscanf(fp, "%llu", &uj) == 1;
+    fclose(fp);
+    if (ok) {
+        *value = (double)uj;
+    }
+    return ok;
+}
+
+// Accumulates the energy since the previous read of `d`, unwrapping once.
+static inline void bench_rapl_update(bench_rapl_domain_t *d) {
+    double now = 0.0;
+    if (!bench_rapl_read_uj(d->path, &now)) {
+        return;
+    }
+    double delta = now - d->last_uj;
+    if (delta < 0.0) {
+        delta += d->max_range_uj;
+    }
+    d->joules += delta * 1e-6;
+    d->last_uj = now;
+}
+
+/*
+ * Discovers the package and DRAM zones below `root`. `mode` is the --energy
+ * value: "off", "auto" (default) or "rapl".
+ */
+static inline void bench_rapl_init(bench_rapl_t *rapl, const char *mode, const char *root) {
+    memset(rapl, 0, sizeof(*rapl));
+    if (mode && strcmp(mode, "off") == 0) {
+        return;
+    }
+    rapl->mode = (mode && strcmp(mode, "rapl") == 0) ? BENCH_RAPL_REQUIRED : BENCH_RAPL_AUTO;
+
+    DIR *dir = opendir(root);
+    if (!dir) {
+        snprintf(rapl->status, sizeof(rapl->status), "%.100s: %s", root, strerror(errno));
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && rapl->ndomains < BENCH_RAPL_MAX_DOMAINS) {
+        if (strncmp(entry->d_name, "intel-rapl:", 11) != 0) {
+            continue;
+        }
+        char path[256];
+        char name[64] = "";
+        snprintf(path, sizeof(path), "%.180s/%.48s/name", root, entry->d_name);
+        FILE *fp = fopen(path, "r");
+        if (!fp) {
+            continue;
+        }
+        int ok = fscanf(fp, "%63s", name) == 1;
+        fclose(fp);
+        // Core/uncore subzones are already part of their package.
+        int kind;
+        if (ok && strncmp(name, "package", 7) == 0) {
+            kind = BENCH_RAPL_PACKAGE;
+        } else if (ok && strcmp(name, "dram") == 0) {
+            kind = BENCH_RAPL_DRAM;
+        } else {
+            continue;
+        }
+
+        bench_rapl_domain_t *d = &rapl->domains[rapl->ndomains];
+        memset(d, 0, sizeof(*d));
+        d->kind = kind;
+        snprintf(path, sizeof(path), "%.180s/%.48s/max_energy_range_uj", root, entry->d_name);
+        if (!bench_rapl_read_uj(path, &d->max_range_uj)) {
+            continue;
+        }
+        snprintf(d->path, sizeof(d->path), "%.180s/%.48s/energy_uj", root, entry->d_name);
+        if (!bench_rapl_read_uj(d->path, &d->last_uj)) {
+            snprintf(rapl->status, sizeof(rapl->status), "%.100s: %s", d->path, strerror(errno));
+            continue;
+        }
+        rapl->ndomains++;
+    }
+    closedir(dir);
+    if (rapl->ndomains == 0 && rapl->status[0] == '\0') {
+        snprintf(rapl->status, sizeof(rapl->status), "no RAPL package zones in %.100s", root);
+    }
+}
+
+static inline void bench_rapl_start(bench_rapl_t *rapl, double now) {
+    rapl->available = 0;
+    for (int i = 0; i < rapl->ndomains; i++) {
+        rapl->domains[i].joules = 0.0;
+        if (bench_rapl_read_uj(rapl->domains[i].path, &rapl->domains[i].last_uj)) {
+            rapl->available = 1;
+        }
+    }
+    rapl->last_poll = now;
+}
+
+// Called between samples; reads the counters at most every BENCH_RAPL_POLL_SEC.
+static inline void bench_rapl_poll(bench_rapl_t *rapl, double now) {
+    if (!rapl->available || now - rapl->last_poll < BENCH_RAPL_POLL_SEC) {
+        return;
+    }
+    for (int i = 0; i < rapl->ndomains; i++) {
+        bench_rapl_update(&rapl->domains[i]);
+    }
+    rapl->last_poll = now;
+}
+
+static inline void bench_rapl_stop(bench_rapl_t *rapl) {
+    if (!rapl->available) {
+        return;
+    }
+    for (int i = 0; i < rapl->ndomains; i++) {
+        bench_rapl_update(&rapl->domains[i]);
+    }
+}
+
+// Total joules of one domain kind; negative when no such zone exists.
+static inline double bench_rapl_joules(const bench_rapl_t *rapl, int kind) {
+    double total = -1.0;
+    for (int i = 0; i < rapl->ndomains; i++) {
+        if (rapl->domains[i].kind == kind) {
+            total = (total < 0.0 ? 0.0 : total) + rapl->domains[i].joules;
+        }
+    }
+    return total;
+}
+
+#endif
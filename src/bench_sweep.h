@@ -0,0 +1,187 @@
+#ifndef BENCH_SWEEP_H
+#define BENCH_SWEEP_H
+
+/*
+ * Multi-point runs for the sized memory kernels.
+ *
+ * --sweep-bytes min:max:factor walks the working set geometrically from min
+ * to max, and a comma-separated --numa list (e.g. local,remote,interleave)
+ * repeats the run for each placement policy; a --duty or --target-bw list
+ * does the same for pacing levels (bench_pace.h), a --chains list for
+ * pointer_chase chain counts, and a --band or --alpha list for spmv column
+ * locality. A list and the byte sweep combine. The kernel's normal
+ * single-point path is run once per point with "--size <bytes>" and/or e.g.
+ * "--numa <policy>" prepended to the arguments, so every point allocates,
+ * first-touches, warms up and times its own data exactly as a standalone
+ * run would (including --threads). When sweeping sizes, each point is
+ * calibrated to BENCH_SWEEP_DEFAULT_DURATION seconds unless --iterations or
+ * --duration is given, because a fixed iteration count cannot suit both L1-
+ * and DRAM-sized sets. After the last point the bandwidth or latency of
+ * every point is printed as a table.
+ */
+
+#include "bench_args.h"
+
+#define BENCH_SWEEP_DEFAULT_DURATION "1"
+#define BENCH_SWEEP_MAX_POINTS 256
+#define BENCH_SWEEP_MAX_VALUES 64
+
+// Flags that may carry a comma-separated list of values, one point per value.
+static const char *const bench_sweep_list_flags[] = { "--numa", "--duty", "--target-bw", "--chains", "--band",
+                                                       "--alpha" };
+
+// First list flag whose value contains a comma, or NULL.
+static inline const char *bench_sweep_list_flag(int argc, char **argv) {
+    for (size_t f = 0; f < sizeof(bench_sweep_list_flags) / sizeof(bench_sweep_list_flags[0]); f++) {
+        const char *value = bench_find_arg(argc, argv, bench_sweep_list_flags[f]);
+        if (value && strchr(value, ',')) {
+            return bench_sweep_list_flags[f];
+        }
+    }
+    return NULL;
+}
+
+// Runs the kernel once for the --size/--numa in argv; returns the exit code.
+typedef int (*bench_point_fn_t)(int argc, char **argv, double t0);
+
+typedef struct {
+    unsigned long long min, max;
+    double factor;
+} bench_sweep_t;
+
+// Parses "--sweep-bytes min:max[:factor]" (factor defaults to 2); returns 0 when absent, -1 when invalid.
+static inline int bench_parse_sweep(int argc, char **argv, bench_sweep_t *sweep) {
+    const char *value = bench_find_arg(argc, argv, "--sweep-bytes");
+    if (!value) {
+        return 0;
+    }
+    sweep->min = bench_parse_bytes_text(value);
+    const char *p = strchr(value, ':');
+    sweep->max = p ? bench_parse_bytes_text(p + 1) : 0ULL;
+    p = p ? strchr(p + 1, ':') : NULL;
+    sweep->factor = p ? strtod(p + 1, NULL) : 2.0;
+    if (sweep->min == 0ULL || sweep->max < sweep->min || sweep->factor <= 1.0) {
+        fprintf(stderr, "Invalid --sweep-bytes %s (expected min:max[:factor], factor > 1)\n", value);
+        return -1;
+    }
+    return 1;
+}
+
+static inline int bench_sweep_requested(int argc, char **argv) {
+    return bench_find_arg(argc, argv, "--sweep-bytes") != NULL || bench_sweep_list_flag(argc, argv) != NULL;
+}
+
+static inline int bench_sweep_main(bench_point_fn_t point, int argc, char **argv, double t0) {
+    bench_sweep_t sweep;
+    int sweep_bytes = bench_parse_sweep(argc, argv, &sweep);
+    if (sweep_bytes < 0) {
+        return 1;
+    }
+
+    unsigned long long sizes[BENCH_SWEEP_MAX_POINTS];
+    int nsizes = 0;
+    if (sweep_bytes) {
+        for (double bytes = (double)sweep.min;
+             bytes <= (double)sweep.max * (1.0 + 1e-9) && nsizes < BENCH_SWEEP_MAX_POINTS; bytes *= sweep.factor) {
+            unsigned long long b = (unsigned long long)(bytes + 0.5);
+            if (nsizes == 0 || b > sizes[nsizes - 1]) {
+                sizes[nsizes++] = b;
+            }
+        }
+    } else {
+        sizes[nsizes++] = 0ULL;
+    }
+
+    char value_list[512];
+    char *values[BENCH_SWEEP_MAX_VALUES];
+    int nvalues = 0;
+    const char *list_flag = bench_sweep_list_flag(argc, argv);
+    if (list_flag) {
+        snprintf(value_list, sizeof(value_list), "%s", bench_find_arg(argc, argv, list_flag));
+        for (char *tok = strtok(value_list, ","); tok && nvalues < BENCH_SWEEP_MAX_VALUES; tok = strtok(NULL, ",")) {
+            values[nvalues++] = tok;
+        }
+    } else {
+        values[nvalues++] = NULL;
+    }
+
+    // argv[0], [--size <bytes>], [<list flag> <value>], [--duration <sec>], original arguments, NULL
+    char size_text[32];
+    char **args = (char**)malloc((size_t)(argc + 7) * sizeof(char*));
+    int nargs = 0;
+    args[nargs++] = argv[0];
+    int size_slot = -1, value_slot = -1;
+    if (sweep_bytes) {
+        args[nargs++] = (char*)"--size";
+        size_slot = nargs;
+        args[nargs++] = size_text;
+    }
+    if (values[0]) {
+        args[nargs++] = (char*)list_flag;
+        value_slot = nargs;
+        args[nargs++] = values[0];
+    }
+    if (sweep_bytes && !bench_find_arg(argc, argv, "--iterations") && !bench_find_arg(argc, argv, "--duration")) {
+        args[nargs++] = (char*)"--duration";
+        args[nargs++] = (char*)BENCH_SWEEP_DEFAULT_DURATION;
+    }
+    for (int i = 1; i < argc; i++) {
+        args[nargs++] = argv[i];
+    }
+    args[nargs] = NULL;
+
+    int npoints = nvalues * nsizes;
+    bench_summary_t *curve = (bench_summary_t*)calloc((size_t)npoints, sizeof(bench_summary_t));
+    double *column = (double*)calloc((size_t)npoints, sizeof(double));
+    int rc = 0;
+    memset(&bench_sweep_state, 0, sizeof(bench_sweep_state));
+    bench_sweep_state.active = 1;
+    for (int i = 0; i < npoints && rc == 0; i++) {
+        int p = i / nsizes, k = i % nsizes;
+        if (size_slot >= 0) {
+            snprintf(size_text, sizeof(size_text), "%llu", sizes[k]);
+        }
+        if (value_slot >= 0) {
+            args[value_slot] = values[p];
+        }
+        BENCH_PRINTF("Sweep point %d/%d:", i + 1, npoints);
+        if (values[p]) {
+            BENCH_PRINTF(" %s %s", list_flag + 2, values[p]);
+        }
+        if (sweep_bytes) {
+            BENCH_PRINTF(" %llu bytes", sizes[k]);
+        }
+        BENCH_PRINTF("\n");
+        bench_sweep_state.column = NULL;
+        rc = point(nargs, args, t0);
+        curve[i] = bench_sweep_state.last;
+        column[i] = bench_sweep_state.column_value;
+        bench_sweep_state.points++;
+    }
+    if (rc == 0) {
+        BENCH_PRINTF("Sweep summary (%s vs. %s):\n", bench_sweep_state.latency ? "latency" : "throughput",
+                     sweep_bytes ? "working set" : strcmp(list_flag, "--numa") == 0 ? "placement" : list_flag + 2);
+        for (int i = 0; i < npoints; i++) {
+            int p = i / nsizes, k = i % nsizes;
+            BENCH_PRINTF(" ");
+            if (values[p]) {
+                BENCH_PRINTF(" %-10s", values[p]);
+            }
+            if (sweep_bytes) {
+                BENCH_PRINTF(" %14llu bytes", sizes[k]);
+            }
+            BENCH_PRINTF("  %f %s (best %f)", curve[i].value, bench_sweep_state.unit, curve[i].best);
+            if (bench_sweep_state.column) {
+                BENCH_PRINTF("  %s %.2f", bench_sweep_state.column, column[i]);
+            }
+            BENCH_PRINTF("\n");
+        }
+    }
+    bench_sweep_state.active = 0;
+    free(curve);
+    free(column);
+    free(args);
+    return rc;
+}
+
+#endif
@@ -0,0 +1,371 @@
+#ifndef BENCH_THREADS_H
+#define BENCH_THREADS_H
+
+/*
+ * Pinned multi-threaded "saturate the socket" mode for serial kernels.
+ *
+ * With --threads N the kernel's setup/run/teardown callbacks are executed by
+ * N pthreads, each pinned to one CPU chosen by --affinity (compact, scatter
+ * or an explicit list such as 0-63,128-191). Every thread allocates and
+ * first-touches its own private data, warms up, and then all threads start
+ * the timed loop together on a barrier. The report lists per-thread results
+ * followed by the aggregate over the whole team; with --counters perf each
+ * thread counts itself and the aggregate sums the counts over the team.
+ *
+ * Build with -pthread -D_GNU_SOURCE (THREAD_FLAGS in the Makefile).
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include "bench_args.h"
+
+#define BENCH_MAX_CPUS 4096
+
+typedef struct {
+    const char *label;                                   // progress-line prefix, e.g. "STREAM"
+    void *(*setup)(int tid, int argc, char **argv);      // allocate and first-touch private data
+    bench_run_fn_t run;
+    void (*teardown)(void *ctx);
+    void (*start)(void *ctx);                            // optional: right before the timed loop
+    void (*finish)(bench_results_t *agg);                // optional: after teardown, before the aggregate report
+} bench_kernel_t;
+
+static inline int bench_parse_threads(int argc, char **argv) {
+    return (int)bench_parse_ull(argc, argv, "--threads", 0ULL);
+}
+
+// OpenMP kernels run serially unless OMP_NUM_THREADS is set explicitly, so
+// one-rank-per-core launches do not oversubscribe; --threads also runs serially.
+static inline int bench_omp_enabled(int argc, char **argv) {
+    return bench_parse_threads(argc, argv) <= 0 && getenv("OMP_NUM_THREADS") != NULL;
+}
+
+// Parses "0-3,8,10-11" into cpus[]; returns the number of entries.
+static inline int bench_parse_cpu_list(const char *list, int *cpus, int max) {
+    int n = 0;
+    const char *p = list;
+    while (*p && n < max) {
+        char *end = NULL;
+        long lo = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long c = lo; c <= hi && n < max; c++) {
+            cpus[n++] = (int)c;
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return n;
+}
+
+static inline int bench_read_sysfs_int(const char *path, int def) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return def;
+    }
+    int value = def;
+    if (fscanf(fp, "%d", &value) != 1) {
+        value = def;
+    }
+    fclose(fp);
+    return value;
+}
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    int smt;       // index among the hardware threads of the same core
+    int slot;      // index of the core within its package
+} bench_cpu_info_t;
+
+static inline int bench_cpu_compact_cmp(const void *a, const void *b) {
+    const bench_cpu_info_t *x = (const bench_cpu_info_t*)a;
+    const bench_cpu_info_t *y = (const bench_cpu_info_t*)b;
+    if (x->smt != y->smt) return x->smt - y->smt;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->slot != y->slot) return x->slot - y->slot;
+    return x->cpu - y->cpu;
+}
+
+static inline int bench_cpu_scatter_cmp(const void *a, const void *b) {
+    const bench_cpu_info_t *x = (const bench_cpu_info_t*)a;
+    const bench_cpu_info_t *y = (const bench_cpu_info_t*)b;
+    if (x->smt != y->smt) return x->smt - y->smt;
+    if (x->slot != y->slot) return x->slot - y->slot;
+    if (x->package != y->package) return x->package - y->package;
+    return x->cpu - y->cpu;
+}
+
+/*
+ * Orders the CPUs this process may run on. "compact" fills one physical core
+ * per thread, socket by socket; "scatter" round-robins across sockets. In both
+ * cases SMT siblings are only used after every physical core has a thread.
+ * Anything else is treated as an explicit CPU list. Returns the CPU count.
+ */
+static inline int bench_affinity_cpus(const char *policy, int *cpus, int max) {
+    if (strcmp(policy, "compact") != 0 && strcmp(policy, "scatter") != 0) {
+        return bench_parse_cpu_list(policy, cpus, max);
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return 0;
+    }
+    bench_cpu_info_t *info = (bench_cpu_info_t*)calloc(CPU_SETSIZE, sizeof(bench_cpu_info_t));
+    int n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        info[n].package = bench_read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        info[n].core = bench_read_sysfs_int(path, cpu);
+        info[n].cpu = cpu;
+        n++;
+    }
+    // CPUs are visited in ascending order, so earlier entries of the same
+    // core are its lower-numbered siblings.
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < i; j++) {
+            if (info[j].package == info[i].package && info[j].core == info[i].core) {
+                info[i].smt++;
+            }
+        }
+        if (info[i].smt == 0) {
+            for (int j = 0; j < i; j++) {
+                if (info[j].package == info[i].package && info[j].smt == 0) {
+                    info[i].slot++;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (info[i].smt > 0) {
+            for (int j = 0; j < n; j++) {
+                if (info[j].smt == 0 && info[j].package == info[i].package && info[j].core == info[i].core) {
+                    info[i].slot = info[j].slot;
+                }
+            }
+        }
+    }
+    qsort(info, (size_t)n, sizeof(bench_cpu_info_t),
+          strcmp(policy, "compact") == 0 ? bench_cpu_compact_cmp : bench_cpu_scatter_cmp);
+    if (n > max) {
+        n = max;
+    }
+    for (int i = 0; i < n; i++) {
+        cpus[i] = info[i].cpu;
+    }
+    free(info);
+    return n;
+}
+
+typedef struct {
+    const bench_kernel_t *kernel;
+    int argc;
+    char **argv;
+    double t0;
+    int nthreads;
+    int *cpus;
+    unsigned long long warmup_iters;
+    unsigned long long iterations;
+    double duration;
+    pthread_barrier_t barrier;
+    double *agree_values;
+    bench_results_t *results;   // one per thread
+} bench_team_t;
+
+static bench_team_t bench_team;
+static __thread int bench_team_tid;
+
+// Team-wide max so that every thread calibrates to the same iteration count.
+static inline double bench_team_agree_max(double value) {
+    bench_team.agree_values[bench_team_tid] = value;
+    pthread_barrier_wait(&bench_team.barrier);
+    double result = value;
+    for (int t = 0; t < bench_team.nthreads; t++) {
+        if (bench_team.agree_values[t] > result) {
+            result = bench_team.agree_values[t];
+        }
+    }
+    pthread_barrier_wait(&bench_team.barrier);
+    return result;
+}
+
+static inline void *bench_team_worker(void *arg) {
+    int tid = (int)(intptr_t)arg;
+    const bench_kernel_t *kernel = bench_team.kernel;
+    bench_team_tid = tid;
+
+    void *ctx = kernel->setup(tid, bench_team.argc, bench_team.argv);
+    pthread_barrier_wait(&bench_team.barrier);
+
+    if (bench_team.warmup_iters > 0ULL) {
+        if (tid == 0) {
+            BENCH_PRINTF("%s warmup start\n", kernel->label);
+        }
+        kernel->run(ctx, bench_team.warmup_iters);
+    }
+
+    if (bench_team.duration > 0.0) {
+        double per_iter = 0.0;
+        unsigned long long iterations = bench_calibrate_probe(kernel->run, ctx, bench_team.duration,
+                                                              bench_team_agree_max, &per_iter);
+        if (tid == 0) {
+            bench_team.iterations = iterations;
+            bench_print_calibration(iterations, bench_team.duration, per_iter);
+        }
+    }
+    pthread_barrier_wait(&bench_team.barrier);
+
+    if (tid == 0) {
+        bench_mem_scan();
+        BENCH_PRINTF("%s loop start\n", kernel->label);
+        BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - bench_team.t0);
+    }
+    pthread_barrier_wait(&bench_team.barrier);
+
+    // RAPL is package-wide, so only thread 0 reads it.
+    if (tid != 0) {
+        bench_team.results[tid].rapl.mode = BENCH_RAPL_OFF;
+        bench_team.results[tid].rapl.ndomains = 0;
+    }
+    if (kernel->start) {
+        kernel->start(ctx);
+    }
+    bench_results_run(&bench_team.results[tid], kernel->run, ctx, bench_team.iterations);
+
+    pthread_barrier_wait(&bench_team.barrier);
+    if (tid == 0) {
+        BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - bench_team.t0);
+    }
+
+    kernel->teardown(ctx);
+    return NULL;
+}
+
+/*
+ * Runs `kernel` on --threads pinned threads and reports per-thread and
+ * aggregate results. `tmpl` carries the name and unit set up by the kernel;
+ * aggregate throughput is the team's total work over the slowest thread's
+ * loop time. Returns the process exit code.
+ */
+static inline int bench_threads_main(const bench_kernel_t *kernel, const bench_results_t *tmpl,
+                                     int argc, char **argv, double t0,
+                                     unsigned long long default_warmup, unsigned long long default_iters) {
+    int nthreads = bench_parse_threads(argc, argv);
+    const char *policy = bench_parse_string(argc, argv, "--affinity", "compact");
+    int *avail = (int*)malloc(BENCH_MAX_CPUS * sizeof(int));
+    int navail = bench_affinity_cpus(policy, avail, BENCH_MAX_CPUS);
+    if (nthreads <= 0 || navail <= 0) {
+        fprintf(stderr, "Invalid --threads %d / --affinity %s\n", nthreads, policy);
+        free(avail);
+        return 1;
+    }
+
+    memset(&bench_team, 0, sizeof(bench_team));
+    bench_team.kernel = kernel;
+    bench_team.argc = argc;
+    bench_team.argv = argv;
+    bench_team.t0 = t0;
+    bench_team.nthreads = nthreads;
+    bench_team.cpus = (int*)malloc((size_t)nthreads * sizeof(int));
+    bench_team.warmup_iters = bench_parse_warmup_iterations(argc, argv, default_warmup);
+    bench_team.iterations = bench_parse_iterations(argc, argv, default_iters);
+    bench_team.duration = bench_parse_duration(argc, argv);
+    bench_team.agree_values = (double*)calloc((size_t)nthreads, sizeof(double));
+    bench_team.results = (bench_results_t*)calloc((size_t)nthreads, sizeof(bench_results_t));
+    pthread_barrier_init(&bench_team.barrier, NULL, (unsigned)nthreads);
+
+    BENCH_PRINTF("Threads: %d (affinity %s) CPUs:", nthreads, policy);
+    for (int t = 0; t < nthreads; t++) {
+        bench_team.cpus[t] = avail[t % navail];
+        bench_team.results[t] = *tmpl;
+        bench_team.results[t].samples = NULL;
+        bench_team.results[t].per_thread = NULL;
+        BENCH_PRINTF(" %d", bench_team.cpus[t]);
+    }
+    BENCH_PRINTF("\n");
+    if (nthreads > navail) {
+        BENCH_PRINTF("Warning: %d threads share %d CPUs\n", nthreads, navail);
+    }
+    free(avail);
+
+    pthread_t *threads = (pthread_t*)malloc((size_t)nthreads * sizeof(pthread_t));
+    for (int t = 0; t < nthreads; t++) {
+        pthread_attr_t attr;
+        cpu_set_t set;
+        pthread_attr_init(&attr);
+        CPU_ZERO(&set);
+        CPU_SET(bench_team.cpus[t], &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        if (pthread_create(&threads[t], &attr, bench_team_worker, (void*)(intptr_t)t) != 0) {
+            fprintf(stderr, "Failed to create thread %d\n", t);
+            exit(1);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    for (int t = 0; t < nthreads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+
+    BENCH_PRINTF("%s complete\n", kernel->label);
+
+    // Aggregate: all samples pooled, loop time of the slowest thread.
+    bench_results_t agg = *tmpl;
+    size_t total = 0;
+    for (int t = 0; t < nthreads; t++) {
+        total += bench_team.results[t].nsamples;
+    }
+    agg.samples = (double*)malloc((total ? total : 1) * sizeof(double));
+    agg.per_thread = (double*)malloc((size_t)nthreads * sizeof(double));
+    agg.nsamples = 0;
+    agg.threads = nthreads;
+    agg.iterations = bench_team.iterations;
+    agg.iters_per_sample = bench_team.results[0].iters_per_sample;
+    agg.seconds = 0.0;
+    agg.perf.available = 0;
+    agg.rapl = bench_team.results[0].rapl;
+    for (int t = 0; t < nthreads; t++) {
+        bench_results_t *r = &bench_team.results[t];
+        bench_perf_accumulate(&agg.perf, &r->perf);
+        memcpy(agg.samples + agg.nsamples, r->samples, r->nsamples * sizeof(double));
+        agg.nsamples += r->nsamples;
+        if (r->seconds > agg.seconds) {
+            agg.seconds = r->seconds;
+        }
+        agg.per_thread[t] = bench_results_convert(r, r->iterations ? r->seconds / (double)r->iterations : 0.0);
+        bench_results_dump_trace(r, t);
+        bench_results_free(r);
+    }
+    if (!agg.latency) {
+        agg.work_per_iter *= (double)nthreads;
+    }
+    if (kernel->finish) {
+        kernel->finish(&agg);
+    }
+    bench_results_report(&agg);
+    bench_results_free(&agg);
+
+    pthread_barrier_destroy(&bench_team.barrier);
+    free(bench_team.results);
+    free(bench_team.agree_values);
+    free(bench_team.cpus);
+    return 0;
+}
+
+#endif
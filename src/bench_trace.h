@@ -0,0 +1,128 @@
+#ifndef BENCH_TRACE_H
+#define BENCH_TRACE_H
+
+/*
+ * Progress time series of the timed loop (--trace-every / --trace-interval-us).
+ *
+ * The timing thread appends (timestamp, iterations_done) records to a ring
+ * preallocated before the loop, either every K iterations or whenever at
+ * least T microseconds have passed (the kernel is then run in steps sized
+ * to a quarter of T from the measured rate). Timestamps come from the vDSO
+ * CLOCK_MONOTONIC, so the hot path makes no syscalls and takes no locks; the
+ * head index is published with a release store. If the ring fills, the
+ * oldest records are overwritten. The series is dumped after the loop,
+ * with CLOCK_MONOTONIC seconds so it can be aligned with the DVFS
+ * controller's "[DVFS] Switching to Level" lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_TRACE_DEFAULT_CAPACITY 65536ULL
+
+typedef struct {
+    double t;                        // CLOCK_MONOTONIC seconds
+    unsigned long long iterations;   // iterations completed at t
+} bench_trace_entry_t;
+
+typedef struct {
+    unsigned long long every;        // record every `every` iterations (0: unused)
+    double interval;                 // or every `interval` seconds (0: unused)
+    unsigned long long capacity;
+    bench_trace_entry_t *ring;
+    unsigned long long head;         // records written so far
+    unsigned long long step;         // iterations per kernel call while tracing
+    double start, last;
+} bench_trace_t;
+
+static inline void bench_trace_init(bench_trace_t *tr, unsigned long long every, double interval_us,
+                                    unsigned long long capacity) {
+    memset(tr, 0, sizeof(*tr));
+    tr->every = every;
+    tr->interval = interval_us > 0.0 ? interval_us * 1e-6 : 0.0;
+    tr->capacity = capacity ? capacity : 1ULL;
+}
+
+static inline int bench_trace_enabled(const bench_trace_t *tr) {
+    return tr->every > 0ULL || tr->interval > 0.0;
+}
+
+// Allocates the ring and records the loop start; call before timing.
+static inline void bench_trace_start(bench_trace_t *tr, double now) {
+    if (!bench_trace_enabled(tr)) {
+        return;
+    }
+    free(tr->ring);
+    tr->ring = (bench_trace_entry_t*)malloc(tr->capacity * sizeof(bench_trace_entry_t));
+    tr->head = 0;
+    tr->step = tr->every > 0ULL ? tr->every : 1ULL;
+    tr->start = tr->last = now;
+    tr->ring[0].t = now;
+    tr->ring[0].iterations = 0;
+    __atomic_store_n(&tr->head, 1ULL, __ATOMIC_RELEASE);
+}
+
+static inline void bench_trace_push(bench_trace_t *tr, double now, unsigned long long iterations) {
+    unsigned long long h = tr->head;
+    bench_trace_entry_t *e = &tr->ring[h % tr->capacity];
+    e->t = now;
+    e->iterations = iterations;
+    __atomic_store_n(&tr->head, h + 1ULL, __ATOMIC_RELEASE);
+}
+
+// Iterations for the next kernel call so that every-K records land on multiples of K.
+static inline unsigned long long bench_trace_next_step(const bench_trace_t *tr, unsigned long long done,
+                                                       unsigned long long remaining) {
+    unsigned long long step = tr->every > 0ULL ? tr->every - done % tr->every : tr->step;
+    return step < remaining ? step : remaining;
+}
+
+/*
+ * Called after each traced step of `step` iterations that ended at `now`
+ * and began at `prev`. In interval mode the step is resized so that one
+ * kernel call lasts about a quarter of the interval.
+ */
+static inline void bench_trace_step(bench_trace_t *tr, double prev, double now, unsigned long long step,
+                                    unsigned long long iterations) {
+    if (tr->every > 0ULL ? iterations % tr->every == 0ULL : now - tr->last >= tr->interval) {
+        bench_trace_push(tr, now, iterations);
+        tr->last = now;
+    }
+    if (tr->interval > 0.0 && now > prev) {
+        double per_iter = (now - prev) / (double)step;
+        double target = tr->interval / 4.0 / per_iter;
+        tr->step = target < 1.0 ? 1ULL : (unsigned long long)target;
+    }
+}
+
+// Records the loop end unless the last step already did.
+static inline void bench_trace_finish(bench_trace_t *tr, double now, unsigned long long iterations) {
+    if (tr->ring && tr->ring[(tr->head - 1ULL) % tr->capacity].iterations != iterations) {
+        bench_trace_push(tr, now, iterations);
+    }
+}
+
+static inline void bench_trace_write(const bench_trace_t *tr, FILE *fp, int tid, int csv) {
+    unsigned long long head = __atomic_load_n(&tr->head, __ATOMIC_ACQUIRE);
+    unsigned long long first = head > tr->capacity ? head - tr->capacity : 0ULL;
+    if (first > 0ULL) {
+        fprintf(stderr, "Trace: thread %d ring full, dropped %llu oldest records\n", tid, first);
+    }
+    for (unsigned long long i = first; i < head; i++) {
+        const bench_trace_entry_t *e = &tr->ring[i % tr->capacity];
+        if (csv) {
+            fprintf(fp, "%d,%.9f,%.9f,%llu\n", tid, e->t, e->t - tr->start, e->iterations);
+        } else {
+            fprintf(fp, "TRACE %d %.9f %.9f %llu\n", tid, e->t, e->t - tr->start, e->iterations);
+        }
+    }
+}
+
+static inline void bench_trace_free(bench_trace_t *tr) {
+    free(tr->ring);
+    tr->ring = NULL;
+    tr->head = 0;
+}
+
+#endif
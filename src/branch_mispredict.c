@@ -1,70 +1,339 @@
-/* 
+/*
  * Branch misprediction benchmark.
- * Uses a random data-dependent branch with ~50% taken rate to stress
- * branch predictor accuracy and highlight misprediction penalties.
+ * Uses a random data-dependent branch (taken with probability --taken,
+ * 50% by default) to stress branch predictor accuracy and highlight
+ * misprediction penalties. --mode cond also takes --period (a repeating
+ * pattern of k outcomes, to find where predictor history runs out);
+ * --mode indirect calls through a table of --targets functions with
+ * --entropy random bits per call; --mode return recurses --depth deep
+ * through randomly chosen call sites, past the return stack buffer.
+ * Reports branch MPKI and time per mispredict from the --counters perf
+ * branch-miss counter.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "bench_args.h"
-#define N 10000000 // 10 Million elements
+#include "bench_threads.h"
+#define N 10000000 // 10 Million elements (branches, calls or frames per iteration)
 #define DEFAULT_SEED 1u
 #define DEFAULT_ITERS 1000ULL
+#define DEFAULT_CALL_ITERS 100ULL   // indirect and return modes: a call and a return per branch
+#define DEFAULT_WARMUP 100ULL
+#define DEFAULT_CALL_WARMUP 10ULL
+#define DEFAULT_TARGETS 16
+#define DEFAULT_DEPTH 64
+#define MAX_TARGETS 64
 
-int main(int argc, char **argv) {
-    double t0 = bench_now_sec();
+enum { BRANCH_COND, BRANCH_INDIRECT, BRANCH_RETURN, BRANCH_MODES };
 
-    BENCH_PRINTF("Branch mispredict start\n");
+static const char *const branch_mode_names[BRANCH_MODES] = { "cond", "indirect", "return" };
+// What one of the N units per iteration is: a return-mode frame is a call, a return and the call-site branch.
+static const char *const branch_unit_names[BRANCH_MODES] = { "branch", "call", "frame" };
+static const char *const branch_rate_units[BRANCH_MODES] = { "Gbranch/s", "Gcall/s", "Gframe/s" };
 
-    // 1. Setup Data
-    // Use short to keep cache pressure lower than memory benchmarks, 
-    // focusing bottleneck on the Branch Unit.
-    short *data = (short*)malloc(N * sizeof(short));
+typedef long long (*branch_target_fn)(long long acc);
 
-    srand(bench_parse_seed(argc, argv, DEFAULT_SEED));
-    for (int i = 0; i < N; i++) {
-        data[i] = rand() % 256; // Random values 0-255
+// Distinct indirect-call targets (different constants, so identical-code folding keeps them apart).
+#define BRANCH_TARGET(k) \
+    __attribute__((noinline)) static long long branch_target_##k(long long acc) { return acc * 3 + (k); }
+#define BRANCH_TARGETS8(k) \
+    BRANCH_TARGET(k##0) BRANCH_TARGET(k##1) BRANCH_TARGET(k##2) BRANCH_TARGET(k##3) \
+    BRANCH_TARGET(k##4) BRANCH_TARGET(k##5) BRANCH_TARGET(k##6) BRANCH_TARGET(k##7)
+BRANCH_TARGETS8(1) BRANCH_TARGETS8(2) BRANCH_TARGETS8(3) BRANCH_TARGETS8(4)
+BRANCH_TARGETS8(5) BRANCH_TARGETS8(6) BRANCH_TARGETS8(7) BRANCH_TARGETS8(8)
+#define BRANCH_ROW(k) branch_target_##k##0, branch_target_##k##1, branch_target_##k##2, branch_target_##k##3, \
+                      branch_target_##k##4, branch_target_##k##5, branch_target_##k##6, branch_target_##k##7
+
+static branch_target_fn const branch_table[MAX_TARGETS] = {
+    BRANCH_ROW(1), BRANCH_ROW(2), BRANCH_ROW(3), BRANCH_ROW(4),
+    BRANCH_ROW(5), BRANCH_ROW(6), BRANCH_ROW(7), BRANCH_ROW(8),
+};
+
+/*
+ * Recursion `depth` deep; each frame calls the next from one of two call
+ * sites, chosen by its random bit in `site`. Returns the RSB still holds
+ * are predicted exactly; once the recursion is deeper than the RSB, each
+ * overflowed return goes to one of two addresses at random, and about half
+ * of them mispredict. The call-site branch itself mispredicts about half
+ * the time at any depth. The differing arguments keep the two calls from
+ * being merged, and the empty asm keeps the recursion from becoming a loop.
+ */
+__attribute__((noinline)) static long long branch_recurse(const unsigned char *site, int depth, long long acc) {
+    long long r;
+    if (depth == 0) {
+        return acc + 1;
     }
+    if (site[depth]) {
+        r = branch_recurse(site, depth - 1, acc + 1);
+        __asm__ volatile("" : "+r"(r));
+        return r * 3;
+    }
+    r = branch_recurse(site, depth - 1, acc);
+    __asm__ volatile("" : "+r"(r));
+    return r + 7;
+}
 
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 100ULL);
-    long long sum = 0;
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
-    if (warmup_iters > 0ULL) {
+typedef struct {
+    int mode;
+    short *data;             // cond: taken when >= 128
+    unsigned char *targets;  // indirect: table index per call
+    unsigned char *sites;    // return: call-site bit per frame
+    long long sum;
+} branch_ctx_t;
 
-        BENCH_PRINTF("Branch mispredict warmup start\n");
+static int branch_mode;
+static double branch_taken;
+static int branch_period;
+static int branch_targets;
+static int branch_entropy;
+static int branch_depth;
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
+// Uniform in [0, 1).
+static double branch_uniform(unsigned int *seed) {
+    return (double)rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+// A value on the taken side (>= 128) with probability p.
+static short branch_value(unsigned int *seed, double p) {
+    int taken = branch_uniform(seed) < p;
+    return (short)(taken ? 128 + rand_r(seed) % 128 : rand_r(seed) % 128);
+}
+
+static void *branch_setup(int tid, int argc, char **argv) {
+    branch_ctx_t *ctx = (branch_ctx_t*)calloc(1, sizeof(branch_ctx_t));
+    ctx->mode = branch_mode;
+
+    unsigned int seed = bench_parse_seed(argc, argv, DEFAULT_SEED) + (unsigned int)tid;
+    if (ctx->mode == BRANCH_COND) {
+        // 1. Setup Data
+        // Use short to keep cache pressure lower than memory benchmarks,
+        // focusing bottleneck on the Branch Unit.
+        ctx->data = (short*)malloc(N * sizeof(short));
+        if (branch_period > 0) {
+            for (int i = 0; i < branch_period && i < N; i++) {
+                ctx->data[i] = branch_value(&seed, branch_taken);
+            }
+            for (int i = branch_period; i < N; i++) {
+                ctx->data[i] = ctx->data[i - branch_period];
+            }
+        } else if (branch_taken == 0.5) {
+            for (int i = 0; i < N; i++) {
+                ctx->data[i] = rand_r(&seed) % 256; // Random values 0-255
+            }
+        } else {
             for (int i = 0; i < N; i++) {
-                if (data[i] >= 128) {
-                    sum += data[i];
-                }
+                ctx->data[i] = branch_value(&seed, branch_taken);
             }
         }
-        sum = 0;
+    } else if (ctx->mode == BRANCH_INDIRECT) {
+        // Walk the table in order, offset by `entropy` random bits: that many bits per call are unpredictable.
+        ctx->targets = (unsigned char*)malloc(N);
+        for (int i = 0; i < N; i++) {
+            int offset = branch_entropy > 0 ? rand_r(&seed) % (1 << branch_entropy) : 0;
+            ctx->targets[i] = (unsigned char)((i + offset) % branch_targets);
+        }
+    } else {
+        // Fresh bits for every frame of every recursion, so no history predicts them.
+        ctx->sites = (unsigned char*)malloc((size_t)N + branch_depth + 1);
+        for (int i = 0; i < N + branch_depth + 1; i++) {
+            ctx->sites[i] = (unsigned char)(rand_r(&seed) % 2);
+        }
     }
-    double start = bench_now_sec();
-
-    BENCH_PRINTF("Branch mispredict loop start\n");
+    return ctx;
+}
 
-    // 2. The Loop
-    // The condition (data[i] >= 128) is true 50% of the time, randomly.
-    // This is the mathematical worst-case for a branch predictor.
-    BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
+static void branch_run(void *arg, unsigned long long iters) {
+    branch_ctx_t *ctx = (branch_ctx_t*)arg;
+    long long sum = ctx->sum;
+    if (ctx->mode == BRANCH_INDIRECT) {
+        const unsigned char *targets = ctx->targets;
+        for (unsigned long long iter = 0; iter < iters; iter++) {
+            for (int i = 0; i < N; i++) {
+                sum = branch_table[targets[i]](sum);
+            }
+        }
+        ctx->sum = sum;
+        return;
+    }
+    if (ctx->mode == BRANCH_RETURN) {
+        const unsigned char *sites = ctx->sites;
+        int depth = branch_depth;
+        for (unsigned long long iter = 0; iter < iters; iter++) {
+            for (int calls = 0; calls < N; calls += depth + 1) {
+                sum = branch_recurse(sites + calls, depth, sum);
+            }
+        }
+        ctx->sum = sum;
+        return;
+    }
+    const short *data = ctx->data;
+    // The condition (data[i] >= 128) holds with probability --taken, independently per element unless
+    // --period repeats a pattern. Independent outcomes at 0.5 are the worst case for a branch predictor.
+    for (unsigned long long iter = 0; iter < iters; iter++) {
         for (int i = 0; i < N; i++) {
             if (data[i] >= 128) {
                 sum += data[i];
             }
         }
     }
+    ctx->sum = sum;
+}
+
+static void branch_teardown(void *arg) {
+    branch_ctx_t *ctx = (branch_ctx_t*)arg;
+    free(ctx->data);
+    free(ctx->targets);
+    free(ctx->sites);
+    free(ctx);
+}
+
+/*
+ * Timing normalised by mispredictions: branch MPKI, mispredicts per branch
+ * (per call or frame in the other modes) and loop time per mispredict (per thread), from the branch-miss counter.
+ * Also prints the miss rate an ideal predictor would reach where the
+ * stream fixes it: min(p, 1 - p) for aperiodic cond, 1 - 2^-entropy for
+ * indirect.
+ */
+static void branch_finish(bench_results_t *res) {
+    double units = (double)res->iterations * N * (res->threads > 0 ? res->threads : 1);
+    double misses = bench_perf_sum(&res->perf, BENCH_PERF_BRANCH_MISSES, 0);
+    double instr = bench_perf_sum(&res->perf, BENCH_PERF_INSTRUCTIONS, 0);
+    double model = -1.0;
+    if (branch_mode == BRANCH_COND && branch_period == 0) {
+        model = branch_taken < 0.5 ? branch_taken : 1.0 - branch_taken;
+    } else if (branch_mode == BRANCH_INDIRECT) {
+        model = 1.0 - 1.0 / (double)(1 << branch_entropy);
+    }
+    if (model >= 0.0) {
+        BENCH_PRINTF("Model miss rate: %.4f per %s\n", model, branch_unit_names[branch_mode]);
+        bench_results_add_metric(res, "model_miss_rate", model);
+    }
+    if (isnan(misses) || units <= 0.0) {
+        BENCH_PRINTF("Branch MPKI: n/a (needs --counters perf)\n");
+        return;
+    }
+    double rate = misses / units;
+    double ns = misses > 0.0 ? res->seconds * 1e9 * (res->threads > 0 ? res->threads : 1) / misses : 0.0;
+    BENCH_PRINTF("Branch MPKI: %.2f, mispredicts per %s: %.4f, loop time per mispredict: %.2f ns\n",
+                 isnan(instr) || instr <= 0.0 ? 0.0 : misses * 1000.0 / instr, branch_unit_names[branch_mode], rate, ns);
+    bench_results_add_metric(res, "miss_rate", rate);
+    bench_results_add_metric(res, "ns_per_mispredict", ns);
+}
+
+static const bench_kernel_t branch_kernel = { "Branch mispredict", branch_setup, branch_run, branch_teardown,
+                                              NULL, branch_finish };
+
+// Parses --mode and its parameters; returns -1 when invalid.
+static int branch_parse(int argc, char **argv) {
+    const char *mode = bench_parse_string(argc, argv, "--mode", "cond");
+    branch_mode = -1;
+    for (int m = 0; m < BRANCH_MODES; m++) {
+        if (strcmp(mode, branch_mode_names[m]) == 0) {
+            branch_mode = m;
+        }
+    }
+    if (branch_mode < 0) {
+        fprintf(stderr, "Unknown --mode %s (expected cond, indirect or return)\n", mode);
+        return -1;
+    }
+    branch_taken = strtod(bench_parse_string(argc, argv, "--taken", "0.5"), NULL);
+    if (!(branch_taken >= 0.0 && branch_taken <= 1.0)) {
+        fprintf(stderr, "Invalid --taken (expected a probability in [0, 1])\n");
+        return -1;
+    }
+    branch_period = (int)bench_parse_ull(argc, argv, "--period", 0ULL);
+    if (branch_period < 0 || branch_period > N) {
+        fprintf(stderr, "Invalid --period (expected 0 for aperiodic, or 1 to %d)\n", N);
+        return -1;
+    }
+    branch_targets = (int)bench_parse_ull(argc, argv, "--targets", DEFAULT_TARGETS);
+    if (branch_targets < 1 || branch_targets > MAX_TARGETS) {
+        fprintf(stderr, "Invalid --targets (expected 1 to %d)\n", MAX_TARGETS);
+        return -1;
+    }
+    int max_entropy = 0;
+    while ((2 << max_entropy) <= branch_targets) {
+        max_entropy++;
+    }
+    branch_entropy = (int)bench_parse_ull(argc, argv, "--entropy", (unsigned long long)max_entropy);
+    if (branch_entropy < 0 || branch_entropy > max_entropy) {
+        fprintf(stderr, "Invalid --entropy (expected 0 to %d bits for %d targets)\n", max_entropy, branch_targets);
+        return -1;
+    }
+    branch_depth = (int)bench_parse_ull(argc, argv, "--depth", DEFAULT_DEPTH);
+    if (branch_depth < 1 || branch_depth > 100000) {
+        fprintf(stderr, "Invalid --depth (expected 1 to 100000 frames)\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+
+    BENCH_PRINTF("Branch mispredict start\n");
+
+    if (branch_parse(argc, argv) != 0) {
+        return 1;
+    }
+    switch (branch_mode) {
+    case BRANCH_COND:
+        BENCH_PRINTF("Mode: cond, taken %.3f, period %d%s\n", branch_taken, branch_period,
+                     branch_period ? "" : " (aperiodic)");
+        break;
+    case BRANCH_INDIRECT:
+        BENCH_PRINTF("Mode: indirect, %d targets, %d random bits per call\n", branch_targets, branch_entropy);
+        break;
+    default:
+        BENCH_PRINTF("Mode: return, recursion depth %d\n", branch_depth);
+        break;
+    }
+    unsigned long long default_iters = branch_mode == BRANCH_COND ? DEFAULT_ITERS : DEFAULT_CALL_ITERS;
+    unsigned long long default_warmup = branch_mode == BRANCH_COND ? DEFAULT_WARMUP : DEFAULT_CALL_WARMUP;
+
+    bench_results_t res;
+    bench_results_init(&res, "branch_mispredict", argc, argv);
+    bench_results_set_rate(&res, (double)N * 1e-9, branch_rate_units[branch_mode]);
+    bench_results_add_metric(&res, "taken", branch_taken);
+    bench_results_add_metric(&res, "period", branch_period);
+    bench_results_add_metric(&res, "targets", branch_targets);
+    bench_results_add_metric(&res, "entropy_bits", branch_entropy);
+    bench_results_add_metric(&res, "depth", branch_depth);
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&branch_kernel, &res, argc, argv, t0, default_warmup, default_iters);
+    }
+
+    branch_ctx_t *ctx = (branch_ctx_t*)branch_setup(0, argc, argv);
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, default_warmup);
+    if (warmup_iters > 0ULL) {
+
+        BENCH_PRINTF("Branch mispredict warmup start\n");
+
+        branch_run(ctx, warmup_iters);
+    }
+
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, default_iters, branch_run, ctx);
+    ctx->sum = 0;
+
+    BENCH_PRINTF("Branch mispredict loop start\n");
+
+    // 2. The Loop
+    BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
+    bench_results_run(&res, branch_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
-    BENCH_PRINTF("Sum: %lld\n", sum);
+    BENCH_PRINTF("Sum: %lld\n", ctx->sum);
     BENCH_PRINTF("Branch mispredict complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
-    
-    free(data);
+    branch_finish(&res);
+    bench_results_report(&res);
+    bench_results_free(&res);
+
+    branch_teardown(ctx);
     return 0;
 }
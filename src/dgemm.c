@@ -1,24 +1,793 @@
-/* 
+/*
  * DGEMM (Double-precision General Matrix Multiply) benchmark.
  * BLAS dense matrix multiply to stress floating-point throughput and
- * compute-bound execution.
+ * compute-bound execution, or (--impl blocked) a built-in cache-tiled,
+ * register-blocked GEMM written with FMA intrinsics in FP64, FP32, BF16 or
+ * FP16, so the instruction stream does not depend on the BLAS build.
+ * --scaling weak|strong multiplies one shared matrix with OpenMP threads
+ * (BLAS threads for --impl blas) instead of private copies per thread.
+ * Every run reports its arithmetic intensity and fraction of the FMA peak.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
 #include <cblas.h> // Requires BLAS library (e.g., OpenBLAS, MKL)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "bench_args.h"
-// Matrix dimensions (adjust for L3 cache size, e.g., 256MB / sizeof(double))
-#define N 2048
+#include "bench_threads.h"
+#include "bench_isa.h"
+// Matrix dimensions (adjust for L3 cache size, e.g., 256MB / sizeof(double)); override with --n.
+#define DEFAULT_N 2048
 #define DEFAULT_SEED 1u
 #define DEFAULT_ITERS 250ULL
+#define DEFAULT_WARMUP 20ULL
+// Cache tiles of the blocked GEMM (elements): A block MC x KC in L2, B panel KC x NC in L3.
+#define DEFAULT_MC 96
+#define DEFAULT_KC 256
+#define DEFAULT_NC 3072
+#define GEMM_SAMPLES 64   // C entries checked against a double-precision dot product
+#define DEFAULT_FMA_LATENCY 4          // FMA latency in cycles (Skylake and later, Zen 2 and later)
+#define GEMM_PROBE_ROUNDS 20000000ULL  // dependent FMAs per clock probe
 
-double A[N*N], B[N*N], C[N*N]; // Static allocation
+#if BENCH_HAVE_X86_ISA && defined(__GNUC__) && __GNUC__ >= 12
+#define GEMM_HAVE_HALF 1   // BF16 and FP16 kernels (AVX512-BF16 / AVX512-FP16)
+#else
+#define GEMM_HAVE_HALF 0
+#endif
 
-void init_matrix(double *matrix, int n) {
-    for (int i = 0; i < n*n; i++) {
-        matrix[i] = (double)rand() / RAND_MAX; // Fill with random numbers
+enum { GEMM_FP64, GEMM_FP32, GEMM_BF16, GEMM_FP16, GEMM_PRECISIONS };
+
+static const char *const gemm_precision_names[GEMM_PRECISIONS] = { "fp64", "fp32", "bf16", "fp16" };
+static const int gemm_precision_bits[GEMM_PRECISIONS] = { 64, 32, 16, 16 };
+// Relative error allowed at the sampled entries (K = N products of values in [0, 1]).
+static const double gemm_tolerance[GEMM_PRECISIONS] = { 1e-10, 1e-4, 1e-3, 5e-2 };
+
+/*
+ * Micro-kernel: C[MR x NR] (+)= Apack * Bpack over kc steps, C row-major
+ * with leading dimension ldc. Apack holds MR-row slivers (k-major), Bpack
+ * NR-column slivers (k-major); for BF16 both interleave k in pairs (the
+ * operand layout of VDPBF16PS) and kc is even.
+ */
+typedef void (*gemm_ukernel_fn)(int kc, const void *a, const void *b, void *c, int ldc, int accumulate);
+
+typedef struct {
+    gemm_ukernel_fn ukernel;
+    int mr, nr;
+} gemm_impl_t;
+
+// Per OpenMP thread of the blocked GEMM; padded apart.
+typedef struct {
+    void *Ap;                  // packed A block
+    double tile[8 * 96];       // edge tile: MR x NR elements of C at most
+    double flops, busy;        // timed-loop work and seconds outside barriers
+    char pad[64];
+} gemm_thread_t;
+
+typedef struct {
+    int tid;
+    int blocked;
+    int precision;
+    gemm_impl_t impl;
+    size_t elem, celem;        // bytes per A/B element and per C element
+    int pair;                  // k interleave of the packed operands (2 for BF16)
+    int n;                     // matrix dimension
+    int mc, kc, nc;
+    int nthreads;              // OpenMP threads per multiply (1 unless --scaling)
+    void *A, *B, *C;
+    void *Bp;                  // packed B panel, shared by the threads
+    gemm_thread_t *threads;
+} dgemm_ctx_t;
+
+static int gemm_blocked;
+static int gemm_precision;
+static int gemm_isa;
+static int gemm_mc, gemm_kc, gemm_nc;
+static int gemm_n;               // dimension after --scaling
+static int gemm_scaling;         // 0, or the OpenMP thread count of the shared multiply
+static int gemm_fma_latency;
+static double gemm_probe_hz[BENCH_MAX_CPUS];   // per worker, from the clock probe after the loop
+
+// Round-to-nearest-even float -> bfloat16 bits.
+static uint16_t gemm_to_bf16(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    u += 0x7FFFu + ((u >> 16) & 1u);
+    return (uint16_t)(u >> 16);
+}
+
+static double gemm_from_bf16(uint16_t h) {
+    uint32_t u = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Element i of a matrix of `precision` as a double (C of BF16 is FP32).
+static double gemm_get(const void *m, size_t i, int precision, int is_c) {
+    switch (precision) {
+    case GEMM_FP64: return ((const double*)m)[i];
+    case GEMM_FP32: return ((const float*)m)[i];
+    case GEMM_BF16: return is_c ? ((const float*)m)[i] : gemm_from_bf16(((const uint16_t*)m)[i]);
+#if GEMM_HAVE_HALF
+    default: return (double)((const _Float16*)m)[i];
+#else
+    default: return 0.0;
+#endif
+    }
+}
+
+// --- Micro-kernels -------------------------------------------------------
+
+#define GEMM_SCALAR_UKERNEL(name, T, MR, NR)                                                        \
+    __attribute__((optimize("no-tree-vectorize")))                                                \
+    static void name(int kc, const void *ap, const void *bp, void *cp, int ldc, int accumulate) { \
+        const T *a = (const T*)ap;                                                                \
+        const T *b = (const T*)bp;                                                                \
+        T *c = (T*)cp;                                                                            \
+        T acc[MR][NR] = { { 0 } };                                                                \
+        for (int k = 0; k < kc; k++) {                                                            \
+            for (int r = 0; r < (MR); r++) {                                                      \
+                for (int j = 0; j < (NR); j++) {                                                  \
+                    acc[r][j] += a[k * (MR) + r] * b[k * (NR) + j];                               \
+                }                                                                                 \
+            }                                                                                     \
+        }                                                                                         \
+        for (int r = 0; r < (MR); r++) {                                                          \
+            for (int j = 0; j < (NR); j++) {                                                      \
+                c[r * ldc + j] = accumulate ? c[r * ldc + j] + acc[r][j] : acc[r][j];             \
+            }                                                                                     \
+        }                                                                                         \
+    }
+
+GEMM_SCALAR_UKERNEL(gemm_fp64_scalar, double, 4, 4)
+GEMM_SCALAR_UKERNEL(gemm_fp32_scalar, float, 4, 4)
+
+#if BENCH_HAVE_X86_ISA
+#define GEMM_ISA_ATTR(tgt) __attribute__((target(tgt), optimize("no-tree-vectorize")))
+
+/*
+ * MR x NV vector accumulators kept in registers: each k step loads NV
+ * vectors of B, broadcasts MR elements of A and issues MR * NV FMAs.
+ */
+#define GEMM_VEC_UKERNEL(name, tgt, T, vec_t, VL, MR, NV, loadu, storeu, set1, fmadd, add, zero)   \
+    GEMM_ISA_ATTR(tgt)                                                                             \
+    static void name(int kc, const void *ap, const void *bp, void *cp, int ldc, int accumulate) {  \
+        const T *a = (const T*)ap;                                                                 \
+        const T *b = (const T*)bp;                                                                 \
+        T *c = (T*)cp;                                                                             \
+        vec_t acc[MR][NV];                                                                         \
+        _Pragma("GCC unroll 16") for (int r = 0; r < (MR); r++) {                                  \
+            _Pragma("GCC unroll 4") for (int v = 0; v < (NV); v++) acc[r][v] = zero();             \
+        }                                                                                          \
+        for (int k = 0; k < kc; k++) {                                                             \
+            vec_t bv[NV];                                                                          \
+            _Pragma("GCC unroll 4") for (int v = 0; v < (NV); v++) {                               \
+                bv[v] = loadu(b + (size_t)k * (NV) * (VL) + v * (VL));                             \
+            }                                                                                      \
+            _Pragma("GCC unroll 16") for (int r = 0; r < (MR); r++) {                              \
+                vec_t av = set1(a[(size_t)k * (MR) + r]);                                          \
+                _Pragma("GCC unroll 4") for (int v = 0; v < (NV); v++) {                           \
+                    acc[r][v] = fmadd(av, bv[v], acc[r][v]);                                       \
+                }                                                                                  \
+            }                                                                                      \
+        }                                                                                          \
+        _Pragma("GCC unroll 16") for (int r = 0; r < (MR); r++) {                                  \
+            _Pragma("GCC unroll 4") for (int v = 0; v < (NV); v++) {                               \
+                T *p = c + (size_t)r * ldc + v * (VL);                                             \
+                storeu(p, accumulate ? add(loadu(p), acc[r][v]) : acc[r][v]);                      \
+            }                                                                                      \
+        }                                                                                          \
+    }
+
+// AVX2: 16 registers, 6 x 2 accumulators. AVX-512: 32 registers, 8 x 3 accumulators.
+GEMM_VEC_UKERNEL(gemm_fp64_avx2, "avx2,fma", double, __m256d, 4, 6, 2, _mm256_loadu_pd, _mm256_storeu_pd,
+                 _mm256_set1_pd, _mm256_fmadd_pd, _mm256_add_pd, _mm256_setzero_pd)
+GEMM_VEC_UKERNEL(gemm_fp32_avx2, "avx2,fma", float, __m256, 8, 6, 2, _mm256_loadu_ps, _mm256_storeu_ps,
+                 _mm256_set1_ps, _mm256_fmadd_ps, _mm256_add_ps, _mm256_setzero_ps)
+GEMM_VEC_UKERNEL(gemm_fp64_avx512, "avx512f", double, __m512d, 8, 8, 3, _mm512_loadu_pd, _mm512_storeu_pd,
+                 _mm512_set1_pd, _mm512_fmadd_pd, _mm512_add_pd, _mm512_setzero_pd)
+GEMM_VEC_UKERNEL(gemm_fp32_avx512, "avx512f", float, __m512, 16, 8, 3, _mm512_loadu_ps, _mm512_storeu_ps,
+                 _mm512_set1_ps, _mm512_fmadd_ps, _mm512_add_ps, _mm512_setzero_ps)
+
+#if GEMM_HAVE_HALF
+GEMM_VEC_UKERNEL(gemm_fp16_avx512, "avx512fp16,avx512bw,avx512vl", _Float16, __m512h, 32, 8, 3, _mm512_loadu_ph,
+                 _mm512_storeu_ph, _mm512_set1_ph, _mm512_fmadd_ph, _mm512_add_ph, _mm512_setzero_ph)
+
+// BF16 inputs, FP32 accumulation: each VDPBF16PS adds a k pair of products per lane.
+GEMM_ISA_ATTR("avx512bf16,avx512bw,avx512vl")
+static void gemm_bf16_avx512(int kc, const void *ap, const void *bp, void *cp, int ldc, int accumulate) {
+    const uint32_t *a = (const uint32_t*)ap;   // (A[r][k], A[r][k+1]) pairs
+    const uint16_t *b = (const uint16_t*)bp;
+    float *c = (float*)cp;
+    __m512 acc[8][3];
+    _Pragma("GCC unroll 16") for (int r = 0; r < 8; r++) {
+        _Pragma("GCC unroll 4") for (int v = 0; v < 3; v++) acc[r][v] = _mm512_setzero_ps();
+    }
+    for (int kp = 0; kp < kc / 2; kp++) {
+        __m512bh bv[3];
+        _Pragma("GCC unroll 4") for (int v = 0; v < 3; v++) {
+            bv[v] = (__m512bh)_mm512_loadu_si512((const void*)(b + ((size_t)kp * 3 + v) * 32));
+        }
+        _Pragma("GCC unroll 16") for (int r = 0; r < 8; r++) {
+            __m512bh av = (__m512bh)_mm512_set1_epi32((int)a[(size_t)kp * 8 + r]);
+            _Pragma("GCC unroll 4") for (int v = 0; v < 3; v++) {
+                acc[r][v] = _mm512_dpbf16_ps(acc[r][v], av, bv[v]);
+            }
+        }
+    }
+    _Pragma("GCC unroll 16") for (int r = 0; r < 8; r++) {
+        _Pragma("GCC unroll 4") for (int v = 0; v < 3; v++) {
+            float *p = c + (size_t)r * ldc + v * 16;
+            _mm512_storeu_ps(p, accumulate ? _mm512_add_ps(_mm512_loadu_ps(p), acc[r][v]) : acc[r][v]);
+        }
+    }
+}
+#endif
+
+static const gemm_impl_t gemm_impls[GEMM_PRECISIONS][BENCH_ISA_COUNT] = {
+    { { gemm_fp64_scalar, 4, 4 }, { NULL, 0, 0 }, { gemm_fp64_avx2, 6, 8 }, { gemm_fp64_avx512, 8, 24 } },
+    { { gemm_fp32_scalar, 4, 4 }, { NULL, 0, 0 }, { gemm_fp32_avx2, 6, 16 }, { gemm_fp32_avx512, 8, 48 } },
+#if GEMM_HAVE_HALF
+    { { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, { gemm_bf16_avx512, 8, 48 } },
+    { { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, { gemm_fp16_avx512, 8, 96 } },
+#endif
+};
+#else
+static const gemm_impl_t gemm_impls[GEMM_PRECISIONS][BENCH_ISA_COUNT] = {
+    { { gemm_fp64_scalar, 4, 4 } },
+    { { gemm_fp32_scalar, 4, 4 } },
+};
+#endif
+
+// --- Clock probe -------------------------------------------------------------
+
+// One dependent FP64 FMA chain of `rounds` steps; returns a lane so the chain stays live.
+typedef double (*gemm_probe_fn)(unsigned long long rounds);
+
+#if BENCH_HAVE_X86_ISA
+#define GEMM_PROBE(name, tgt, vec_t, set1, fmadd, first)                      \
+    GEMM_ISA_ATTR(tgt)                                                        \
+    static double name(unsigned long long rounds) {                           \
+        vec_t a = set1(1.0 - 1.0 / 2048.0), b = set1(1.0 / 2048.0);           \
+        vec_t acc = set1(0.5);                                                \
+        for (unsigned long long i = 0; i < rounds; i++) {                     \
+            acc = fmadd(acc, a, b);                                           \
+        }                                                                     \
+        return first(acc);                                                    \
+    }
+
+#define GEMM_PROBE_SET1(x) (x)
+#define GEMM_PROBE_FIRST(x) (x)
+
+// 128-bit FMA is the VEX encoding (FMA3), so the scalar and sse2 probes need FMA too.
+GEMM_PROBE(gemm_probe_scalar, "fma", double, GEMM_PROBE_SET1, __builtin_fma, GEMM_PROBE_FIRST)
+GEMM_PROBE(gemm_probe_sse2, "fma", __m128d, _mm_set1_pd, _mm_fmadd_pd, _mm_cvtsd_f64)
+GEMM_PROBE(gemm_probe_avx2, "avx2,fma", __m256d, _mm256_set1_pd, _mm256_fmadd_pd, _mm256_cvtsd_f64)
+GEMM_PROBE(gemm_probe_avx512, "avx512f", __m512d, _mm512_set1_pd, _mm512_fmadd_pd, _mm512_cvtsd_f64)
+
+static const gemm_probe_fn gemm_probes[BENCH_ISA_COUNT] = { gemm_probe_scalar, gemm_probe_sse2, gemm_probe_avx2,
+                                                            gemm_probe_avx512 };
+#endif
+
+static volatile double gemm_probe_sink;
+
+/*
+ * Clock of the calling core, measured the way fma_peak does it: one dependent
+ * chain at `isa`'s width (so under the kernel's frequency license), rounds x
+ * --fma-latency cycles over the elapsed time. 0 when the CPU has no FMA.
+ */
+static double gemm_probe_clock(int isa) {
+#if BENCH_HAVE_X86_ISA
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("fma") || !bench_isa_supported(isa)) {
+        return 0.0;
+    }
+    double start = bench_now_sec();
+    gemm_probe_sink = gemm_probes[isa](GEMM_PROBE_ROUNDS);
+    double seconds = bench_now_sec() - start;
+    return seconds > 0.0 ? (double)GEMM_PROBE_ROUNDS * gemm_fma_latency / seconds : 0.0;
+#else
+    (void)isa;
+    return 0.0;
+#endif
+}
+
+// CPU feature beyond --isa needed by a precision.
+static int gemm_precision_supported(int precision) {
+#if GEMM_HAVE_HALF
+    __builtin_cpu_init();
+    if (precision == GEMM_BF16) return __builtin_cpu_supports("avx512bf16");
+    if (precision == GEMM_FP16) return __builtin_cpu_supports("avx512fp16");
+#endif
+    return precision == GEMM_FP64 || precision == GEMM_FP32;
+}
+
+// --- Blocked driver --------------------------------------------------------
+
+/*
+ * Packs rows [i0, i0 + m) x columns [p0, p0 + k) of row-major `src` into
+ * `rows`-tall slivers, zero-padding the last sliver and k up to `kpad`.
+ * `rows` is MR when packing A; B is packed transposed (slivers of NR
+ * columns), which is the same walk with the strides swapped.
+ */
+#define GEMM_PACK(name, T)                                                                             \
+    static void name(const T *src, size_t row_stride, size_t col_stride, int i0, int p0, int m, int k,   \
+                     int kpad, int rows, int pair, T *dst) {                                           \
+        for (int s = 0; s * rows < m; s++) {                                                           \
+            T *out = dst + (size_t)s * kpad * rows;                                                    \
+            for (int kk = 0; kk < kpad; kk++) {                                                        \
+                for (int r = 0; r < rows; r++) {                                                       \
+                    int i = s * rows + r;                                                              \
+                    T v = 0;                                                                           \
+                    if (i < m && kk < k) {                                                             \
+                        v = src[(size_t)(i0 + i) * row_stride + (size_t)(p0 + kk) * col_stride];       \
+                    }                                                                                  \
+                    out[((size_t)(kk / pair) * rows + r) * pair + kk % pair] = v;                      \
+                }                                                                                      \
+            }                                                                                          \
+        }                                                                                              \
+    }
+
+GEMM_PACK(gemm_pack64, uint64_t)
+GEMM_PACK(gemm_pack32, uint32_t)
+GEMM_PACK(gemm_pack16, uint16_t)
+
+static void gemm_pack(const dgemm_ctx_t *ctx, const void *src, size_t row_stride, size_t col_stride, int i0, int p0,
+                      int m, int k, int kpad, int rows, void *dst) {
+    switch (ctx->elem) {
+    case 8: gemm_pack64((const uint64_t*)src, row_stride, col_stride, i0, p0, m, k, kpad, rows, 1, (uint64_t*)dst); break;
+    case 4: gemm_pack32((const uint32_t*)src, row_stride, col_stride, i0, p0, m, k, kpad, rows, 1, (uint32_t*)dst); break;
+    default:
+        gemm_pack16((const uint16_t*)src, row_stride, col_stride, i0, p0, m, k, kpad, rows, ctx->pair, (uint16_t*)dst);
+        break;
+    }
+}
+
+// Adds (or stores) the valid m x n corner of an edge tile into C.
+static void gemm_merge(const dgemm_ctx_t *ctx, const void *tile, void *c, int m, int n, int accumulate) {
+    int nr = ctx->impl.nr;
+    for (int r = 0; r < m; r++) {
+        for (int j = 0; j < n; j++) {
+            size_t t = (size_t)r * nr + j, o = (size_t)r * ctx->n + j;
+            switch (ctx->precision) {
+            case GEMM_FP64:
+                ((double*)c)[o] = (accumulate ? ((double*)c)[o] : 0.0) + ((const double*)tile)[t];
+                break;
+            case GEMM_FP32:
+            case GEMM_BF16:
+                ((float*)c)[o] = (accumulate ? ((float*)c)[o] : 0.0f) + ((const float*)tile)[t];
+                break;
+#if GEMM_HAVE_HALF
+            default:
+                ((_Float16*)c)[o] = (accumulate ? ((_Float16*)c)[o] : (_Float16)0) + ((const _Float16*)tile)[t];
+                break;
+#endif
+            }
+        }
+    }
+}
+
+/*
+ * C = A * B: NC-wide panels of B, KC-deep slices, MC-tall blocks of A, then
+ * MR x NR micro-tiles. Threads pack the B panel together, then share out
+ * (A block, NR sliver) pairs in A-block-major order, so each thread packs
+ * only the A blocks its contiguous share touches.
+ */
+static void gemm_blocked_multiply(dgemm_ctx_t *ctx) {
+    int mr = ctx->impl.mr, nr = ctx->impl.nr, n = ctx->n;
+    const char *A = (const char*)ctx->A;
+    const char *B = (const char*)ctx->B;
+    char *C = (char*)ctx->C;
+    #pragma omp parallel num_threads(ctx->nthreads)
+    {
+        gemm_thread_t *th = &ctx->threads[omp_get_thread_num()];
+        for (int jc = 0; jc < n; jc += ctx->nc) {
+            int nb = n - jc < ctx->nc ? n - jc : ctx->nc;
+            int slivers = (nb + nr - 1) / nr;
+            for (int pc = 0; pc < n; pc += ctx->kc) {
+                int kb = n - pc < ctx->kc ? n - pc : ctx->kc;
+                int kpad = (kb + ctx->pair - 1) / ctx->pair * ctx->pair;
+                int blocks = (n + ctx->mc - 1) / ctx->mc;
+                int packed = -1;
+                double start = bench_now_sec();
+                // B[pc.., jc..] packed as slivers of nr columns: walk columns as "rows".
+                #pragma omp for schedule(static)
+                for (int s = 0; s < slivers; s++) {
+                    int cols = nb - s * nr < nr ? nb - s * nr : nr;
+                    gemm_pack(ctx, B, 1, n, jc + s * nr, pc, cols, kb, kpad, nr,
+                              (char*)ctx->Bp + (size_t)s * kpad * nr * ctx->elem);
+                }
+                th->busy += bench_now_sec() - start;
+                #pragma omp for schedule(static)
+                for (int u = 0; u < blocks * slivers; u++) {
+                    double t0 = bench_now_sec();
+                    int ic = u / slivers * ctx->mc, jr = u % slivers * nr;
+                    int mb = n - ic < ctx->mc ? n - ic : ctx->mc;
+                    if (packed != ic) {
+                        gemm_pack(ctx, A, n, 1, ic, pc, mb, kb, kpad, mr, th->Ap);
+                        packed = ic;
+                    }
+                    const char *bp = (const char*)ctx->Bp + (size_t)(jr / nr) * kpad * nr * ctx->elem;
+                    int cols = nb - jr < nr ? nb - jr : nr;
+                    for (int ir = 0; ir < mb; ir += mr) {
+                        const char *ap = (const char*)th->Ap + (size_t)(ir / mr) * kpad * mr * ctx->elem;
+                        char *c = C + ((size_t)(ic + ir) * n + jc + jr) * ctx->celem;
+                        int m = mb - ir < mr ? mb - ir : mr;
+                        if (m == mr && cols == nr) {
+                            ctx->impl.ukernel(kpad, ap, bp, c, n, pc > 0);
+                        } else {
+                            ctx->impl.ukernel(kpad, ap, bp, th->tile, nr, 0);
+                            gemm_merge(ctx, th->tile, c, m, cols, pc > 0);
+                        }
+                    }
+                    th->flops += 2.0 * mb * cols * kb;
+                    th->busy += bench_now_sec() - t0;
+                }
+            }
+        }
+    }
+}
+
+// --- Benchmark -------------------------------------------------------------
+
+static void gemm_set(void *m, size_t i, int precision, double v) {
+    switch (precision) {
+    case GEMM_FP64: ((double*)m)[i] = v; break;
+    case GEMM_FP32: ((float*)m)[i] = (float)v; break;
+    case GEMM_BF16: ((uint16_t*)m)[i] = gemm_to_bf16((float)v); break;
+#if GEMM_HAVE_HALF
+    default: ((_Float16*)m)[i] = (_Float16)v; break;
+#endif
+    }
+}
+
+static void *dgemm_setup(int tid, int argc, char **argv) {
+    dgemm_ctx_t *ctx = (dgemm_ctx_t*)calloc(1, sizeof(dgemm_ctx_t));
+    ctx->tid = tid;
+    ctx->blocked = gemm_blocked;
+    ctx->precision = gemm_precision;
+    ctx->elem = gemm_precision == GEMM_FP64 ? 8 : gemm_precision == GEMM_FP32 ? 4 : 2;
+    ctx->celem = gemm_precision == GEMM_FP64 ? 8 : gemm_precision == GEMM_FP16 ? 2 : 4;
+    ctx->pair = gemm_precision == GEMM_BF16 ? 2 : 1;
+    ctx->n = gemm_n;
+    ctx->nthreads = gemm_scaling && gemm_blocked ? gemm_scaling : 1;
+    size_t nn = (size_t)ctx->n * ctx->n;
+    ctx->A = malloc(nn * ctx->elem);
+    ctx->B = malloc(nn * ctx->elem);
+    ctx->C = malloc(nn * ctx->celem);
+
+    // Seed the random number generator (one stream per thread)
+    unsigned int seed = bench_parse_seed(argc, argv, DEFAULT_SEED) + (unsigned int)tid;
+
+    // Initialize matrices in the precision's storage; C is only written.
+    if (!gemm_scaling) {
+        for (size_t i = 0; i < nn; i++) {
+            gemm_set(ctx->A, i, ctx->precision, (double)rand_r(&seed) / RAND_MAX);
+        }
+        for (size_t i = 0; i < nn; i++) {
+            gemm_set(ctx->B, i, ctx->precision, (double)rand_r(&seed) / RAND_MAX);
+        }
+        memset(ctx->C, 0, nn * ctx->celem);
+    } else {
+        // One stream per row, so that each thread first-touches the rows it fills.
+        #pragma omp parallel for schedule(static) num_threads(gemm_scaling)
+        for (int r = 0; r < ctx->n; r++) {
+            unsigned int row_seed = seed + 2654435761u * (unsigned int)r;
+            for (size_t i = (size_t)r * ctx->n; i < (size_t)(r + 1) * ctx->n; i++) {
+                gemm_set(ctx->A, i, ctx->precision, (double)rand_r(&row_seed) / RAND_MAX);
+                gemm_set(ctx->B, i, ctx->precision, (double)rand_r(&row_seed) / RAND_MAX);
+            }
+            memset((char*)ctx->C + (size_t)r * ctx->n * ctx->celem, 0, (size_t)ctx->n * ctx->celem);
+        }
+    }
+
+    if (ctx->blocked) {
+        ctx->impl = gemm_impls[ctx->precision][gemm_isa];
+        // Tiles rounded to whole micro-tiles (and k pairs for BF16).
+        ctx->mc = gemm_mc / ctx->impl.mr > 0 ? gemm_mc / ctx->impl.mr * ctx->impl.mr : ctx->impl.mr;
+        ctx->nc = gemm_nc / ctx->impl.nr > 0 ? gemm_nc / ctx->impl.nr * ctx->impl.nr : ctx->impl.nr;
+        ctx->kc = (gemm_kc + ctx->pair - 1) / ctx->pair * ctx->pair;
+        ctx->Bp = aligned_alloc(64, ((size_t)ctx->nc * ctx->kc * ctx->elem + 63) / 64 * 64);
+        ctx->threads = (gemm_thread_t*)aligned_alloc(64, (size_t)ctx->nthreads * sizeof(gemm_thread_t));
+        memset(ctx->threads, 0, (size_t)ctx->nthreads * sizeof(gemm_thread_t));
+        for (int t = 0; t < ctx->nthreads; t++) {
+            ctx->threads[t].Ap = aligned_alloc(64, ((size_t)ctx->mc * ctx->kc * ctx->elem + 63) / 64 * 64);
+        }
+    }
+    return ctx;
+}
+
+// C = 1.0 * A * B + 0.0 * C, row-major, no transposes.
+static void dgemm_run(void *arg, unsigned long long iters) {
+    dgemm_ctx_t *ctx = (dgemm_ctx_t*)arg;
+    int n = ctx->n;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        if (ctx->blocked) {
+            gemm_blocked_multiply(ctx);
+        } else if (ctx->precision == GEMM_FP32) {
+            cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, n, n, n, 1.0f, (const float*)ctx->A, n,
+                        (const float*)ctx->B, n, 0.0f, (float*)ctx->C, n);
+        } else {
+            cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, n, n, n, 1.0, ctx->A, n, ctx->B, n, 0.0, ctx->C, n);
+        }
+    }
+}
+
+// Clears the per-thread counters so that they cover the timed loop only.
+static void dgemm_reset(void *arg) {
+    dgemm_ctx_t *ctx = (dgemm_ctx_t*)arg;
+    for (int t = 0; ctx->threads && t < ctx->nthreads; t++) {
+        ctx->threads[t].flops = 0.0;
+        ctx->threads[t].busy = 0.0;
+    }
+}
+
+// Checks sampled entries of the last product against double-precision dot products; exits on a mismatch.
+static void dgemm_validate(const dgemm_ctx_t *ctx) {
+    unsigned int seed = 12345u + (unsigned int)ctx->tid;
+    int n = ctx->n;
+    double worst = 0.0;
+    for (int s = 0; s < GEMM_SAMPLES; s++) {
+        int i = rand_r(&seed) % n, j = rand_r(&seed) % n;
+        double ref = 0.0;
+        for (int k = 0; k < n; k++) {
+            ref += gemm_get(ctx->A, (size_t)i * n + k, ctx->precision, 0) *
+                   gemm_get(ctx->B, (size_t)k * n + j, ctx->precision, 0);
+        }
+        double got = gemm_get(ctx->C, (size_t)i * n + j, ctx->precision, 1);
+        double rel = fabs(got - ref) / (fabs(ref) > 0.0 ? fabs(ref) : 1.0);
+        worst = rel > worst ? rel : worst;
+    }
+    if (!(worst <= gemm_tolerance[ctx->precision])) {
+        fprintf(stderr, "Validation failed: thread %d, relative error %.3e exceeds %.0e for %s\n", ctx->tid, worst,
+                gemm_tolerance[ctx->precision], gemm_precision_names[ctx->precision]);
+        exit(1);
+    }
+    if (ctx->tid == 0) {
+        BENCH_PRINTF("Validation: %d sampled entries within %.1e relative (worst %.1e)\n", GEMM_SAMPLES,
+                     gemm_tolerance[ctx->precision], worst);
+    }
+}
+
+// Per-OpenMP-thread GFLOP/s of the shared multiply (flops over time outside barriers).
+static void dgemm_print_threads(const dgemm_ctx_t *ctx, double loop_sec) {
+    if (ctx->nthreads < 2) {
+        return;
+    }
+    for (int t = 0; t < ctx->nthreads; t++) {
+        const gemm_thread_t *th = &ctx->threads[t];
+        BENCH_PRINTF("OpenMP thread %d: %f GFLOP/s (%.1f%% of the loop outside barriers)\n", t,
+                     th->busy > 0.0 ? th->flops * 1e-9 / th->busy : 0.0, loop_sec > 0.0 ? 100.0 * th->busy / loop_sec : 0.0);
+    }
+}
+
+static void dgemm_teardown(void *arg) {
+    dgemm_ctx_t *ctx = (dgemm_ctx_t*)arg;
+    // Right after the timed loop, before validation cools the core down.
+    if (ctx->tid < BENCH_MAX_CPUS) {
+        gemm_probe_hz[ctx->tid] = gemm_probe_clock(gemm_blocked ? gemm_isa : bench_isa_detect());
+    }
+    dgemm_validate(ctx);
+    free(ctx->A);
+    free(ctx->B);
+    free(ctx->C);
+    free(ctx->Bp);
+    for (int t = 0; ctx->threads && t < ctx->nthreads; t++) {
+        free(ctx->threads[t].Ap);
+    }
+    free(ctx->threads);
+    free(ctx);
+}
+
+// --- Roofline ----------------------------------------------------------------
+
+// Physical cores this process may use (distinct package/core pairs).
+static int gemm_physical_cores(void) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return 1;
+    }
+    int *seen = (int*)malloc(CPU_SETSIZE * sizeof(int));
+    int cores = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        int package = bench_read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        int key = package * 65536 + bench_read_sysfs_int(path, cpu);
+        int dup = 0;
+        for (int i = 0; i < cores && !dup; i++) {
+            dup = seen[i] == key;
+        }
+        if (!dup) {
+            seen[cores++] = key;
+        }
+    }
+    free(seen);
+    return cores > 0 ? cores : 1;
+}
+
+static int gemm_workers;         // cores the run occupies: --threads workers or --scaling threads
+static int gemm_roofline_argc;
+static char **gemm_roofline_argv;
+
+/*
+ * Core clock for the peak: --freq-ghz, else the cycle counter over the timed
+ * loop (--counters perf), else the mean of the workers' clock probes. The
+ * cpufreq and /proc/cpuinfo figures are the requested or base clock, not what
+ * a boosting core (or one under an AVX license) runs at, so they are not used.
+ * Sets `source` to where it came from; 0 if unknown.
+ */
+static double gemm_frequency_hz(const bench_results_t *res, const char **source) {
+    const char *flag = bench_find_arg(gemm_roofline_argc, gemm_roofline_argv, "--freq-ghz");
+    if (flag) {
+        *source = "--freq-ghz";
+        return strtod(flag, NULL) * 1e9;
+    }
+    int workers = res->threads > 0 ? res->threads : 1;
+    double cycles = bench_perf_sum(&res->perf, BENCH_PERF_CYCLES, 0);
+    if (!isnan(cycles) && cycles > 0.0 && res->seconds > 0.0) {
+        *source = "cycle counter";
+        return cycles / (res->seconds * workers);
+    }
+    double probe = 0.0;
+    for (int t = 0; t < workers && t < BENCH_MAX_CPUS; t++) {
+        probe += gemm_probe_hz[t];
     }
+    *source = probe > 0.0 ? "FMA probe" : "unknown";
+    return probe / workers;
+}
+
+
+/*
+ * Places the run on a roofline: arithmetic intensity from the compulsory
+ * traffic (A and B read, C written once) and from the blocked loop nest
+ * (A re-read per NC panel, C read and written per KC slice), and achieved
+ * GFLOP/s as a fraction of cores x clock x FMA units x 2 x SIMD lanes,
+ * counting only the physical cores the workers can occupy.
+ */
+static void dgemm_finish(bench_results_t *res) {
+    double n = gemm_n;
+    size_t elem = gemm_precision == GEMM_FP64 ? 8 : gemm_precision == GEMM_FP32 ? 4 : 2;
+    size_t celem = gemm_precision == GEMM_FP64 ? 8 : gemm_precision == GEMM_FP16 ? 2 : 4;
+    double flops = 2.0 * n * n * n;
+    double compulsory = n * n * (2.0 * elem + celem);
+    double intensity = flops / compulsory;
+    double tiled = intensity;
+    if (gemm_blocked) {
+        double panels = ceil(n / gemm_nc), slices = ceil(n / gemm_kc);
+        tiled = flops / (n * n * elem * (panels + 1.0) + n * n * celem * (2.0 * slices - 1.0));
+    }
+    int isa = gemm_blocked ? gemm_isa : bench_isa_detect();
+    int lanes = isa == BENCH_ISA_SCALAR ? 1 : bench_isa_bits[isa] / gemm_precision_bits[gemm_precision];
+    int units = (int)bench_parse_ull(gemm_roofline_argc, gemm_roofline_argv, "--fma-units", 2ULL);
+    const char *source = "";
+    double hz = gemm_frequency_hz(res, &source);
+    int cores = gemm_physical_cores();
+    int used = gemm_workers < cores ? gemm_workers : cores;
+    double peak = used * hz * units * 2.0 * lanes * 1e-9;
+    bench_summary_t s = bench_results_summarize(res);
+    BENCH_PRINTF("Roofline: %.2f FLOP/byte compulsory, %.2f FLOP/byte with tiling\n", intensity, tiled);
+    BENCH_PRINTF("Peak: %d of %d cores x %.3f GHz (%s) x %d FMA units x %d lanes x 2 = %.1f GFLOP/s\n", used, cores,
+                 hz * 1e-9, source, units, lanes, peak);
+    BENCH_PRINTF("Fraction of peak: %.3f\n", peak > 0.0 ? s.value / peak : 0.0);
+    if (peak > 0.0 && s.value > peak) {
+        BENCH_PRINTF("Warning: fraction of peak above 1; the %s clock, --fma-units or --fma-latency understates "
+                     "the peak\n", source);
+    }
+    bench_results_add_metric(res, "n", n);
+    bench_results_add_metric(res, "arith_intensity", intensity);
+    bench_results_add_metric(res, "tiled_intensity", tiled);
+    bench_results_add_metric(res, "cores", used);
+    bench_results_add_metric(res, "freq_ghz", hz * 1e-9);
+    bench_results_add_metric(res, "peak_gflops", peak);
+    bench_results_add_metric(res, "peak_fraction", peak > 0.0 ? s.value / peak : 0.0);
+}
+
+static const bench_kernel_t dgemm_kernel = { "DGEMM", dgemm_setup, dgemm_run, dgemm_teardown, dgemm_reset,
+                                             dgemm_finish };
+
+/*
+ * --scaling: one multiply shared by omp_get_max_threads() threads. Strong
+ * keeps --n; weak grows it by cbrt(threads) (to a multiple of 64) so that
+ * each thread keeps the single-thread flop count.
+ */
+static int dgemm_parse_scaling(int argc, char **argv) {
+    gemm_n = (int)bench_parse_ull(argc, argv, "--n", DEFAULT_N);
+    if (gemm_n < 1) {
+        fprintf(stderr, "Invalid --n (expected >= 1)\n");
+        return -1;
+    }
+    const char *scaling = bench_find_arg(argc, argv, "--scaling");
+    gemm_scaling = 0;
+    gemm_workers = bench_parse_threads(argc, argv) > 0 ? bench_parse_threads(argc, argv) : 1;
+    if (!scaling) {
+        return 0;
+    }
+    if (strcmp(scaling, "weak") != 0 && strcmp(scaling, "strong") != 0) {
+        fprintf(stderr, "Unknown --scaling %s (expected weak or strong)\n", scaling);
+        return -1;
+    }
+    if (bench_parse_threads(argc, argv) > 0) {
+        fprintf(stderr, "--scaling shares one multiply between OpenMP threads; it cannot be combined with --threads\n");
+        return -1;
+    }
+    gemm_scaling = omp_get_max_threads();
+    gemm_workers = gemm_scaling;
+    if (strcmp(scaling, "weak") == 0 && gemm_scaling > 1) {
+        int n = (int)lround(gemm_n * cbrt((double)gemm_scaling) / 64.0) * 64;
+        gemm_n = n > gemm_n ? n : gemm_n;
+    }
+    BENCH_PRINTF("Scaling: %s, %d threads, N %d\n", scaling, gemm_scaling, gemm_n);
+    return 0;
+}
+
+// Parses --impl, --precision, --fma-latency, --isa, the tile sizes and --n/--scaling; returns -1 when invalid.
+static int dgemm_parse(int argc, char **argv) {
+    gemm_roofline_argc = argc;
+    gemm_roofline_argv = argv;
+    if (dgemm_parse_scaling(argc, argv) != 0) {
+        return -1;
+    }
+    const char *impl = bench_parse_string(argc, argv, "--impl", "blas");
+    const char *precision = bench_parse_string(argc, argv, "--precision", "fp64");
+    if (strcmp(impl, "blas") != 0 && strcmp(impl, "blocked") != 0) {
+        fprintf(stderr, "Unknown --impl %s (expected blas or blocked)\n", impl);
+        return -1;
+    }
+    gemm_blocked = strcmp(impl, "blocked") == 0;
+    gemm_precision = -1;
+    for (int p = 0; p < GEMM_PRECISIONS; p++) {
+        if (strcmp(precision, gemm_precision_names[p]) == 0) {
+            gemm_precision = p;
+        }
+    }
+    if (gemm_precision < 0) {
+        fprintf(stderr, "Unknown --precision %s (expected fp64, fp32, bf16 or fp16)\n", precision);
+        return -1;
+    }
+    gemm_fma_latency = (int)bench_parse_ull(argc, argv, "--fma-latency", DEFAULT_FMA_LATENCY);
+    if (gemm_fma_latency < 1) {
+        fprintf(stderr, "Invalid --fma-latency (expected cycles >= 1)\n");
+        return -1;
+    }
+    if (!gemm_blocked) {
+        if (gemm_precision > GEMM_FP32) {
+            fprintf(stderr, "--precision %s needs --impl blocked (BLAS has no such GEMM)\n", precision);
+            return -1;
+        }
+        return 0;
+    }
+    gemm_isa = bench_isa_select(argc, argv);
+    if (gemm_isa < 0) {
+        return -1;
+    }
+    if (gemm_precision > GEMM_FP32 && bench_find_arg(argc, argv, "--isa") == NULL) {
+        gemm_isa = BENCH_ISA_AVX512;
+    }
+    if (!gemm_precision_supported(gemm_precision) || !gemm_impls[gemm_precision][gemm_isa].ukernel) {
+        fprintf(stderr, "--precision %s has no kernel for --isa %s on this CPU/compiler%s\n", precision,
+                bench_isa_names[gemm_isa], gemm_precision > GEMM_FP32 ? " (needs avx512 with AVX512-BF16/FP16)" : "");
+        return -1;
+    }
+    gemm_mc = (int)bench_parse_ull(argc, argv, "--mc", DEFAULT_MC);
+    gemm_kc = (int)bench_parse_ull(argc, argv, "--kc", DEFAULT_KC);
+    gemm_nc = (int)bench_parse_ull(argc, argv, "--nc", DEFAULT_NC);
+    if (gemm_mc < 1 || gemm_kc < 1 || gemm_nc < 1) {
+        fprintf(stderr, "Invalid --mc/--kc/--nc (expected elements >= 1)\n");
+        return -1;
+    }
+    return 0;
 }
 
 int main(int argc, char **argv) {
@@ -26,47 +795,71 @@ int main(int argc, char **argv) {
 
     BENCH_PRINTF("DGEMM start\n");
 
-    // Seed the random number generator
-    srand(bench_parse_seed(argc, argv, DEFAULT_SEED));
+    if (dgemm_parse(argc, argv) != 0) {
+        return 1;
+    }
+    bench_results_t res;
+    bench_results_init(&res, "dgemm", argc, argv);
+    bench_results_set_rate(&res, 2.0 * (double)gemm_n * (double)gemm_n * (double)gemm_n * 1e-9, "GFLOP/s");
+    bench_results_add_metric(&res, "precision_bits", gemm_precision_bits[gemm_precision]);
+    if (gemm_blocked) {
+        const gemm_impl_t *im = &gemm_impls[gemm_precision][gemm_isa];
+        int mc = gemm_mc / im->mr > 0 ? gemm_mc / im->mr * im->mr : im->mr;
+        int nc = gemm_nc / im->nr > 0 ? gemm_nc / im->nr * im->nr : im->nr;
+        BENCH_PRINTF("GEMM: blocked %s, ISA %s, micro-tile %dx%d, MC %d KC %d NC %d\n",
+                     gemm_precision_names[gemm_precision], bench_isa_names[gemm_isa], im->mr, im->nr, mc, gemm_kc, nc);
+        bench_results_add_metric(&res, "isa_bits", bench_isa_bits[gemm_isa]);
+        bench_results_add_metric(&res, "mr", im->mr);
+        bench_results_add_metric(&res, "nr", im->nr);
+        bench_results_add_metric(&res, "mc", mc);
+        bench_results_add_metric(&res, "kc", gemm_kc);
+        bench_results_add_metric(&res, "nc", nc);
+    } else {
+        BENCH_PRINTF("GEMM: BLAS %s\n", gemm_precision == GEMM_FP32 ? "sgemm" : "dgemm");
+    }
 
-    // Initialize matrices
-    init_matrix(A, N);
-    init_matrix(B, N);
-    init_matrix(C, N);
+    if (bench_parse_threads(argc, argv) > 0) {
+#ifdef OPENBLAS_VERSION
+        // Each harness thread runs its own DGEMM; keep BLAS itself serial.
+        openblas_set_num_threads(1);
+#endif
+        return bench_threads_main(&dgemm_kernel, &res, argc, argv, t0, DEFAULT_WARMUP, DEFAULT_ITERS);
+    }
+#ifdef OPENBLAS_VERSION
+    if (!gemm_blocked) {
+        // One BLAS call per iteration: serial unless --scaling hands it the OpenMP threads.
+        openblas_set_num_threads(gemm_scaling ? gemm_scaling : 1);
+    }
+#endif
+    bench_results_add_metric(&res, "threads", gemm_workers);
 
-    // DGEMM parameters
-    double alpha = 1.0;
-    double beta = 0.0;
-    CBLAS_LAYOUT layout = CblasRowMajor;
-    CBLAS_TRANSPOSE transA = CblasNoTrans;
-    CBLAS_TRANSPOSE transB = CblasNoTrans;
+    void *ctx = dgemm_setup(0, argc, argv);
 
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 20ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("DGEMM warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            cblas_dgemm(layout, transA, transB, N, N, N, alpha, A, N, B, N, beta, C, N);
-        }
+        dgemm_run(ctx, warmup_iters);
     }
 
-    double start_time = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, dgemm_run, ctx);
 
     BENCH_PRINTF("DGEMM loop start\n");
 
+    dgemm_reset(ctx);
+    double start = bench_now_sec();
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        cblas_dgemm(layout, transA, transB, N, N, N, alpha, A, N, B, N, beta, C, N);
-    }
+    bench_results_run(&res, dgemm_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
+    dgemm_print_threads((const dgemm_ctx_t*)ctx, bench_now_sec() - start);
 
-    double seconds = bench_now_sec() - start_time;
     BENCH_PRINTF("DGEMM complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", seconds);
+    dgemm_teardown(ctx);
+    dgemm_finish(&res);
+    bench_results_report(&res);
+    bench_results_free(&res);
 
     return 0;
 }
@@ -1,17 +1,36 @@
-/* 
+/*
  * FFT mix benchmark.
  * Runs a recursive FFT on fixed-size arrays to mix compute intensity with
- * cache behavior and twiddle-factor access patterns.
+ * cache behavior and twiddle-factor access patterns. --impl iterative
+ * instead runs an in-place radix-4 (plus one radix-2 pass when log2 N is
+ * odd) with precomputed twiddles in split real/imaginary arrays, so the
+ * mix is FFT data movement rather than libm calls; --impl batched runs
+ * --batch such transforms per iteration across OpenMP threads.
  */
 
 #include <complex.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <omp.h>
 #include "bench_args.h"
+#include "bench_threads.h"
 #define PI 3.14159265358979323846
-#define N 16384 // Fit in L2/L3 boundary
+#define DEFAULT_N 16384 // Fit in L2/L3 boundary; override with --n (power of two)
+#define DEFAULT_BATCH 64
+#define DEFAULT_SEED 1u
 #define DEFAULT_ITERS 15000ULL
+#define DEFAULT_WARMUP 1000ULL
+#define FFT_SAMPLES 8   // output bins checked against a direct DFT
+
+enum { FFT_RECURSIVE, FFT_ITERATIVE, FFT_BATCHED, FFT_IMPLS };
+
+static const char *const fft_impl_names[FFT_IMPLS] = { "recursive", "iterative", "batched" };
+
+static int fft_impl;
+static int fft_n;
+static int fft_batch;
 
 void fft(double complex *buf, double complex *out, int n, int step) {
     if (step < n) {
@@ -25,47 +44,320 @@ void fft(double complex *buf, double complex *out, int n, int step) {
     }
 }
 
+/*
+ * Plan of the iterative FFT: bit-reversal permutation, then radix-4 passes
+ * of span h = 1 (or 2 after a radix-2 pass), 4, 16, ... For each pass the
+ * table holds W^k, W^2k and W^3k (W = exp(-2 pi i / 4h), k < h) as three
+ * consecutive runs of h, in split re/im arrays, so every butterfly reads
+ * its twiddles with unit stride.
+ */
+typedef struct {
+    int n;
+    int log2n;
+    int *bitrev;
+    double *tw_re;
+    double *tw_im;
+} fft_plan_t;
+
+static void fft_plan_init(fft_plan_t *plan, int n) {
+    plan->n = n;
+    plan->log2n = 0;
+    while ((1 << plan->log2n) < n) {
+        plan->log2n++;
+    }
+    plan->bitrev = (int*)malloc((size_t)n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < plan->log2n; b++) {
+            r |= ((i >> b) & 1) << (plan->log2n - 1 - b);
+        }
+        plan->bitrev[i] = r;
+    }
+    plan->tw_re = (double*)malloc((size_t)(n > 1 ? n : 1) * sizeof(double));
+    plan->tw_im = (double*)malloc((size_t)(n > 1 ? n : 1) * sizeof(double));
+    size_t off = 0;
+    for (int h = plan->log2n % 2 ? 2 : 1; h < n; h *= 4) {
+        for (int j = 1; j <= 3; j++) {
+            for (int k = 0; k < h; k++) {
+                double angle = -2.0 * PI * j * k / (4.0 * h);
+                plan->tw_re[off] = cos(angle);
+                plan->tw_im[off] = sin(angle);
+                off++;
+            }
+        }
+    }
+}
+
+static void fft_plan_free(fft_plan_t *plan) {
+    free(plan->bitrev);
+    free(plan->tw_re);
+    free(plan->tw_im);
+}
+
+// Out-of-place forward FFT: the permutation reads `in`, the passes run in place on `out`.
+static void fft_iterative(const fft_plan_t *plan, const double *in_re, const double *in_im, double *re, double *im) {
+    int n = plan->n;
+    for (int i = 0; i < n; i++) {
+        re[plan->bitrev[i]] = in_re[i];
+        im[plan->bitrev[i]] = in_im[i];
+    }
+    int h = 1;
+    if (plan->log2n % 2) {
+        for (int i = 0; i < n; i += 2) {
+            double r0 = re[i], i0 = im[i];
+            re[i] = r0 + re[i + 1];
+            im[i] = i0 + im[i + 1];
+            re[i + 1] = r0 - re[i + 1];
+            im[i + 1] = i0 - im[i + 1];
+        }
+        h = 2;
+    }
+    const double *wr = plan->tw_re;
+    const double *wi = plan->tw_im;
+    for (; h < n; h *= 4) {
+        // Bit-reversed blocks of h: F0, F2, F1, F3 of the radix-4 split.
+        for (int base = 0; base < n; base += 4 * h) {
+            double *r0 = re + base, *r1 = r0 + h, *r2 = r1 + h, *r3 = r2 + h;
+            double *i0 = im + base, *i1 = i0 + h, *i2 = i1 + h, *i3 = i2 + h;
+            for (int k = 0; k < h; k++) {
+                double t1r = r2[k] * wr[k] - i2[k] * wi[k];
+                double t1i = r2[k] * wi[k] + i2[k] * wr[k];
+                double t2r = r1[k] * wr[h + k] - i1[k] * wi[h + k];
+                double t2i = r1[k] * wi[h + k] + i1[k] * wr[h + k];
+                double t3r = r3[k] * wr[2 * h + k] - i3[k] * wi[2 * h + k];
+                double t3i = r3[k] * wi[2 * h + k] + i3[k] * wr[2 * h + k];
+                double ar = r0[k] + t2r, ai = i0[k] + t2i;
+                double br = r0[k] - t2r, bi = i0[k] - t2i;
+                double cr = t1r + t3r, ci = t1i + t3i;
+                double dr = t1r - t3r, di = t1i - t3i;
+                r0[k] = ar + cr;
+                i0[k] = ai + ci;
+                r2[k] = ar - cr;
+                i2[k] = ai - ci;
+                // y1 = b - i d, y3 = b + i d
+                r1[k] = br + di;
+                i1[k] = bi - dr;
+                r3[k] = br - di;
+                i3[k] = bi + dr;
+            }
+        }
+        wr += 3 * h;
+        wi += 3 * h;
+    }
+}
+
+typedef struct {
+    int impl;
+    int n;
+    int batch;           // transforms per iteration (1 unless batched)
+    int nthreads;        // OpenMP threads of the batched loop (1 unless OMP_NUM_THREADS)
+    double complex *buf;
+    double complex *out;
+    fft_plan_t plan;
+    double *in_re, *in_im;   // batch x n signals
+    double *re, *im;         // batch x n spectra
+} fft_ctx_t;
+
+// Worst |X[k] - DFT(x)[k]| over sampled bins of transform b, relative to sqrt(n).
+static double fft_check(const fft_ctx_t *ctx, int b, unsigned int *seed) {
+    int n = ctx->n;
+    const double *xr = ctx->in_re + (size_t)b * n, *xi = ctx->in_im + (size_t)b * n;
+    const double *yr = ctx->re + (size_t)b * n, *yi = ctx->im + (size_t)b * n;
+    double worst = 0.0;
+    for (int s = 0; s < FFT_SAMPLES; s++) {
+        int k = rand_r(seed) % n;
+        double sr = 0.0, si = 0.0;
+        for (int j = 0; j < n; j++) {
+            // Reduce k*j mod n first so the angle stays exact for large n.
+            double angle = -2.0 * PI * (double)(((long long)k * j) % n) / n;
+            double c = cos(angle), s_ = sin(angle);
+            sr += xr[j] * c - xi[j] * s_;
+            si += xr[j] * s_ + xi[j] * c;
+        }
+        double err = hypot(yr[k] - sr, yi[k] - si) / sqrt((double)n);
+        worst = err > worst ? err : worst;
+    }
+    return worst;
+}
+
+static void *fft_setup(int tid, int argc, char **argv) {
+    fft_ctx_t *ctx = (fft_ctx_t*)calloc(1, sizeof(fft_ctx_t));
+    int N = fft_n;
+    ctx->impl = fft_impl;
+    ctx->n = N;
+    if (fft_impl == FFT_RECURSIVE) {
+        ctx->buf = malloc(N * sizeof(double complex));
+        ctx->out = malloc(N * sizeof(double complex));
+
+        for (int i = 0; i < N; i++) {
+            double angle = 2.0 * PI * (double)i / (double)N;
+            ctx->buf[i] = cos(angle) + I * sin(angle);
+            ctx->out[i] = ctx->buf[i];
+        }
+        return ctx;
+    }
+
+    ctx->batch = fft_impl == FFT_BATCHED ? fft_batch : 1;
+    ctx->nthreads = fft_impl == FFT_BATCHED && bench_omp_enabled(argc, argv) ? omp_get_max_threads() : 1;
+    fft_plan_init(&ctx->plan, N);
+    size_t total = (size_t)ctx->batch * N;
+    ctx->in_re = (double*)malloc(total * sizeof(double));
+    ctx->in_im = (double*)malloc(total * sizeof(double));
+    ctx->re = (double*)malloc(total * sizeof(double));
+    ctx->im = (double*)malloc(total * sizeof(double));
+
+    // Each transform is first touched by the thread that runs it (same static schedule).
+    unsigned int seed = bench_parse_seed(argc, argv, DEFAULT_SEED) + (unsigned int)tid;
+    #pragma omp parallel for schedule(static) num_threads(ctx->nthreads)
+    for (int b = 0; b < ctx->batch; b++) {
+        unsigned int s = seed + 2654435761u * (unsigned int)b;
+        for (size_t i = (size_t)b * N; i < (size_t)(b + 1) * N; i++) {
+            ctx->in_re[i] = 2.0 * rand_r(&s) / RAND_MAX - 1.0;
+            ctx->in_im[i] = 2.0 * rand_r(&s) / RAND_MAX - 1.0;
+            ctx->re[i] = 0.0;
+            ctx->im[i] = 0.0;
+        }
+    }
+    return ctx;
+}
+
+static void fft_run(void *arg, unsigned long long iters) {
+    fft_ctx_t *ctx = (fft_ctx_t*)arg;
+    int n = ctx->n;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        if (ctx->impl == FFT_RECURSIVE) {
+            fft(ctx->buf, ctx->out, n, 1);
+        } else if (ctx->impl == FFT_ITERATIVE) {
+            fft_iterative(&ctx->plan, ctx->in_re, ctx->in_im, ctx->re, ctx->im);
+        } else {
+            #pragma omp parallel for schedule(static) num_threads(ctx->nthreads)
+            for (int b = 0; b < ctx->batch; b++) {
+                size_t off = (size_t)b * n;
+                fft_iterative(&ctx->plan, ctx->in_re + off, ctx->in_im + off, ctx->re + off, ctx->im + off);
+            }
+        }
+    }
+}
+
+// Checks the last spectra against a direct DFT; exits on a mismatch.
+static void fft_validate(const fft_ctx_t *ctx, int tid) {
+    unsigned int seed = 12345u + (unsigned int)tid;
+    double worst = fft_check(ctx, 0, &seed);
+    if (ctx->batch > 1) {
+        double last = fft_check(ctx, ctx->batch - 1, &seed);
+        worst = last > worst ? last : worst;
+    }
+    if (!(worst <= 1e-9)) {
+        fprintf(stderr, "Validation failed: thread %d, error %.3e exceeds 1e-9 x sqrt(N)\n", tid, worst);
+        exit(1);
+    }
+    if (tid == 0) {
+        BENCH_PRINTF("Validation: %d sampled bins within 1e-9 x sqrt(N) of a direct DFT (worst %.1e)\n",
+                     FFT_SAMPLES * (ctx->batch > 1 ? 2 : 1), worst);
+    }
+}
+
+static void fft_teardown(void *arg) {
+    fft_ctx_t *ctx = (fft_ctx_t*)arg;
+    if (ctx->impl == FFT_RECURSIVE) {
+        free(ctx->buf);
+        free(ctx->out);
+        free(ctx);
+        return;
+    }
+    fft_validate(ctx, bench_team_tid);
+    fft_plan_free(&ctx->plan);
+    free(ctx->in_re);
+    free(ctx->in_im);
+    free(ctx->re);
+    free(ctx->im);
+    free(ctx);
+}
+
+static const bench_kernel_t fft_kernel = { "FFT mix", fft_setup, fft_run, fft_teardown };
+
+// Parses --impl, --n and --batch; returns -1 when invalid.
+static int fft_parse(int argc, char **argv) {
+    const char *impl = bench_parse_string(argc, argv, "--impl", "recursive");
+    fft_impl = -1;
+    for (int i = 0; i < FFT_IMPLS; i++) {
+        if (strcmp(impl, fft_impl_names[i]) == 0) {
+            fft_impl = i;
+        }
+    }
+    if (fft_impl < 0) {
+        fprintf(stderr, "Unknown --impl %s (expected recursive, iterative or batched)\n", impl);
+        return -1;
+    }
+    unsigned long long n = bench_parse_ull(argc, argv, "--n", DEFAULT_N);
+    if (n < 2 || n > (1ULL << 26) || (n & (n - 1)) != 0) {
+        fprintf(stderr, "Invalid --n %llu (expected a power of two from 2 to 2^26)\n", n);
+        return -1;
+    }
+    fft_n = (int)n;
+    fft_batch = (int)bench_parse_ull(argc, argv, "--batch", DEFAULT_BATCH);
+    if (fft_batch < 1) {
+        fprintf(stderr, "Invalid --batch (expected transforms >= 1)\n");
+        return -1;
+    }
+    if (fft_impl == FFT_BATCHED && bench_parse_threads(argc, argv) > 0) {
+        fprintf(stderr, "--impl batched spreads transforms over OpenMP threads; it cannot be combined with --threads\n");
+        return -1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     double t0 = bench_now_sec();
 
     BENCH_PRINTF("FFT mix start\n");
 
-    double complex *buf = malloc(N * sizeof(double complex));
-    double complex *out = malloc(N * sizeof(double complex));
+    if (fft_parse(argc, argv) != 0) {
+        return 1;
+    }
+    int transforms = fft_impl == FFT_BATCHED ? fft_batch : 1;
+    BENCH_PRINTF("FFT: %s, N %d", fft_impl_names[fft_impl], fft_n);
+    if (fft_impl == FFT_BATCHED) {
+        BENCH_PRINTF(", %d transforms per iteration, OpenMP threads: %d", fft_batch,
+                     bench_omp_enabled(argc, argv) ? omp_get_max_threads() : 1);
+    }
+    BENCH_PRINTF("\n");
+
+    bench_results_t res;
+    bench_results_init(&res, "fft_mix", argc, argv);
+    // Standard 5 N log2(N) flop count for a complex radix-2 FFT.
+    bench_results_set_rate(&res, transforms * 5.0 * fft_n * log2((double)fft_n) * 1e-9, "GFLOP/s");
+    bench_results_add_metric(&res, "n", fft_n);
+    bench_results_add_metric(&res, "batch", transforms);
 
-    for (int i = 0; i < N; i++) {
-        double angle = 2.0 * PI * (double)i / (double)N;
-        buf[i] = cos(angle) + I * sin(angle);
-        out[i] = buf[i];
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&fft_kernel, &res, argc, argv, t0, DEFAULT_WARMUP, DEFAULT_ITERS);
     }
 
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 1000ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+    void *ctx = fft_setup(0, argc, argv);
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
 
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("FFT mix warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            fft(buf, out, N, 1);
-        }
+        fft_run(ctx, warmup_iters);
     }
 
-    double start = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, fft_run, ctx);
 
     BENCH_PRINTF("FFT mix loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        fft(buf, out, N, 1);
-    }
+    bench_results_run(&res, fft_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
     BENCH_PRINTF("FFT mix complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
-    
-    free(buf); free(out);
+    fft_teardown(ctx);
+    bench_results_report(&res);
+    bench_results_free(&res);
+
     return 0;
 }
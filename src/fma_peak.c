@@ -0,0 +1,298 @@
+/*
+ * FMA peak benchmark.
+ * Independent FMA chains, enough of them to keep every FMA port busy, at one
+ * vector width (--isa scalar|sse2|avx2|avx512: 64/128/256/512 bits) and data
+ * type (--dtype fp64|fp32|fp16). No loads or stores in the loop, so the
+ * regime is purely compute bound; the point is the core clock each width
+ * runs at. Reports FLOP/s, FLOP per cycle and the effective frequency, from
+ * the cycle counter with --counters perf and from a dependent-chain probe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "bench_args.h"
+#include "bench_threads.h"
+#include "bench_isa.h"
+#define DEFAULT_ITERS 500000000ULL
+#define DEFAULT_WARMUP 20000000ULL   // also long enough to settle the AVX frequency license
+#define DEFAULT_LATENCY 4            // FMA latency in cycles (Skylake and later, Zen 2 and later)
+// Accumulators per round: latency x 2 ports is 8; 12 leaves slack and fits 16 registers with the two constants.
+#define FMA_CHAINS 12
+#define FMA_PROBE_ROUNDS 20000000ULL
+// acc = acc * (1 - 2^-11) + 2^-11 converges to 1 and is exact in every type: no overflow, no denormals.
+#define FMA_MUL (1.0 - 1.0 / 2048.0)
+#define FMA_ADD (1.0 / 2048.0)
+
+#if BENCH_HAVE_X86_ISA && defined(__GNUC__) && __GNUC__ >= 12
+#define FMA_HAVE_HALF 1   // FP16 kernels (AVX512-FP16)
+#else
+#define FMA_HAVE_HALF 0
+#endif
+
+enum { FMA_FP64, FMA_FP32, FMA_FP16, FMA_DTYPES };
+
+static const char *const fma_dtype_names[FMA_DTYPES] = { "fp64", "fp32", "fp16" };
+static const int fma_dtype_bits[FMA_DTYPES] = { 64, 32, 16 };
+
+// `rounds` rounds of `chains` FMAs; the accumulators land in `sink` (64 bytes per chain).
+typedef void (*fma_kernel_fn)(unsigned long long rounds, void *sink);
+
+typedef struct {
+    fma_kernel_fn peak;      // FMA_CHAINS independent chains
+    fma_kernel_fn latency;   // one dependent chain
+} fma_impl_t;
+
+typedef struct {
+    int tid;
+    fma_impl_t impl;
+    double probe_hz;
+    void *sink;
+} fma_ctx_t;
+
+static int fma_isa;
+static int fma_dtype;
+static int fma_latency;
+static double fma_probe_hz[BENCH_MAX_CPUS];   // per worker, from the latency probe
+
+// --- Kernels -----------------------------------------------------------------
+
+#if BENCH_HAVE_X86_ISA
+#define FMA_ISA_ATTR(tgt) __attribute__((target(tgt), optimize("no-tree-vectorize")))
+#else
+#define FMA_ISA_ATTR(tgt) __attribute__((optimize("no-tree-vectorize")))
+#endif
+
+#define FMA_KERNEL(name, tgt, T, vec_t, CHAINS, set1, fmadd, store)                  \
+    FMA_ISA_ATTR(tgt)                                                               \
+    static void name(unsigned long long rounds, void *sink) {                       \
+        vec_t a = set1((T)FMA_MUL), b = set1((T)FMA_ADD);                           \
+        vec_t acc[CHAINS];                                                          \
+        _Pragma("GCC unroll 16") for (int c = 0; c < (CHAINS); c++) {               \
+            acc[c] = set1((T)(0.5 + c / 64.0));                                     \
+        }                                                                           \
+        for (unsigned long long i = 0; i < rounds; i++) {                           \
+            _Pragma("GCC unroll 16") for (int c = 0; c < (CHAINS); c++) {           \
+                acc[c] = fmadd(acc[c], a, b);                                       \
+            }                                                                       \
+        }                                                                           \
+        _Pragma("GCC unroll 16") for (int c = 0; c < (CHAINS); c++) {               \
+            store((T*)((char*)sink + (size_t)c * 64), acc[c]);                      \
+        }                                                                           \
+    }
+
+#define FMA_KERNELS(prefix, tgt, T, vec_t, set1, fmadd, store)                                  \
+    FMA_KERNEL(prefix##_peak, tgt, T, vec_t, FMA_CHAINS, set1, fmadd, store)                    \
+    FMA_KERNEL(prefix##_latency, tgt, T, vec_t, 1, set1, fmadd, store)
+
+#define FMA_SCALAR_SET1(x) (x)
+#define FMA_SCALAR_STORE(p, v) (*(p) = (v))
+
+#if BENCH_HAVE_X86_ISA
+FMA_KERNELS(fma_fp64_scalar, "fma", double, double, FMA_SCALAR_SET1, __builtin_fma, FMA_SCALAR_STORE)
+FMA_KERNELS(fma_fp32_scalar, "fma", float, float, FMA_SCALAR_SET1, __builtin_fmaf, FMA_SCALAR_STORE)
+// 128-bit FMA is the VEX encoding (FMA3); SSE2 itself has no FMA.
+FMA_KERNELS(fma_fp64_sse2, "fma", double, __m128d, _mm_set1_pd, _mm_fmadd_pd, _mm_storeu_pd)
+FMA_KERNELS(fma_fp32_sse2, "fma", float, __m128, _mm_set1_ps, _mm_fmadd_ps, _mm_storeu_ps)
+FMA_KERNELS(fma_fp64_avx2, "avx2,fma", double, __m256d, _mm256_set1_pd, _mm256_fmadd_pd, _mm256_storeu_pd)
+FMA_KERNELS(fma_fp32_avx2, "avx2,fma", float, __m256, _mm256_set1_ps, _mm256_fmadd_ps, _mm256_storeu_ps)
+FMA_KERNELS(fma_fp64_avx512, "avx512f", double, __m512d, _mm512_set1_pd, _mm512_fmadd_pd, _mm512_storeu_pd)
+FMA_KERNELS(fma_fp32_avx512, "avx512f", float, __m512, _mm512_set1_ps, _mm512_fmadd_ps, _mm512_storeu_ps)
+#if FMA_HAVE_HALF
+#define FMA_HALF_TARGET "avx512fp16,avx512bw,avx512vl"
+#define FMA_SH_SET1(x) _mm_set_sh(x)
+FMA_KERNELS(fma_fp16_scalar, FMA_HALF_TARGET, _Float16, __m128h, FMA_SH_SET1, _mm_fmadd_sh, _mm_storeu_ph)
+FMA_KERNELS(fma_fp16_sse2, FMA_HALF_TARGET, _Float16, __m128h, _mm_set1_ph, _mm_fmadd_ph, _mm_storeu_ph)
+FMA_KERNELS(fma_fp16_avx2, FMA_HALF_TARGET, _Float16, __m256h, _mm256_set1_ph, _mm256_fmadd_ph, _mm256_storeu_ph)
+FMA_KERNELS(fma_fp16_avx512, FMA_HALF_TARGET, _Float16, __m512h, _mm512_set1_ph, _mm512_fmadd_ph, _mm512_storeu_ph)
+#define FMA_HALF_IMPLS                                                                                    \
+    { { fma_fp16_scalar_peak, fma_fp16_scalar_latency }, { fma_fp16_sse2_peak, fma_fp16_sse2_latency },   \
+      { fma_fp16_avx2_peak, fma_fp16_avx2_latency }, { fma_fp16_avx512_peak, fma_fp16_avx512_latency } }
+#else
+#define FMA_HALF_IMPLS { { 0 } }
+#endif
+
+static const fma_impl_t fma_impls[FMA_DTYPES][BENCH_ISA_COUNT] = {
+    { { fma_fp64_scalar_peak, fma_fp64_scalar_latency }, { fma_fp64_sse2_peak, fma_fp64_sse2_latency },
+      { fma_fp64_avx2_peak, fma_fp64_avx2_latency }, { fma_fp64_avx512_peak, fma_fp64_avx512_latency } },
+    { { fma_fp32_scalar_peak, fma_fp32_scalar_latency }, { fma_fp32_sse2_peak, fma_fp32_sse2_latency },
+      { fma_fp32_avx2_peak, fma_fp32_avx2_latency }, { fma_fp32_avx512_peak, fma_fp32_avx512_latency } },
+    FMA_HALF_IMPLS,
+};
+#else
+FMA_KERNELS(fma_fp64_scalar, "", double, double, FMA_SCALAR_SET1, __builtin_fma, FMA_SCALAR_STORE)
+FMA_KERNELS(fma_fp32_scalar, "", float, float, FMA_SCALAR_SET1, __builtin_fmaf, FMA_SCALAR_STORE)
+
+static const fma_impl_t fma_impls[FMA_DTYPES][BENCH_ISA_COUNT] = {
+    { { fma_fp64_scalar_peak, fma_fp64_scalar_latency } },
+    { { fma_fp32_scalar_peak, fma_fp32_scalar_latency } },
+};
+#endif
+
+// Whether the CPU runs `dtype` FMAs at `isa` width.
+static int fma_supported(int dtype, int isa) {
+    if (!fma_impls[dtype][isa].peak || !bench_isa_supported(isa)) {
+        return 0;
+    }
+#if BENCH_HAVE_X86_ISA
+    if (!__builtin_cpu_supports("fma")) {
+        return 0;
+    }
+#if FMA_HAVE_HALF
+    if (dtype == FMA_FP16) {
+        return __builtin_cpu_supports("avx512fp16");
+    }
+#endif
+#endif
+    return 1;
+}
+
+static int fma_lanes(void) {
+    return fma_isa == BENCH_ISA_SCALAR ? 1 : bench_isa_bits[fma_isa] / fma_dtype_bits[fma_dtype];
+}
+
+// --- Benchmark -----------------------------------------------------------------
+
+static void *fma_setup(int tid, int argc, char **argv) {
+    (void)argc; (void)argv;
+    fma_ctx_t *ctx = (fma_ctx_t*)calloc(1, sizeof(fma_ctx_t));
+    ctx->tid = tid;
+    ctx->impl = fma_impls[fma_dtype][fma_isa];
+    ctx->sink = aligned_alloc(64, FMA_CHAINS * 64);
+    return ctx;
+}
+
+static void fma_run(void *arg, unsigned long long iters) {
+    fma_ctx_t *ctx = (fma_ctx_t*)arg;
+    ctx->impl.peak(iters, ctx->sink);
+}
+
+/*
+ * Clock from one dependent chain right after the timed loop, at the same
+ * width (and so the same frequency license): rounds x latency cycles over
+ * the elapsed time. Assumes --fma-latency is this core's FMA latency.
+ */
+static void fma_teardown(void *arg) {
+    fma_ctx_t *ctx = (fma_ctx_t*)arg;
+    double start = bench_now_sec();
+    ctx->impl.latency(FMA_PROBE_ROUNDS, ctx->sink);
+    double seconds = bench_now_sec() - start;
+    if (ctx->tid < BENCH_MAX_CPUS) {
+        fma_probe_hz[ctx->tid] = seconds > 0.0 ? (double)FMA_PROBE_ROUNDS * fma_latency / seconds : 0.0;
+    }
+    free(ctx->sink);
+    free(ctx);
+}
+
+// Effective frequency and FLOP per cycle per core.
+static void fma_finish(bench_results_t *res) {
+    int workers = res->threads > 0 ? res->threads : 1;
+    double probe = 0.0;
+    for (int t = 0; t < workers && t < BENCH_MAX_CPUS; t++) {
+        probe += fma_probe_hz[t];
+    }
+    probe /= workers;
+    double cycles = bench_perf_sum(&res->perf, BENCH_PERF_CYCLES, 0);
+    double counted = !isnan(cycles) && res->seconds > 0.0 ? cycles / (res->seconds * workers) : 0.0;
+    double hz = counted > 0.0 ? counted : probe;
+    double gflops = bench_results_summarize(res).value;
+    double nominal = bench_perf_nominal_hz();
+
+    BENCH_PRINTF("FMA: %s x %d lanes (%s), %d chains\n", fma_dtype_names[fma_dtype], fma_lanes(),
+                 bench_isa_names[fma_isa], FMA_CHAINS);
+    if (counted > 0.0) {
+        BENCH_PRINTF("Effective frequency: %.3f GHz (cycle counter)\n", counted * 1e-9);
+    }
+    BENCH_PRINTF("Probe frequency: %.3f GHz (dependent chain, %d-cycle FMA latency)\n", probe * 1e-9, fma_latency);
+    if (nominal > 0.0) {
+        BENCH_PRINTF("Clock ratio: %.3f of %.3f GHz nominal\n", hz / nominal, nominal * 1e-9);
+    }
+    BENCH_PRINTF("FLOP per cycle per core: %.2f\n", hz > 0.0 ? gflops * 1e9 / (hz * workers) : 0.0);
+    bench_results_add_metric(res, "vector_bits", fma_isa == BENCH_ISA_SCALAR ? fma_dtype_bits[fma_dtype]
+                                                                                : bench_isa_bits[fma_isa]);
+    bench_results_add_metric(res, "dtype_bits", fma_dtype_bits[fma_dtype]);
+    bench_results_add_metric(res, "chains", FMA_CHAINS);
+    bench_results_add_metric(res, "freq_ghz", hz * 1e-9);
+    bench_results_add_metric(res, "probe_freq_ghz", probe * 1e-9);
+    bench_results_add_metric(res, "flops_per_cycle", hz > 0.0 ? gflops * 1e9 / (hz * workers) : 0.0);
+}
+
+static const bench_kernel_t fma_kernel = { "FMA peak", fma_setup, fma_run, fma_teardown, NULL, fma_finish };
+
+// Parses --isa, --dtype and --fma-latency; returns -1 when invalid.
+static int fma_parse(int argc, char **argv) {
+    const char *dtype = bench_parse_string(argc, argv, "--dtype", "fp64");
+    fma_dtype = -1;
+    for (int d = 0; d < FMA_DTYPES; d++) {
+        if (strcmp(dtype, fma_dtype_names[d]) == 0) {
+            fma_dtype = d;
+        }
+    }
+    if (fma_dtype < 0) {
+        fprintf(stderr, "Unknown --dtype %s (expected fp64, fp32 or fp16)\n", dtype);
+        return -1;
+    }
+    fma_isa = bench_isa_select(argc, argv);
+    if (fma_isa < 0) {
+        return -1;
+    }
+    if (!fma_supported(fma_dtype, fma_isa)) {
+        fprintf(stderr, "--dtype %s has no FMA at --isa %s on this CPU/compiler%s\n", dtype, bench_isa_names[fma_isa],
+                fma_dtype == FMA_FP16 ? " (needs AVX512-FP16)" : " (needs FMA3)");
+        return -1;
+    }
+    fma_latency = (int)bench_parse_ull(argc, argv, "--fma-latency", DEFAULT_LATENCY);
+    if (fma_latency < 1) {
+        fprintf(stderr, "Invalid --fma-latency (expected cycles >= 1)\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+
+    BENCH_PRINTF("FMA peak start\n");
+
+    if (fma_parse(argc, argv) != 0) {
+        return 1;
+    }
+    bench_results_t res;
+    bench_results_init(&res, "fma_peak", argc, argv);
+    bench_results_set_rate(&res, 2.0 * fma_lanes() * FMA_CHAINS * 1e-9, "GFLOP/s");
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&fma_kernel, &res, argc, argv, t0, DEFAULT_WARMUP, DEFAULT_ITERS);
+    }
+
+    void *ctx = fma_setup(0, argc, argv);
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
+    if (warmup_iters > 0ULL) {
+
+        BENCH_PRINTF("FMA peak warmup start\n");
+
+        fma_run(ctx, warmup_iters);
+    }
+
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, fma_run, ctx);
+
+    BENCH_PRINTF("FMA peak loop start\n");
+
+    BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
+    bench_results_run(&res, fma_run, ctx, iterations);
+    BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
+
+    BENCH_PRINTF("FMA peak complete\n");
+
+    fma_teardown(ctx);
+    fma_finish(&res);
+    bench_results_report(&res);
+    bench_results_free(&res);
+
+    return 0;
+}
@@ -7,53 +7,85 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "bench_args.h"
+#include "bench_threads.h"
 // Macro to generate massive code volume without loops (linear execution)
 #define OP a^=b; b+=a; a|=b; b^=a;
 #define OP10 OP OP OP OP OP OP OP OP OP OP 
 #define OP100 OP10 OP10 OP10 OP10 OP10 OP10 OP10 OP10 OP10 OP10
 #define OP1000 OP100 OP100 OP100 OP100 OP100 OP100 OP100 OP100 OP100 OP100
+#define DEFAULT_ITERS 1000000ULL
+#define DEFAULT_WARMUP 10000ULL
+
+typedef struct {
+    int a;
+    int b;
+} icache_ctx_t;
+
+static void *icache_setup(int tid, int argc, char **argv) {
+    (void)tid; (void)argc; (void)argv;
+    icache_ctx_t *ctx = (icache_ctx_t*)malloc(sizeof(icache_ctx_t));
+    ctx->a = 1;
+    ctx->b = 2;
+    return ctx;
+}
+
+static void icache_run(void *arg, unsigned long long iters) {
+    icache_ctx_t *ctx = (icache_ctx_t*)arg;
+    volatile int a = ctx->a, b = ctx->b;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        // This block expands to thousands of instructions.
+        // If this loop body > 32KB, it thrashes L1i.
+        OP1000 
+        OP1000
+        OP1000
+        OP1000
+    }
+    ctx->a = a;
+    ctx->b = b;
+}
+
+static void icache_teardown(void *ctx) {
+    free(ctx);
+}
+
+static const bench_kernel_t icache_kernel = { "I-cache thrash", icache_setup, icache_run, icache_teardown };
 
 int main(int argc, char **argv) {
     double t0 = bench_now_sec();
 
     BENCH_PRINTF("I-cache thrash start\n");
 
-    volatile int a = 1, b = 2;
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 10000ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, 1000000ULL);
+    bench_results_t res;
+    bench_results_init(&res, "icache_thrash", argc, argv);
+    bench_results_set_rate(&res, 1e-6, "Miter/s");
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&icache_kernel, &res, argc, argv, t0, DEFAULT_WARMUP, DEFAULT_ITERS);
+    }
+
+    icache_ctx_t ctx = { 1, 2 };
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
 
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("I-cache thrash warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            OP1000
-            OP1000
-            OP1000
-            OP1000
-        }
+        icache_run(&ctx, warmup_iters);
     }
 
-    double start = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, icache_run, &ctx);
 
     BENCH_PRINTF("I-cache thrash loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        // This block expands to thousands of instructions.
-        // If this loop body > 32KB, it thrashes L1i.
-        OP1000 
-        OP1000
-        OP1000
-        OP1000
-    }
+    bench_results_run(&res, icache_run, &ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
-    BENCH_PRINTF("%d\n", a);
+    BENCH_PRINTF("%d\n", ctx.a);
     BENCH_PRINTF("I-cache thrash complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
+    bench_results_report(&res);
+    bench_results_free(&res);
     
     return 0;
 }
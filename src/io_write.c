@@ -11,6 +11,25 @@
 #define CHUNK_SIZE (1024 * 1024 * 10) // 10 MB chunks
 #define DEFAULT_CHUNK_SIZE CHUNK_SIZE
 #define DEFAULT_ITERS 10ULL
+#define CHUNKS_PER_FILE 100
+
+typedef struct {
+    char *buffer;
+    size_t chunk_size;
+} io_ctx_t;
+
+static void io_run(void *arg, unsigned long long iters) {
+    io_ctx_t *ctx = (io_ctx_t*)arg;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        FILE *fp = fopen("/tmp/test_io_file.bin", "wb");
+        if (!fp) exit(1);
+        for (int i = 0; i < CHUNKS_PER_FILE; i++) {
+            fwrite(ctx->buffer, 1, ctx->chunk_size, fp);
+        }
+        fsync(fileno(fp));
+        fclose(fp);
+    }
+}
 
 int main(int argc, char **argv) {
     double t0 = bench_now_sec();
@@ -18,49 +37,38 @@ int main(int argc, char **argv) {
     BENCH_PRINTF("I/O write start\n");
 
     size_t chunk_size = bench_parse_size(argc, argv, DEFAULT_CHUNK_SIZE);
+
+    bench_results_t res;
+    bench_results_init(&res, "io_write", argc, argv);
+    bench_results_set_rate(&res, (double)CHUNKS_PER_FILE * (double)chunk_size * 1e-9, "GB/s");
+
     char *buffer = (char*)malloc(chunk_size);
     // Fill buffer to prevent OS zero-page optimization
     for (size_t i = 0; i < chunk_size; i++) buffer[i] = (char)i;
 
     unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 1ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+    io_ctx_t ctx = { buffer, chunk_size };
 
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("I/O write warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            FILE *fp = fopen("/tmp/test_io_file.bin", "wb");
-            if (!fp) exit(1);
-            for (int i = 0; i < 100; i++) {
-                fwrite(buffer, 1, chunk_size, fp);
-            }
-            fsync(fileno(fp));
-            fclose(fp);
-        }
+        io_run(&ctx, warmup_iters);
         remove("/tmp/test_io_file.bin");
     }
-    double start = bench_now_sec();
+
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, io_run, &ctx);
 
     BENCH_PRINTF("I/O write loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        FILE *fp = fopen("/tmp/test_io_file.bin", "wb");
-        if (!fp) exit(1);
-        for (int i = 0; i < 100; i++) {
-            fwrite(buffer, 1, chunk_size, fp);
-        }
-        fsync(fileno(fp));
-        fclose(fp);
-    }
+    bench_results_run(&res, io_run, &ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
     BENCH_PRINTF("I/O write complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
+    bench_results_report(&res);
+    bench_results_free(&res);
 
     remove("/tmp/test_io_file.bin");
     free(buffer);
@@ -8,61 +8,88 @@
 #include <stdlib.h>
 #include <omp.h>
 #include "bench_args.h"
-// Size: 2MB (Large enough to bust L2, small enough to fit in L3)
-// Adjust this: typical L2 is 256KB-1MB, L3 is 10MB-64MB.
-#define N (2 * 1024 * 1024 / sizeof(double)) 
+#include "bench_sweep.h"
+// Size: 2MB per array (Large enough to bust L2, small enough to fit in L3)
+// Adjust with --size <bytes> (A and B together): typical L2 is 256KB-1MB, L3 is 10MB-64MB.
+#define DEFAULT_BYTES (2ULL * 2 * 1024 * 1024)
 #define DEFAULT_ITERS 5000000ULL
 
-int main(int argc, char **argv) {
-    double t0 = bench_now_sec();
+typedef struct {
+    double *A;
+    double *B;
+    long n;
+} stencil_ctx_t;
+
+// Elements per array for a working set of `bytes` (A and B together).
+static long stencil_elements(size_t bytes) {
+    long n = (long)(bytes / (2 * sizeof(double)));
+    return n < 3 ? 3 : n;
+}
 
+static void stencil_run(void *arg, unsigned long long iters) {
+    stencil_ctx_t *ctx = (stencil_ctx_t*)arg;
+    double *A = ctx->A;
+    const double *B = ctx->B;
+    long N = ctx->n;
+    // Stencil-like 3-point average (Read 2, Write 1, Spatial Locality)
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        #pragma omp parallel for schedule(static)
+        for (long i = 1; i < N - 1; i++) {
+            A[i] = (B[i-1] + B[i] + B[i+1]) * 0.33;
+        }
+        if (A[N/2] > 1000) break;
+    }
+}
+
+static int stencil_main(int argc, char **argv, double t0) {
     BENCH_PRINTF("L3 stencil start\n");
 
-    double *A = (double*)malloc(N * sizeof(double));
-    double *B = (double*)malloc(N * sizeof(double));
+    long N = stencil_elements(bench_parse_size(argc, argv, DEFAULT_BYTES));
+    bench_results_t res;
+    bench_results_init(&res, "l3_stencil", argc, argv);
+    res.working_set = (size_t)N * 2 * sizeof(double);
+    // One read stream (B) and one write stream (A) per sweep.
+    bench_results_set_rate(&res, 2.0 * sizeof(double) * (double)N * 1e-9, "GB/s");
+
+    double *A = (double*)bench_alloc_output(N * sizeof(double));
+    double *B = (double*)bench_alloc(N * sizeof(double));
 
     // Initialize
     #pragma omp parallel for schedule(static)
-    for(int i=0; i<N; i++) { A[i] = 1.0; B[i] = 0.5; }
+    for(long i=0; i<N; i++) { A[i] = 1.0; B[i] = 0.5; }
 
     unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 5000ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+    stencil_ctx_t ctx = { A, B, N };
 
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("L3 stencil warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            #pragma omp parallel for schedule(static)
-            for (int i = 1; i < N - 1; i++) {
-                A[i] = (B[i-1] + B[i] + B[i+1]) * 0.33;
-            }
-            if (A[N/2] > 1000) break;
-        }
+        stencil_run(&ctx, warmup_iters);
     }
 
-    double start = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, stencil_run, &ctx);
 
     BENCH_PRINTF("L3 stencil loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-
-    // Stencil-like 3-point average (Read 2, Write 1, Spatial Locality)
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        #pragma omp parallel for schedule(static)
-        for (int i = 1; i < N - 1; i++) {
-            A[i] = (B[i-1] + B[i] + B[i+1]) * 0.33;
-        }
-        if (A[N/2] > 1000) break;
-    }
+    bench_results_run(&res, stencil_run, &ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
     BENCH_PRINTF("L3 stencil complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
+    bench_results_report(&res);
+    bench_results_free(&res);
 
-    free(A);
-    free(B);
+    bench_free(A);
+    bench_free(B);
     return 0;
 }
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+    if (bench_sweep_requested(argc, argv)) {
+        return bench_sweep_main(stencil_main, argc, argv, t0);
+    }
+    return stencil_main(argc, argv, t0);
+}
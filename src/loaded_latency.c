@@ -0,0 +1,283 @@
+/*
+ * Loaded-latency benchmark.
+ * One pinned probe thread follows a random pointer chain (as in
+ * pointer_chase.c) while N pinned generator threads stream read, write or
+ * read-modify-write traffic through their own buffers, rate-limited with
+ * --duty / --target-bw. Reports probe latency together with the bandwidth
+ * the generators delivered over the probe's timed loop; a --duty or
+ * --target-bw list gives the latency vs. bandwidth curve.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "bench_args.h"
+#include "bench_threads.h"
+#include "bench_sweep.h"
+#include "bench_pace.h"
+// Probe working set: next[] and values[] for 64M elements, well beyond any LLC.
+// Override with --size <bytes>; --load-size sets each generator's buffer.
+#define DEFAULT_BYTES (64ULL * 1024 * 1024 * 2 * sizeof(int))
+#define DEFAULT_LOAD_BYTES (256ULL * 1024 * 1024)
+#define DEFAULT_SEED 1u
+#define DEFAULT_ITERS 100000000ULL
+#define DEFAULT_WARMUP 1000000ULL
+#define LOAD_BLOCK_WORDS 32768   // 256 KiB per generator burst
+
+enum { LOAD_READ, LOAD_WRITE, LOAD_RMW };
+
+static const char *const load_names[] = { "read", "write", "rmw" };
+
+typedef struct {
+    int *next;
+    int *values;
+    int current_index;
+    volatile int sink;
+} probe_ctx_t;
+
+// One generator; padded so the byte counters do not share cache lines.
+typedef struct {
+    pthread_t thread;
+    int cpu;
+    int kind;
+    size_t words;
+    bench_pace_t pace;
+    unsigned long long bytes;      // DRAM traffic so far, read by the probe thread
+    uint64_t sink;
+    char pad[64];
+} load_gen_t;
+
+static volatile int load_stop;
+static pthread_barrier_t load_ready;   // generators (buffers filled) and the probe (at loop start)
+
+static int probe_elements(size_t bytes) {
+    size_t n = bytes / (2 * sizeof(int));
+    return n < 2 ? 2 : (int)n;
+}
+
+static int load_parse_kind(const char *name) {
+    for (int k = LOAD_READ; k <= LOAD_RMW; k++) {
+        if (strcmp(name, load_names[k]) == 0) {
+            return k;
+        }
+    }
+    fprintf(stderr, "Unknown --load %s (expected read, write or rmw)\n", name);
+    return -1;
+}
+
+// Bytes through DRAM per burst, counting the write-allocate read of regular stores.
+static double load_block_bytes(int kind) {
+    return (kind == LOAD_READ ? 1.0 : 2.0) * LOAD_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+static void *load_worker(void *arg) {
+    load_gen_t *gen = (load_gen_t*)arg;
+    uint64_t *buf = (uint64_t*)bench_alloc(gen->words * sizeof(uint64_t));
+    for (size_t i = 0; i < gen->words; i++) {
+        buf[i] = i;
+    }
+    pthread_barrier_wait(&load_ready);
+    // Pacing covers the probe's timed loop only, not the buffer fill.
+    bench_pace_reset(&gen->pace);
+    uint64_t sum = 0;
+    size_t off = 0;
+    double block_bytes = load_block_bytes(gen->kind);
+    while (!load_stop) {
+        double start = bench_now_sec();
+        uint64_t *p = buf + off;
+        switch (gen->kind) {
+        case LOAD_READ:
+            for (size_t i = 0; i < LOAD_BLOCK_WORDS; i++) sum += p[i];
+            break;
+        case LOAD_WRITE:
+            for (size_t i = 0; i < LOAD_BLOCK_WORDS; i++) p[i] = i + off;
+            break;
+        default:
+            for (size_t i = 0; i < LOAD_BLOCK_WORDS; i++) p[i] += 1;
+            break;
+        }
+        off = off + 2 * LOAD_BLOCK_WORDS <= gen->words ? off + LOAD_BLOCK_WORDS : 0;
+        __atomic_store_n(&gen->bytes, gen->bytes + (unsigned long long)block_bytes, __ATOMIC_RELAXED);
+        if (bench_pace_enabled(&gen->pace)) {
+            bench_pace_wait(&gen->pace, start, bench_now_sec());
+        }
+    }
+    gen->sink = sum;
+    bench_pace_merge(&gen->pace);
+    bench_free(buf);
+    return NULL;
+}
+
+static unsigned long long load_total_bytes(const load_gen_t *gens, int n) {
+    unsigned long long total = 0;
+    for (int g = 0; g < n; g++) {
+        total += __atomic_load_n(&gens[g].bytes, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+static probe_ctx_t *probe_setup(int argc, char **argv) {
+    probe_ctx_t *ctx = (probe_ctx_t*)calloc(1, sizeof(probe_ctx_t));
+    int N = probe_elements(bench_parse_size(argc, argv, DEFAULT_BYTES));
+    int *next = (int*)bench_alloc(N * sizeof(int));
+    int *values = (int*)bench_alloc(N * sizeof(int));
+    int *perm = (int*)calloc((size_t)N, sizeof(int));
+
+    // Single-cycle random permutation, as in pointer_chase.c.
+    unsigned int seed = bench_parse_seed(argc, argv, DEFAULT_SEED);
+    for (int i = 0; i < N; i++) {
+        perm[i] = i;
+        values[i] = i;
+    }
+    for (int i = N - 1; i > 0; i--) {
+        int j = rand_r(&seed) % (i + 1);
+        int tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+    for (int i = 0; i < N - 1; i++) {
+        next[perm[i]] = perm[i + 1];
+    }
+    next[perm[N - 1]] = perm[0];
+
+    ctx->next = next;
+    ctx->values = values;
+    ctx->current_index = perm[0];
+    free(perm);
+    return ctx;
+}
+
+static void probe_run(void *arg, unsigned long long iters) {
+    probe_ctx_t *ctx = (probe_ctx_t*)arg;
+    int *next = ctx->next;
+    int *values = ctx->values;
+    int current_index = ctx->current_index;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        current_index = next[current_index];
+        ctx->sink = values[current_index];
+    }
+    ctx->current_index = current_index;
+}
+
+static int loaded_main(int argc, char **argv, double t0) {
+    BENCH_PRINTF("Loaded latency start\n");
+
+    int kind = load_parse_kind(bench_parse_string(argc, argv, "--load", "read"));
+    if (kind < 0) {
+        return 1;
+    }
+    const char *policy = bench_parse_string(argc, argv, "--affinity", "compact");
+    int *cpus = (int*)malloc(BENCH_MAX_CPUS * sizeof(int));
+    int ncpus = bench_affinity_cpus(policy, cpus, BENCH_MAX_CPUS);
+    // Default: the probe plus one generator on every other CPU of the affinity order.
+    int ngens = (int)bench_parse_ull(argc, argv, "--load-threads", ncpus > 1 ? (unsigned long long)(ncpus - 1) : 1ULL);
+    if (ncpus <= 0) {
+        fprintf(stderr, "Invalid --affinity %s\n", policy);
+        free(cpus);
+        return 1;
+    }
+
+    bench_results_t res;
+    bench_results_init(&res, "loaded_latency", argc, argv);
+    res.working_set = (size_t)probe_elements(bench_parse_size(argc, argv, DEFAULT_BYTES)) * 2 * sizeof(int);
+    bench_results_set_latency(&res, 1.0, "ns/load");
+    bench_pace_t pace;
+    if (bench_pace_init(&pace, argc, argv, load_block_bytes(kind), ngens) != 0) {
+        free(cpus);
+        return 1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[0], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    BENCH_PRINTF("Probe CPU %d, %d %s generators on CPUs:", cpus[0], ngens, load_names[kind]);
+
+    size_t load_words = bench_parse_bytes_text(bench_parse_string(argc, argv, "--load-size", "0")) / sizeof(uint64_t);
+    if (load_words == 0) {
+        load_words = DEFAULT_LOAD_BYTES / sizeof(uint64_t);
+    }
+    if (load_words < 2 * LOAD_BLOCK_WORDS) {
+        load_words = 2 * LOAD_BLOCK_WORDS;
+    }
+    load_gen_t *gens = (load_gen_t*)calloc((size_t)(ngens > 0 ? ngens : 1), sizeof(load_gen_t));
+    load_stop = 0;
+    pthread_barrier_init(&load_ready, NULL, (unsigned)ngens + 1);
+    for (int g = 0; g < ngens; g++) {
+        gens[g].cpu = cpus[(g + 1) % ncpus];
+        gens[g].kind = kind;
+        gens[g].words = load_words;
+        gens[g].pace = pace;
+        BENCH_PRINTF(" %d", gens[g].cpu);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        CPU_ZERO(&set);
+        CPU_SET(gens[g].cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        if (pthread_create(&gens[g].thread, &attr, load_worker, &gens[g]) != 0) {
+            fprintf(stderr, "Failed to create generator %d\n", g);
+            exit(1);
+        }
+        pthread_attr_destroy(&attr);
+    }
+    BENCH_PRINTF("\n");
+    if (ngens + 1 > ncpus) {
+        BENCH_PRINTF("Warning: %d threads share %d CPUs\n", ngens + 1, ncpus);
+    }
+    free(cpus);
+
+    probe_ctx_t *ctx = probe_setup(argc, argv);
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
+    if (warmup_iters > 0ULL) {
+
+        BENCH_PRINTF("Loaded latency warmup start\n");
+
+        probe_run(ctx, warmup_iters);
+    }
+
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, probe_run, ctx);
+
+    BENCH_PRINTF("Loaded latency loop start\n");
+
+    // Generators start streaming once all of them have filled their buffers and the probe is here.
+    pthread_barrier_wait(&load_ready);
+    unsigned long long bytes0 = load_total_bytes(gens, ngens);
+    double start = bench_now_sec();
+    BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
+    bench_results_run(&res, probe_run, ctx, iterations);
+    BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
+    double delivered = (double)(load_total_bytes(gens, ngens) - bytes0) * 1e-9 / (bench_now_sec() - start);
+
+    load_stop = 1;
+    for (int g = 0; g < ngens; g++) {
+        pthread_join(gens[g].thread, NULL);
+    }
+    pthread_barrier_destroy(&load_ready);
+    BENCH_PRINTF("Sink: %d\n", ctx->sink);
+    BENCH_PRINTF("Loaded latency complete\n");
+
+    BENCH_PRINTF("Delivered bandwidth: %f GB/s (%d %s generators)\n", delivered, ngens, load_names[kind]);
+    bench_results_add_metric(&res, "load_threads", ngens);
+    bench_results_add_metric(&res, "delivered_gbs", delivered);
+    bench_pace_report(&pace, &res, ngens);
+    bench_sweep_state.column = "GB/s";
+    bench_sweep_state.column_value = delivered;
+    bench_results_report(&res);
+    bench_results_free(&res);
+
+    bench_free(ctx->values);
+    bench_free(ctx->next);
+    free(ctx);
+    free(gens);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+    if (bench_sweep_requested(argc, argv)) {
+        return bench_sweep_main(loaded_main, argc, argv, t0);
+    }
+    return loaded_main(argc, argv, t0);
+}
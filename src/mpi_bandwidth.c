@@ -14,6 +14,36 @@
 #define DEFAULT_MSG_SIZE SIZE
 #define DEFAULT_ITERS 20000ULL
 
+typedef struct {
+    char *buf;
+    int msg_size;
+    int rank;
+    int size;
+} pingpong_ctx_t;
+
+static void pingpong_run(void *arg, unsigned long long iters) {
+    pingpong_ctx_t *ctx = (pingpong_ctx_t*)arg;
+    int rank = ctx->rank;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        if (rank % 2 == 0) {
+            if (rank + 1 < ctx->size) {
+                MPI_Send(ctx->buf, ctx->msg_size, MPI_CHAR, rank + 1, 0, MPI_COMM_WORLD);
+                MPI_Recv(ctx->buf, ctx->msg_size, MPI_CHAR, rank + 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            }
+        } else {
+            MPI_Recv(ctx->buf, ctx->msg_size, MPI_CHAR, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(ctx->buf, ctx->msg_size, MPI_CHAR, rank - 1, 0, MPI_COMM_WORLD);
+        }
+    }
+}
+
+// Slowest rank decides, so every rank calibrates to the same iteration count.
+static double mpi_agree_max(double value) {
+    double result = value;
+    MPI_Allreduce(&value, &result, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return result;
+}
+
 int main(int argc, char** argv) {
     double t0 = bench_now_sec();
     MPI_Init(&argc, &argv);
@@ -34,9 +64,14 @@ int main(int argc, char** argv) {
     size_t parsed_size = bench_parse_size(argc, argv, DEFAULT_MSG_SIZE);
     int msg_size = (parsed_size > (size_t)INT_MAX) ? INT_MAX : (int)parsed_size;
     char *buf = (char*)malloc((size_t)msg_size);
+    pingpong_ctx_t ctx = { buf, msg_size, rank, size };
+
+    bench_results_t res;
+    bench_results_init(&res, "mpi_bandwidth", argc, argv);
+    // One message in each direction per iteration.
+    bench_results_set_rate(&res, 2.0 * (double)msg_size * 1e-9, "GB/s");
 
     unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 200ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
 
     if (warmup_iters > 0ULL) {
         if (rank == 0) {
@@ -45,47 +80,31 @@ int main(int argc, char** argv) {
 
         }
         MPI_Barrier(MPI_COMM_WORLD);
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            if (rank % 2 == 0) {
-                if (rank + 1 < size) {
-                    MPI_Send(buf, msg_size, MPI_CHAR, rank + 1, 0, MPI_COMM_WORLD);
-                    MPI_Recv(buf, msg_size, MPI_CHAR, rank + 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                }
-            } else {
-                MPI_Recv(buf, msg_size, MPI_CHAR, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Send(buf, msg_size, MPI_CHAR, rank - 1, 0, MPI_COMM_WORLD);
-            }
-        }
+        pingpong_run(&ctx, warmup_iters);
     }
 
+    double duration = bench_parse_duration(argc, argv);
+    unsigned long long iterations = duration > 0.0
+        ? bench_calibrate_iterations(pingpong_run, &ctx, duration, mpi_agree_max)
+        : bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+
     MPI_Barrier(MPI_COMM_WORLD);
-    double start_time = MPI_Wtime();
     if (rank == 0) {
 
         BENCH_PRINTF("MPI bandwidth loop start\n");
 
         BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
     }
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        if (rank % 2 == 0) {
-            if (rank + 1 < size) {
-                MPI_Send(buf, msg_size, MPI_CHAR, rank + 1, 0, MPI_COMM_WORLD);
-                MPI_Recv(buf, msg_size, MPI_CHAR, rank + 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            }
-        } else {
-            MPI_Recv(buf, msg_size, MPI_CHAR, rank - 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            MPI_Send(buf, msg_size, MPI_CHAR, rank - 1, 0, MPI_COMM_WORLD);
-        }
-    }
+    bench_results_run(&res, pingpong_run, &ctx, iterations);
     if (rank == 0) {
         BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
         BENCH_PRINTF("MPI bandwidth complete\n");
-
-        BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-        BENCH_PRINTF("Loop time: %f seconds\n", MPI_Wtime() - start_time);
     }
+    // Every rank reports: text goes to the root only, --report-file records to one file per rank.
+    bench_results_report(&res);
 
+    bench_results_free(&res);
     free(buf);
     MPI_Finalize();
     return 0;
@@ -8,6 +8,20 @@
 #include <stdlib.h>
 #include <mpi.h>
 #include "bench_args.h"
+static void barrier_run(void *ctx, unsigned long long iters) {
+    (void)ctx;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+// Slowest rank decides, so every rank calibrates to the same iteration count.
+static double mpi_agree_max(double value) {
+    double result = value;
+    MPI_Allreduce(&value, &result, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return result;
+}
+
 int main(int argc, char *argv[]) {
     int rank, size;
     double t0 = bench_now_sec();
@@ -19,38 +33,41 @@ int main(int argc, char *argv[]) {
         BENCH_PRINTF("MPI barrier start\n");
 
     }
+    bench_results_t res;
+    bench_results_init(&res, "mpi_barrier", argc, argv);
+    bench_results_set_latency(&res, 1.0, "ns/barrier");
+
     // Run for a fixed workload by default
     unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 3000ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, 30000000ULL);
     if (warmup_iters > 0ULL) {
         if (rank == 0) {
 
             BENCH_PRINTF("MPI barrier warmup start\n");
 
         }
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            MPI_Barrier(MPI_COMM_WORLD);
-        }
+        barrier_run(NULL, warmup_iters);
     }
 
-    double start_time = MPI_Wtime();
+    double duration = bench_parse_duration(argc, argv);
+    unsigned long long iterations = duration > 0.0
+        ? bench_calibrate_iterations(barrier_run, NULL, duration, mpi_agree_max)
+        : bench_parse_iterations(argc, argv, 30000000ULL);
+
     if (rank == 0) {
 
         BENCH_PRINTF("MPI barrier loop start\n");
 
         BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
     }
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        MPI_Barrier(MPI_COMM_WORLD);
-    }
+    bench_results_run(&res, barrier_run, NULL, iterations);
     if (rank == 0) {
         BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
         BENCH_PRINTF("MPI barrier complete\n");
-
-        BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-        BENCH_PRINTF("Loop time: %f seconds\n", MPI_Wtime() - start_time);
     }
+    // Every rank reports: text goes to the root only, --report-file records to one file per rank.
+    bench_results_report(&res);
+    bench_results_free(&res);
 
     MPI_Finalize();
     return 0;
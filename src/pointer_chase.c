@@ -1,80 +1,352 @@
 /* 
  * Pointer chase benchmark.
  * Follows a random single-cycle permutation to serialize loads and expose
- * memory latency from caches and DRAM.
+ * memory latency from caches and DRAM. With --chains K, K independent
+ * chases walk the same cycle from evenly spaced starting points in one
+ * loop, so up to K misses are outstanding at once and the effective
+ * memory-level parallelism (MLP) can be measured.
+ *
+ * --layout selects the node layout: "int" (default) packs 4-byte indices
+ * into next[] with a parallel values[] array, so several nodes share a
+ * cache line; "line" and "page" place one pointer node per cache line or
+ * per page. --scope limits the randomisation: nodes are shuffled within
+ * blocks of a page, 2 MB or the whole set ("global", default) and the
+ * blocks are visited in random order, separating cache from TLB misses.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "bench_args.h"
-#define N 1000000  // Number of elements
+#include "bench_threads.h"
+#include "bench_sweep.h"
+// Working set: next[] and values[] for 1M elements. Override with --size
+// <bytes> or sweep it with --sweep-bytes min:max:factor.
+#define DEFAULT_BYTES (1000000ULL * 2 * sizeof(int))
 #define DEFAULT_SEED 1u
 #define DEFAULT_ITERS 1000000000ULL
+#define DEFAULT_WARMUP 100000ULL
+#define CHASE_MAX_CHAINS 32
+#define CHASE_REFERENCE_SEC 0.2   // single-chain reference run for the MLP estimate
 
-int main(int argc, char **argv) {
-    double t0 = bench_now_sec();
+typedef struct {
+    int *next;                    // "int" layout
+    int *values;
+    char *base;                   // "line"/"page" layouts: node i at base + i * stride
+    size_t stride;
+    int chains;
+    int current[CHASE_MAX_CHAINS];
+    void *current_ptr[CHASE_MAX_CHAINS];
+    double single_ns;             // single-chain latency measured before the loop (chains > 1)
+    volatile int sink;
+} chase_ctx_t;
 
-    BENCH_PRINTF("Pointer chase start\n");
+// Single-chain latency summed over --threads workers, merged at teardown.
+static double chase_single_ns_sum;
+static int chase_single_count;
+static pthread_mutex_t chase_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int chase_parse_chains(int argc, char **argv) {
+    int chains = (int)bench_parse_ull(argc, argv, "--chains", 1ULL);
+    if (chains < 1 || chains > CHASE_MAX_CHAINS) {
+        fprintf(stderr, "Invalid --chains %d (expected 1..%d)\n", chains, CHASE_MAX_CHAINS);
+        return 0;
+    }
+    return chains;
+}
+
+// --layout int|line|page: node stride in bytes, 0 for the int layout, -1 when unknown.
+static long chase_parse_layout(int argc, char **argv) {
+    const char *layout = bench_parse_string(argc, argv, "--layout", "int");
+    if (strcmp(layout, "int") == 0) return 0;
+    if (strcmp(layout, "line") == 0) return 64;
+    if (strcmp(layout, "page") == 0) return sysconf(_SC_PAGESIZE);
+    fprintf(stderr, "Unknown --layout %s (expected int, line or page)\n", layout);
+    return -1;
+}
+
+// --scope page|2m|global (or a positive byte count): randomisation block in bytes, 0 for global, -1 when unknown.
+static long chase_parse_scope(int argc, char **argv) {
+    const char *scope = bench_parse_string(argc, argv, "--scope", "global");
+    if (strcmp(scope, "global") == 0) return 0;
+    if (strcmp(scope, "page") == 0) return sysconf(_SC_PAGESIZE);
+    if (strcmp(scope, "2m") == 0) return 2L * 1024 * 1024;
+    char *end = NULL;
+    strtod(scope, &end);
+    int suffix_ok = *end == '\0' || (strchr("kKmMgG", *end) && end[1] == '\0');
+    long bytes = end != scope && suffix_ok ? (long)bench_parse_bytes_text(scope) : 0;
+    if (bytes > 0) return bytes;
+    fprintf(stderr, "Unknown --scope %s (expected page, 2m, global or a byte count such as 64K)\n", scope);
+    return -1;
+}
+
+// Chain length for a working set of `bytes` (next[] and values[] together, or stride-sized nodes).
+static int chase_elements(size_t bytes, size_t stride) {
+    size_t n = stride ? bytes / stride : bytes / (2 * sizeof(int));
+    return n < 2 ? 2 : (int)n;
+}
+
+/*
+ * Visit order over N nodes: blocks of `block` consecutive nodes in random
+ * order, nodes shuffled within each block. A single block is a plain
+ * Fisher-Yates shuffle of all nodes.
+ */
+static void chase_permutation(int *perm, int N, int block, unsigned int *seed) {
+    int nblocks = (N + block - 1) / block;
+    int *order = (int*)malloc((size_t)nblocks * sizeof(int));
+    for (int b = 0; b < nblocks; b++) {
+        order[b] = b;
+    }
+    for (int b = nblocks - 1; b > 0; b--) {
+        int j = rand_r(seed) % (b + 1);
+        int tmp = order[b];
+        order[b] = order[j];
+        order[j] = tmp;
+    }
+    int k = 0;
+    for (int b = 0; b < nblocks; b++) {
+        int first = k;
+        int hi = (int)((long)order[b] * block + block < N ? (long)order[b] * block + block : N);
+        for (int i = order[b] * block; i < hi; i++) {
+            perm[k++] = i;
+        }
+        for (int i = k - 1; i > first; i--) {
+            int j = first + rand_r(seed) % (i - first + 1);
+            int tmp = perm[i];
+            perm[i] = perm[j];
+            perm[j] = tmp;
+        }
+    }
+    free(order);
+}
+
+static void chase_reference(chase_ctx_t *ctx);
 
-    int *next = (int*)malloc(N * sizeof(int));
-    int *values = (int*)malloc(N * sizeof(int));
-    int *perm = (int*)malloc(N * sizeof(int));
+static void *chase_setup(int tid, int argc, char **argv) {
+    chase_ctx_t *ctx = (chase_ctx_t*)calloc(1, sizeof(chase_ctx_t));
+    ctx->stride = (size_t)chase_parse_layout(argc, argv);
+    int N = chase_elements(bench_parse_size(argc, argv, DEFAULT_BYTES), ctx->stride);
+    size_t scope = (size_t)chase_parse_scope(argc, argv);
+    size_t node_bytes = ctx->stride ? ctx->stride : sizeof(int);
+    int block = scope ? (int)(scope / node_bytes > 0 ? scope / node_bytes : 1) : N;
+    int *perm = (int*)calloc((size_t)N, sizeof(int));
 
     // Create a single-cycle random permutation for deterministic pointer chasing.
-    srand(bench_parse_seed(argc, argv, DEFAULT_SEED));
-    for (int i = 0; i < N; i++) {
-        perm[i] = i;
-        values[i] = i;
-    }
-    for (int i = N - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
-        int tmp = perm[i];
-        perm[i] = perm[j];
-        perm[j] = tmp;
-    }
-    for (int i = 0; i < N - 1; i++) {
-        next[perm[i]] = perm[i + 1];
-    }
-    next[perm[N - 1]] = perm[0];
-
-    // Start timing
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 100000ULL);
-    double start_time = bench_now_sec();
-
-    // Pointer chasing loop
-    int current_index = perm[0];
-    volatile int sink = 0;
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+    unsigned int seed = bench_parse_seed(argc, argv, DEFAULT_SEED) + (unsigned int)tid;
+    chase_permutation(perm, N, block, &seed);
+    if (ctx->stride) {
+        char *base = (char*)bench_alloc((size_t)N * ctx->stride);
+        for (int i = 0; i < N; i++) {
+            *(void**)(base + (size_t)perm[i] * ctx->stride) = base + (size_t)perm[(i + 1) % N] * ctx->stride;
+        }
+        ctx->base = base;
+    } else {
+        int *next = (int*)bench_alloc(N * sizeof(int));
+        int *values = (int*)bench_alloc(N * sizeof(int));
+        for (int i = 0; i < N; i++) {
+            values[i] = i;
+        }
+        for (int i = 0; i < N - 1; i++) {
+            next[perm[i]] = perm[i + 1];
+        }
+        next[perm[N - 1]] = perm[0];
+        ctx->next = next;
+        ctx->values = values;
+    }
+
+    // Chains start N/K apart on the cycle and advance in lockstep, so they never meet.
+    ctx->chains = chase_parse_chains(argc, argv);
+    for (int k = 0; k < ctx->chains; k++) {
+        ctx->current[k] = perm[(long)k * N / ctx->chains];
+        ctx->current_ptr[k] = ctx->base ? ctx->base + (size_t)ctx->current[k] * ctx->stride : NULL;
+    }
+    free(perm);
+    // Before the harness's start barrier, so the workers' timed loops start together.
+    chase_reference(ctx);
+    return ctx;
+}
+
+// One iteration advances each of the K chains by one load; K is a constant at every call site.
+static inline __attribute__((always_inline)) void chase_steps(chase_ctx_t *ctx, unsigned long long iters, int K) {
+    const int *next = ctx->next;
+    const int *values = ctx->values;
+    int cur[CHASE_MAX_CHAINS];
+    for (int k = 0; k < K; k++) {
+        cur[k] = ctx->current[k];
+    }
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        #pragma GCC unroll 32
+        for (int k = 0; k < K; k++) {
+            cur[k] = next[cur[k]];
+            ctx->sink = values[cur[k]];
+        }
+    }
+    for (int k = 0; k < K; k++) {
+        ctx->current[k] = cur[k];
+    }
+}
+
+// Pointer layouts: one dependent load per step, no index arithmetic on the chain.
+static inline __attribute__((always_inline)) void chase_steps_ptr(chase_ctx_t *ctx, unsigned long long iters, int K) {
+    void *cur[CHASE_MAX_CHAINS];
+    for (int k = 0; k < K; k++) {
+        cur[k] = ctx->current_ptr[k];
+    }
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        #pragma GCC unroll 32
+        for (int k = 0; k < K; k++) {
+            cur[k] = *(void**)cur[k];
+        }
+    }
+    for (int k = 0; k < K; k++) {
+        ctx->current_ptr[k] = cur[k];
+    }
+}
+
+#define CHASE_CASE(K)                          \
+    case K:                                    \
+        if (ctx->base) {                       \
+            chase_steps_ptr(ctx, iters, K);    \
+        } else {                               \
+            chase_steps(ctx, iters, K);        \
+        }                                      \
+        break;
+
+static void chase_run(void *arg, unsigned long long iters) {
+    chase_ctx_t *ctx = (chase_ctx_t*)arg;
+    switch (ctx->chains) {
+    CHASE_CASE(1) CHASE_CASE(2) CHASE_CASE(3) CHASE_CASE(4) CHASE_CASE(5) CHASE_CASE(6) CHASE_CASE(7) CHASE_CASE(8)
+    CHASE_CASE(9) CHASE_CASE(10) CHASE_CASE(11) CHASE_CASE(12) CHASE_CASE(13) CHASE_CASE(14) CHASE_CASE(15)
+    CHASE_CASE(16) CHASE_CASE(17) CHASE_CASE(18) CHASE_CASE(19) CHASE_CASE(20) CHASE_CASE(21) CHASE_CASE(22)
+    CHASE_CASE(23) CHASE_CASE(24) CHASE_CASE(25) CHASE_CASE(26) CHASE_CASE(27) CHASE_CASE(28) CHASE_CASE(29)
+    CHASE_CASE(30) CHASE_CASE(31) CHASE_CASE(32)
+    default: break;
+    }
+}
+
+/*
+ * Measures single-chain latency on the same cycle for CHASE_REFERENCE_SEC
+ * (chain 0 only), the baseline for effective MLP = single / per-load time.
+ * Chain 0 is put back where it started, keeping the chains N/K apart.
+ */
+static void chase_reference(chase_ctx_t *ctx) {
+    if (ctx->chains == 1) {
+        return;
+    }
+    int current = ctx->current[0];
+    void *current_ptr = ctx->current_ptr[0];
+    const unsigned long long block = 100000ULL;
+    unsigned long long loads = 0;
+    double start = bench_now_sec(), now = start;
+    while (now - start < CHASE_REFERENCE_SEC) {
+        if (ctx->base) {
+            chase_steps_ptr(ctx, block, 1);
+        } else {
+            chase_steps(ctx, block, 1);
+        }
+        loads += block;
+        now = bench_now_sec();
+    }
+    ctx->single_ns = (now - start) * 1e9 / (double)loads;
+    ctx->current[0] = current;
+    ctx->current_ptr[0] = current_ptr;
+}
+
+static void chase_teardown(void *arg) {
+    chase_ctx_t *ctx = (chase_ctx_t*)arg;
+    if (ctx->single_ns > 0.0) {
+        pthread_mutex_lock(&chase_lock);
+        chase_single_ns_sum += ctx->single_ns;
+        chase_single_count++;
+        pthread_mutex_unlock(&chase_lock);
+    }
+    bench_free(ctx->values);
+    bench_free(ctx->next);
+    bench_free(ctx->base);
+    free(ctx);
+}
+
+// Effective MLP: how many single-chain latencies overlap per load in the K-chain loop.
+static void chase_finish(bench_results_t *res) {
+    int chains = (int)(res->work_per_iter + 0.5);
+    bench_results_add_metric(res, "chains", chains);
+    bench_summary_t s = bench_results_summarize(res);
+    double single = chase_single_count ? chase_single_ns_sum / (double)chase_single_count : s.value;
+    double mlp = s.value > 0.0 ? single / s.value : 0.0;
+    if (chains > 1) {
+        BENCH_PRINTF("MLP: %d chains, %f ns/load, single-chain %f ns/load, effective MLP %.2f\n", chains, s.value,
+                     single, mlp);
+    }
+    bench_results_add_metric(res, "single_chain_ns", single);
+    bench_results_add_metric(res, "mlp", mlp);
+    bench_sweep_state.column = "MLP";
+    bench_sweep_state.column_value = mlp;
+    chase_single_ns_sum = 0.0;
+    chase_single_count = 0;
+}
+
+static const bench_kernel_t chase_kernel = { "Pointer chase", chase_setup, chase_run, chase_teardown, NULL,
+                                             chase_finish };
+
+static int chase_main(int argc, char **argv, double t0) {
+    BENCH_PRINTF("Pointer chase start\n");
+
+    bench_results_t res;
+    bench_results_init(&res, "pointer_chase", argc, argv);
+    long stride = chase_parse_layout(argc, argv);
+    int chains = chase_parse_chains(argc, argv);
+    long scope = chase_parse_scope(argc, argv);
+    if (stride < 0 || chains == 0 || scope < 0) {
+        return 1;
+    }
+    int N = chase_elements(bench_parse_size(argc, argv, DEFAULT_BYTES), (size_t)stride);
+    res.working_set = stride ? (size_t)N * (size_t)stride : (size_t)N * 2 * sizeof(int);
+    BENCH_PRINTF("Layout: %s (%ld-byte nodes), %d nodes, randomised within %s\n",
+                 bench_parse_string(argc, argv, "--layout", "int"), stride ? stride : (long)sizeof(int), N,
+                 bench_parse_string(argc, argv, "--scope", "global"));
+    bench_results_add_metric(&res, "node_bytes", stride ? (double)stride : (double)sizeof(int));
+    bench_results_add_metric(&res, "scope_bytes", (double)scope);
+    // An iteration is one load on each chain; defaults keep the total load count.
+    bench_results_set_latency(&res, (double)chains, "ns/load");
+    unsigned long long default_iters = DEFAULT_ITERS / (unsigned long long)chains;
+    unsigned long long default_warmup = DEFAULT_WARMUP / (unsigned long long)chains;
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&chase_kernel, &res, argc, argv, t0, default_warmup, default_iters);
+    }
+
+    chase_ctx_t *ctx = (chase_ctx_t*)chase_setup(0, argc, argv);
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, default_warmup);
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("Pointer chase warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            current_index = next[current_index];
-            sink = values[current_index];
-        }
+        chase_run(ctx, warmup_iters);
     }
 
-    start_time = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, default_iters, chase_run, ctx);
 
     BENCH_PRINTF("Pointer chase loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        current_index = next[current_index];
-        sink = values[current_index];
-    }
+    bench_results_run(&res, chase_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
-    double seconds = bench_now_sec() - start_time;
-    BENCH_PRINTF("Sink: %d\n", sink);
+    BENCH_PRINTF("Sink: %d\n", ctx->sink);
     BENCH_PRINTF("Pointer chase complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", seconds);
-
-    free(perm);
-    free(values);
-    free(next);
+    chase_teardown(ctx);
+    chase_finish(&res);
+    bench_results_report(&res);
+    bench_results_free(&res);
     return 0;
 }
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+    if (bench_sweep_requested(argc, argv)) {
+        return bench_sweep_main(chase_main, argc, argv, t0);
+    }
+    return chase_main(argc, argv, t0);
+}
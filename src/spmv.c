@@ -1,88 +1,865 @@
-/* 
+/*
  * Sparse matrix-vector multiply benchmark.
  * CSR SpMV with random column indices to drive irregular memory access
- * and TLB pressure from indirect gathers.
+ * and TLB pressure from indirect gathers, with a locality dial (--band,
+ * --alpha) and optional RCM reordering, or on a Matrix Market file
+ * (--matrix file.mtx). The matrix is converted to CSR, ELLPACK, SELL-C-sigma
+ * or 4x4 blocked CSR (--format), each with scalar, AVX2 and AVX-512 kernels,
+ * and checked against scalar CSR. Work runs under OpenMP in ranges holding
+ * equal numbers of stored entries, the same ranges that first-touched the
+ * arrays.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "bench_args.h"
-#define N 1000000  // Rows
+#include "bench_threads.h"
+#include "bench_sweep.h"
+#include "bench_pace.h"
+#include "bench_isa.h"
+#include "bench_mtx.h"
 #define NZ_PER_ROW 10 // Non-zeros per row
+// Bytes per row: values + col_indices + row_ptr + x + y
+#define ROW_BYTES (NZ_PER_ROW * (sizeof(double) + sizeof(int)) + sizeof(int) + 2 * sizeof(double))
+// Working set: 1M rows. Override with --size <bytes> or sweep it with --sweep-bytes min:max:factor.
+#define DEFAULT_BYTES (1000000ULL * ROW_BYTES)
 #define DEFAULT_SEED 1u
 #define DEFAULT_ITERS 1000ULL
+#define DEFAULT_WARMUP 10ULL
+#define DEFAULT_SIGMA 256
+#define SELL_C 8      // SELL/ELL chunk height: one AVX-512 vector of doubles
+#define BCSR_B 4      // BCSR block edge
+#define SPMV_TOLERANCE 1e-12
 
-int main(int argc, char **argv) {
-    double t0 = bench_now_sec();
+enum { SPMV_CSR, SPMV_ELL, SPMV_SELL, SPMV_BCSR, SPMV_FORMATS };
 
-    BENCH_PRINTF("SpMV start\n");
+static const char *const spmv_format_names[SPMV_FORMATS] = { "csr", "ell", "sell", "bcsr" };
 
-    // 1. Setup CSR Format (Compressed Sparse Row)
-    double *values = (double*)malloc(N * NZ_PER_ROW * sizeof(double));
-    int *col_indices = (int*)malloc(N * NZ_PER_ROW * sizeof(int));
-    int *row_ptr = (int*)malloc((N + 1) * sizeof(int));
-    double *x = (double*)malloc(N * sizeof(double));
-    double *y = (double*)malloc(N * sizeof(double));
+/*
+ * Storage per format. A "unit" is what the OpenMP partition splits:
+ *   csr       rows; ptr[] = row offsets into values/col_indices
+ *   ell/sell  chunks of SELL_C rows; entry k of slot s in chunk c sits at
+ *             ptr[c] + k * SELL_C + s; perm[] = row of each slot (padding
+ *             slots point past nrows into the padded y); ELL pads every
+ *             chunk to the longest row, SELL sorts rows by length within
+ *             windows of sigma rows and pads each chunk to its own longest
+ *   bcsr      block rows of BCSR_B rows; ptr[] = block offsets, col_indices
+ *             = block columns, values = row-major BCSR_B x BCSR_B blocks
+ */
+typedef struct {
+    int format;
+    int isa;
+    double *values;
+    int *col_indices;
+    int *ptr;
+    int *perm;
+    int units;
+    long long stored;    // stored entries including padding and block fill
+    double *x;           // ncols, padded to a multiple of BCSR_B
+    double *y;           // nrows, padded to a multiple of SELL_C
+    int nrows, ncols, nnz;
+    int nthreads;        // OpenMP threads per multiply (1 unless OMP_NUM_THREADS)
+    int *part;           // nthreads + 1 unit boundaries, about stored / nthreads entries each
+    bench_pace_t pace;   // --duty / --target-bw, one burst per iteration
+} spmv_ctx_t;
 
-    // Initialize with random data causing cache thrashing
-    srand(bench_parse_seed(argc, argv, DEFAULT_SEED));
-    row_ptr[0] = 0;
-    for (int i = 0; i < N; i++) {
-        row_ptr[i+1] = row_ptr[i] + NZ_PER_ROW;
-        x[i] = 1.0;
-        y[i] = 0.0;
-        for (int j = 0; j < NZ_PER_ROW; j++) {
-            int idx = i * NZ_PER_ROW + j;
-            values[idx] = 1.0;
-            // Random column index forces irregular memory access
-            col_indices[idx] = rand() % N; 
+typedef void (*spmv_kernel_fn)(const spmv_ctx_t *ctx, int u0, int u1);
+
+static bench_pace_t spmv_pace;   // parsed once in spmv_main, copied per worker
+static int spmv_workers;
+static bench_csr_t spmv_matrix;  // --matrix, read once in spmv_main and copied per worker
+static double spmv_bytes;        // traffic per multiply in the chosen format, for the effective bandwidth
+static double spmv_fill;         // stored entries per non-zero
+static int spmv_band;            // --band: columns within a window of this width around the diagonal
+static double spmv_alpha;        // --alpha: power-law column distribution
+static int spmv_rcm;             // --reorder rcm
+static int spmv_matrix_bandwidth;
+
+// Rows for a working set of `bytes`.
+static int spmv_rows(size_t bytes) {
+    size_t n = bytes / ROW_BYTES;
+    return n ? (int)n : 1;
+}
+
+// Compulsory bytes per multiply: values, column indices and row pointers once, x once, y written.
+static double spmv_traffic(int nrows, int ncols, int nnz) {
+    return (double)nnz * (sizeof(double) + sizeof(int)) + (double)(nrows + 1) * sizeof(int) +
+           (double)ncols * sizeof(double) + (double)nrows * sizeof(double);
+}
+
+// The same for the stored format, counting padding, block fill and the SELL permutation.
+static double spmv_format_traffic(const spmv_ctx_t *ctx) {
+    double index = ctx->format == SPMV_BCSR ? (double)ctx->stored / (BCSR_B * BCSR_B) : (double)ctx->stored;
+    double bytes = (double)ctx->stored * sizeof(double) + index * sizeof(int) + (double)(ctx->units + 1) * sizeof(int) +
+                   (double)ctx->ncols * sizeof(double) + (double)ctx->nrows * sizeof(double);
+    if (ctx->format == SPMV_SELL) {
+        bytes += (double)ctx->units * SELL_C * sizeof(int);
+    }
+    return bytes;
+}
+
+static int spmv_parse_format(int argc, char **argv) {
+    const char *name = bench_parse_string(argc, argv, "--format", "csr");
+    for (int f = 0; f < SPMV_FORMATS; f++) {
+        if (strcmp(name, spmv_format_names[f]) == 0) {
+            return f;
         }
     }
+    fprintf(stderr, "Unknown --format %s (expected csr, ell, sell or bcsr)\n", name);
+    return -1;
+}
 
-    // 2. The Loop
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 10ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
-    if (warmup_iters > 0ULL) {
+// Splits `units` into `nthreads` contiguous ranges with about equal entries (lower bound on ptr).
+static void spmv_partition(const int *ptr, int units, int nthreads, int *part) {
+    long long total = ptr[units];
+    part[0] = 0;
+    for (int t = 1; t < nthreads; t++) {
+        long long target = total * t / nthreads;
+        int lo = part[t - 1], hi = units;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (ptr[mid] < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        part[t] = lo;
+    }
+    part[nthreads] = units;
+}
 
-        BENCH_PRINTF("SpMV warmup start\n");
+// --- Kernels -------------------------------------------------------------
+
+static void spmv_csr_scalar(const spmv_ctx_t *ctx, int u0, int u1) {
+    const double *values = ctx->values;
+    const int *col_indices = ctx->col_indices;
+    const int *row_ptr = ctx->ptr;
+    const double *x = ctx->x;
+    double *y = ctx->y;
+    for (int i = u0; i < u1; i++) {
+        double sum = 0.0;
+        for (int j = row_ptr[i]; j < row_ptr[i+1]; j++) {
+            // INDIRECT ACCESS: The bottleneck is fetching x[col_indices[j]]
+            sum += values[j] * x[col_indices[j]];
+        }
+        y[i] = sum;
+    }
+}
+
+static void spmv_sell_scalar(const spmv_ctx_t *ctx, int u0, int u1) {
+    for (int c = u0; c < u1; c++) {
+        const double *v = ctx->values + ctx->ptr[c];
+        const int *col = ctx->col_indices + ctx->ptr[c];
+        int width = (ctx->ptr[c + 1] - ctx->ptr[c]) / SELL_C;
+        double acc[SELL_C] = { 0.0 };
+        for (int k = 0; k < width; k++) {
+            for (int s = 0; s < SELL_C; s++) {
+                acc[s] += v[k * SELL_C + s] * ctx->x[col[k * SELL_C + s]];
+            }
+        }
+        for (int s = 0; s < SELL_C; s++) {
+            ctx->y[ctx->perm[c * SELL_C + s]] = acc[s];
+        }
+    }
+}
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            for (int i = 0; i < N; i++) {
-                double sum = 0.0;
-                for (int j = row_ptr[i]; j < row_ptr[i+1]; j++) {
-                    sum += values[j] * x[col_indices[j]];
+static void spmv_bcsr_scalar(const spmv_ctx_t *ctx, int u0, int u1) {
+    for (int b = u0; b < u1; b++) {
+        double acc[BCSR_B] = { 0.0 };
+        for (int k = ctx->ptr[b]; k < ctx->ptr[b + 1]; k++) {
+            const double *blk = ctx->values + (size_t)k * BCSR_B * BCSR_B;
+            const double *xb = ctx->x + (size_t)ctx->col_indices[k] * BCSR_B;
+            for (int r = 0; r < BCSR_B; r++) {
+                for (int c = 0; c < BCSR_B; c++) {
+                    acc[r] += blk[r * BCSR_B + c] * xb[c];
                 }
-                y[i] = sum;
             }
         }
+        for (int r = 0; r < BCSR_B; r++) {
+            ctx->y[b * BCSR_B + r] = acc[r];
+        }
+    }
+}
+
+#if BENCH_HAVE_X86_ISA
+#define SPMV_ISA_ATTR(tgt) __attribute__((target(tgt), optimize("no-tree-vectorize")))
+
+// Sums of four vectors, lane r = sum of a_r.
+SPMV_ISA_ATTR("avx2,fma") static inline __m256d spmv_hsum4(__m256d a0, __m256d a1, __m256d a2, __m256d a3) {
+    __m256d t0 = _mm256_hadd_pd(a0, a1);
+    __m256d t1 = _mm256_hadd_pd(a2, a3);
+    return _mm256_add_pd(_mm256_permute2f128_pd(t0, t1, 0x20), _mm256_permute2f128_pd(t0, t1, 0x31));
+}
+
+SPMV_ISA_ATTR("avx2,fma") static void spmv_csr_avx2(const spmv_ctx_t *ctx, int u0, int u1) {
+    const double *values = ctx->values;
+    const int *cols = ctx->col_indices;
+    const double *x = ctx->x;
+    for (int i = u0; i < u1; i++) {
+        int j = ctx->ptr[i], end = ctx->ptr[i + 1];
+        __m256d acc = _mm256_setzero_pd();
+        for (; j + 4 <= end; j += 4) {
+            __m256d xv = _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)(cols + j)), 8);
+            acc = _mm256_fmadd_pd(_mm256_loadu_pd(values + j), xv, acc);
+        }
+        __m128d h = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+        double sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+        for (; j < end; j++) {
+            sum += values[j] * x[cols[j]];
+        }
+        ctx->y[i] = sum;
+    }
+}
+
+SPMV_ISA_ATTR("avx2,fma") static void spmv_sell_avx2(const spmv_ctx_t *ctx, int u0, int u1) {
+    const double *x = ctx->x;
+    int sorted = ctx->format == SPMV_SELL;
+    for (int c = u0; c < u1; c++) {
+        const double *v = ctx->values + ctx->ptr[c];
+        const int *col = ctx->col_indices + ctx->ptr[c];
+        int width = (ctx->ptr[c + 1] - ctx->ptr[c]) / SELL_C;
+        __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+        for (int k = 0; k < width; k++) {
+            const int *ck = col + k * SELL_C;
+            lo = _mm256_fmadd_pd(_mm256_loadu_pd(v + k * SELL_C),
+                                 _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)ck), 8), lo);
+            hi = _mm256_fmadd_pd(_mm256_loadu_pd(v + k * SELL_C + 4),
+                                 _mm256_i32gather_pd(x, _mm_loadu_si128((const __m128i*)(ck + 4)), 8), hi);
+        }
+        if (sorted) {
+            double lanes[SELL_C] __attribute__((aligned(32)));
+            _mm256_store_pd(lanes, lo);
+            _mm256_store_pd(lanes + 4, hi);
+            for (int s = 0; s < SELL_C; s++) {
+                ctx->y[ctx->perm[c * SELL_C + s]] = lanes[s];
+            }
+        } else {
+            _mm256_storeu_pd(ctx->y + c * SELL_C, lo);
+            _mm256_storeu_pd(ctx->y + c * SELL_C + 4, hi);
+        }
+    }
+}
+
+SPMV_ISA_ATTR("avx2,fma") static void spmv_bcsr_avx2(const spmv_ctx_t *ctx, int u0, int u1) {
+    for (int b = u0; b < u1; b++) {
+        __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+        __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+        for (int k = ctx->ptr[b]; k < ctx->ptr[b + 1]; k++) {
+            const double *blk = ctx->values + (size_t)k * BCSR_B * BCSR_B;
+            __m256d xv = _mm256_loadu_pd(ctx->x + (size_t)ctx->col_indices[k] * BCSR_B);
+            a0 = _mm256_fmadd_pd(_mm256_loadu_pd(blk), xv, a0);
+            a1 = _mm256_fmadd_pd(_mm256_loadu_pd(blk + 4), xv, a1);
+            a2 = _mm256_fmadd_pd(_mm256_loadu_pd(blk + 8), xv, a2);
+            a3 = _mm256_fmadd_pd(_mm256_loadu_pd(blk + 12), xv, a3);
+        }
+        _mm256_storeu_pd(ctx->y + b * BCSR_B, spmv_hsum4(a0, a1, a2, a3));
+    }
+}
+
+SPMV_ISA_ATTR("avx512f") static void spmv_csr_avx512(const spmv_ctx_t *ctx, int u0, int u1) {
+    const double *values = ctx->values;
+    const int *cols = ctx->col_indices;
+    const double *x = ctx->x;
+    for (int i = u0; i < u1; i++) {
+        int j = ctx->ptr[i], end = ctx->ptr[i + 1];
+        __m512d acc = _mm512_setzero_pd();
+        for (; j + 8 <= end; j += 8) {
+            __m512d xv = _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i*)(cols + j)), x, 8);
+            acc = _mm512_fmadd_pd(_mm512_loadu_pd(values + j), xv, acc);
+        }
+        if (j < end) {
+            __mmask8 m = (__mmask8)((1u << (end - j)) - 1u);
+            int tail[8] = { 0 };
+            memcpy(tail, cols + j, (size_t)(end - j) * sizeof(int));
+            __m256i idx = _mm256_loadu_si256((const __m256i*)tail);
+            __m512d xv = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), m, idx, x, 8);
+            acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, values + j), xv, acc);
+        }
+        ctx->y[i] = _mm512_reduce_add_pd(acc);
+    }
+}
+
+SPMV_ISA_ATTR("avx512f") static void spmv_sell_avx512(const spmv_ctx_t *ctx, int u0, int u1) {
+    const double *x = ctx->x;
+    int sorted = ctx->format == SPMV_SELL;
+    for (int c = u0; c < u1; c++) {
+        const double *v = ctx->values + ctx->ptr[c];
+        const int *col = ctx->col_indices + ctx->ptr[c];
+        int width = (ctx->ptr[c + 1] - ctx->ptr[c]) / SELL_C;
+        __m512d acc = _mm512_setzero_pd();
+        for (int k = 0; k < width; k++) {
+            __m512d xv = _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i*)(col + k * SELL_C)), x, 8);
+            acc = _mm512_fmadd_pd(_mm512_loadu_pd(v + k * SELL_C), xv, acc);
+        }
+        if (sorted) {
+            _mm512_i32scatter_pd(ctx->y, _mm256_loadu_si256((const __m256i*)(ctx->perm + c * SELL_C)), acc, 8);
+        } else {
+            _mm512_storeu_pd(ctx->y + c * SELL_C, acc);
+        }
+    }
+}
+
+SPMV_ISA_ATTR("avx512f,avx2,fma") static void spmv_bcsr_avx512(const spmv_ctx_t *ctx, int u0, int u1) {
+    for (int b = u0; b < u1; b++) {
+        // Rows 0-1 and rows 2-3 of each block share a register; x is broadcast to both halves.
+        __m512d a01 = _mm512_setzero_pd(), a23 = _mm512_setzero_pd();
+        for (int k = ctx->ptr[b]; k < ctx->ptr[b + 1]; k++) {
+            const double *blk = ctx->values + (size_t)k * BCSR_B * BCSR_B;
+            __m512d xv = _mm512_broadcast_f64x4(_mm256_loadu_pd(ctx->x + (size_t)ctx->col_indices[k] * BCSR_B));
+            a01 = _mm512_fmadd_pd(_mm512_loadu_pd(blk), xv, a01);
+            a23 = _mm512_fmadd_pd(_mm512_loadu_pd(blk + 8), xv, a23);
+        }
+        __m256d sums = spmv_hsum4(_mm512_castpd512_pd256(a01), _mm512_extractf64x4_pd(a01, 1),
+                                  _mm512_castpd512_pd256(a23), _mm512_extractf64x4_pd(a23, 1));
+        _mm256_storeu_pd(ctx->y + b * BCSR_B, sums);
+    }
+}
+
+// ELL and SELL share a kernel; no gathers below AVX2, so sse2 has no entries.
+static const spmv_kernel_fn spmv_kernels[SPMV_FORMATS][BENCH_ISA_COUNT] = {
+    { spmv_csr_scalar, NULL, spmv_csr_avx2, spmv_csr_avx512 },
+    { spmv_sell_scalar, NULL, spmv_sell_avx2, spmv_sell_avx512 },
+    { spmv_sell_scalar, NULL, spmv_sell_avx2, spmv_sell_avx512 },
+    { spmv_bcsr_scalar, NULL, spmv_bcsr_avx2, spmv_bcsr_avx512 },
+};
+#else
+static const spmv_kernel_fn spmv_kernels[SPMV_FORMATS][BENCH_ISA_COUNT] = {
+    { spmv_csr_scalar }, { spmv_sell_scalar }, { spmv_sell_scalar }, { spmv_bcsr_scalar },
+};
+#endif
+
+/*
+ * --isa for the kernels: CSR keeps the plain C loop unless --isa is given,
+ * the other formats default to the widest ISA. Returns -1 when invalid.
+ */
+static int spmv_parse_isa(int argc, char **argv, int format) {
+    if (format == SPMV_CSR && !bench_find_arg(argc, argv, "--isa")) {
+        return BENCH_ISA_SCALAR;
+    }
+    int isa = bench_isa_select(argc, argv);
+    if (isa < 0) {
+        return -1;
+    }
+    if (!spmv_kernels[format][isa]) {
+        fprintf(stderr, "--isa %s has no gather instructions (use scalar, avx2 or avx512)\n", bench_isa_names[isa]);
+        return -1;
+    }
+    return isa;
+}
+
+// One multiply over the whole matrix, each OpenMP thread on its range of units.
+static void spmv_multiply(const spmv_ctx_t *ctx) {
+    spmv_kernel_fn kern = spmv_kernels[ctx->format][ctx->isa];
+    const int *part = ctx->part;
+    #pragma omp parallel num_threads(ctx->nthreads)
+    {
+        int t = omp_get_thread_num();
+        kern(ctx, part[t], part[t + 1]);
+    }
+}
+
+// --- Conversion ----------------------------------------------------------
+
+/*
+ * Column of a random non-zero in row i:
+ *   default    uniform over all n columns
+ *   --band W   uniform within W columns centred on the diagonal (wrapping)
+ *   --alpha a  n * u^a for uniform u: density ~ c^(1/a - 1), so a = 1 is
+ *              uniform and larger a concentrates the gathers on few hot columns
+ */
+static int spmv_column(int i, int n, unsigned int *seed) {
+    if (spmv_band > 0) {
+        int width = spmv_band < n ? spmv_band : n;
+        int c = i - width / 2 + rand_r(seed) % width;
+        return c < 0 ? c + n : c >= n ? c - n : c;
+    }
+    if (spmv_alpha > 0.0) {
+        double u = (double)rand_r(seed) / ((double)RAND_MAX + 1.0);
+        int c = (int)((double)n * pow(u, spmv_alpha));
+        return c < n ? c : n - 1;
+    }
+    return rand_r(seed) % n;
+}
+
+// Random CSR with NZ_PER_ROW entries per row (malloc, for conversion).
+static void spmv_random_csr(bench_csr_t *csr, int n, unsigned int seed) {
+    csr->nrows = csr->ncols = n;
+    csr->nnz = n * NZ_PER_ROW;
+    csr->row_ptr = (int*)malloc(((size_t)n + 1) * sizeof(int));
+    csr->col_indices = (int*)malloc((size_t)csr->nnz * sizeof(int));
+    csr->values = (double*)malloc((size_t)csr->nnz * sizeof(double));
+    // Initialize with random data causing cache thrashing
+    for (int i = 0; i <= n; i++) {
+        csr->row_ptr[i] = i * NZ_PER_ROW;
+    }
+    for (int idx = 0; idx < csr->nnz; idx++) {
+        csr->values[idx] = 1.0;
+        // Random column index forces irregular memory access
+        csr->col_indices[idx] = spmv_column(idx / NZ_PER_ROW, n, &seed);
+    }
+}
+
+// Applies --reorder rcm and records the matrix bandwidth; prints when `verbose`.
+static void spmv_reorder(bench_csr_t *csr, int verbose) {
+    int before = bench_csr_bandwidth(csr);
+    spmv_matrix_bandwidth = before;
+    if (!spmv_rcm) {
+        return;
     }
     double start = bench_now_sec();
+    bench_csr_rcm(csr);
+    spmv_matrix_bandwidth = bench_csr_bandwidth(csr);
+    if (verbose) {
+        BENCH_PRINTF("RCM: bandwidth %d -> %d (%.3f s)\n", before, spmv_matrix_bandwidth, bench_now_sec() - start);
+    }
+}
 
-    BENCH_PRINTF("SpMV loop start\n");
+// Allocates the stored arrays once ptr[] is known and first-touches them with the multiply's partition.
+static void spmv_place(spmv_ctx_t *ctx, int *ptr, int units, int nperm) {
+    int block = ctx->format == SPMV_BCSR ? BCSR_B * BCSR_B : 1;
+    ctx->ptr = ptr;
+    ctx->units = units;
+    ctx->stored = (long long)ptr[units] * block;
+    ctx->values = (double*)bench_alloc((size_t)(ctx->stored ? ctx->stored : 1) * sizeof(double));
+    ctx->col_indices = (int*)bench_alloc((size_t)(ptr[units] ? ptr[units] : 1) * sizeof(int));
+    ctx->perm = nperm ? (int*)bench_alloc((size_t)nperm * sizeof(int)) : NULL;
+    ctx->part = (int*)malloc(((size_t)ctx->nthreads + 1) * sizeof(int));
+    spmv_partition(ptr, units, ctx->nthreads, ctx->part);
 
-    BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
+    double *values = ctx->values;
+    int *col_indices = ctx->col_indices;
+    #pragma omp parallel num_threads(ctx->nthreads)
+    {
+        int t = omp_get_thread_num();
+        int u0 = ctx->part[t], u1 = ctx->part[t + 1];
+        for (long long j = (long long)ptr[u0] * block; j < (long long)ptr[u1] * block; j++) {
+            values[j] = 0.0;
+        }
+        for (int j = ptr[u0]; j < ptr[u1]; j++) {
+            col_indices[j] = 0;
+        }
+        if (ctx->perm) {
+            for (int s = u0 * SELL_C; s < u1 * SELL_C; s++) {
+                ctx->perm[s] = 0;
+            }
+        }
+    }
+}
+
+static void spmv_to_csr(spmv_ctx_t *ctx, const bench_csr_t *csr) {
+    int *ptr = (int*)bench_alloc(((size_t)csr->nrows + 1) * sizeof(int));
+    memcpy(ptr, csr->row_ptr, ((size_t)csr->nrows + 1) * sizeof(int));
+    spmv_place(ctx, ptr, csr->nrows, 0);
+    memcpy(ctx->values, csr->values, (size_t)csr->nnz * sizeof(double));
+    memcpy(ctx->col_indices, csr->col_indices, (size_t)csr->nnz * sizeof(int));
+}
+
+// ELL (sigma = 1, uniform width) or SELL-C-sigma.
+static void spmv_to_sell(spmv_ctx_t *ctx, const bench_csr_t *csr, int sigma) {
+    int n = csr->nrows;
+    int nchunks = (n + SELL_C - 1) / SELL_C;
+    int *order = (int*)malloc((size_t)nchunks * SELL_C * sizeof(int));
+    for (int i = 0; i < nchunks * SELL_C; i++) {
+        order[i] = i;   // slots past n are padding rows
+    }
+    if (ctx->format == SPMV_SELL) {
+        // Sort rows by decreasing length within each window of sigma rows (insertion sort keeps it stable).
+        const int *rp = csr->row_ptr;
+        for (int w = 0; w < n; w += sigma) {
+            int end = w + sigma < n ? w + sigma : n;
+            for (int i = w + 1; i < end; i++) {
+                int r = order[i], len = rp[r + 1] - rp[r];
+                int j = i - 1;
+                while (j >= w && rp[order[j] + 1] - rp[order[j]] < len) {
+                    order[j + 1] = order[j];
+                    j--;
+                }
+                order[j + 1] = r;
+            }
+        }
+    }
+    int max_len = 0;
+    for (int r = 0; r < n; r++) {
+        int len = csr->row_ptr[r + 1] - csr->row_ptr[r];
+        max_len = len > max_len ? len : max_len;
+    }
+    int *ptr = (int*)bench_alloc(((size_t)nchunks + 1) * sizeof(int));
+    long long total = 0;
+    ptr[0] = 0;
+    for (int c = 0; c < nchunks; c++) {
+        int width = 0;
+        for (int s = 0; s < SELL_C && ctx->format == SPMV_SELL; s++) {
+            int r = order[c * SELL_C + s];
+            int len = r < n ? csr->row_ptr[r + 1] - csr->row_ptr[r] : 0;
+            width = len > width ? len : width;
+        }
+        total += (long long)(ctx->format == SPMV_SELL ? width : max_len) * SELL_C;
+        if (total > INT_MAX) {
+            fprintf(stderr, "--format %s needs %lld stored entries, more than this kernel indexes\n",
+                    spmv_format_names[ctx->format], total);
+            exit(1);
+        }
+        ptr[c + 1] = (int)total;
+    }
+    spmv_place(ctx, ptr, nchunks, nchunks * SELL_C);
+    for (int c = 0; c < nchunks; c++) {
+        for (int s = 0; s < SELL_C; s++) {
+            int r = order[c * SELL_C + s];
+            ctx->perm[c * SELL_C + s] = r;
+            if (r >= n) {
+                continue;
+            }
+            int len = csr->row_ptr[r + 1] - csr->row_ptr[r];
+            for (int k = 0; k < len; k++) {
+                ctx->values[ptr[c] + k * SELL_C + s] = csr->values[csr->row_ptr[r] + k];
+                ctx->col_indices[ptr[c] + k * SELL_C + s] = csr->col_indices[csr->row_ptr[r] + k];
+            }
+        }
+    }
+    free(order);
+}
+
+static int spmv_cmp_int(const void *a, const void *b) {
+    return (*(const int*)a > *(const int*)b) - (*(const int*)a < *(const int*)b);
+}
+
+// BCSR with BCSR_B x BCSR_B blocks; blocks of a block row are in increasing column order.
+static void spmv_to_bcsr(spmv_ctx_t *ctx, const bench_csr_t *csr) {
+    int nb = (csr->nrows + BCSR_B - 1) / BCSR_B;
+    int bcols = (csr->ncols + BCSR_B - 1) / BCSR_B;
+    int *seen = (int*)malloc((size_t)bcols * sizeof(int));
+    int *slot = (int*)malloc((size_t)bcols * sizeof(int));
+    int *list = (int*)malloc((size_t)bcols * sizeof(int));
+    for (int c = 0; c < bcols; c++) {
+        seen[c] = -1;
+    }
+    int *ptr = (int*)bench_alloc(((size_t)nb + 1) * sizeof(int));
+    ptr[0] = 0;
+    for (int b = 0; b < nb; b++) {
+        int count = 0;
+        for (int r = b * BCSR_B; r < (b + 1) * BCSR_B && r < csr->nrows; r++) {
+            for (int j = csr->row_ptr[r]; j < csr->row_ptr[r + 1]; j++) {
+                int bc = csr->col_indices[j] / BCSR_B;
+                if (seen[bc] != b) {
+                    seen[bc] = b;
+                    count++;
+                }
+            }
+        }
+        if ((long long)ptr[b] + count > INT_MAX / (BCSR_B * BCSR_B)) {
+            fprintf(stderr, "--format bcsr needs more blocks than this kernel indexes\n");
+            exit(1);
+        }
+        ptr[b + 1] = ptr[b] + count;
+    }
+    spmv_place(ctx, ptr, nb, 0);
+    for (int c = 0; c < bcols; c++) {
+        seen[c] = -1;
+    }
+    for (int b = 0; b < nb; b++) {
+        int count = 0;
+        int r_end = (b + 1) * BCSR_B < csr->nrows ? (b + 1) * BCSR_B : csr->nrows;
+        for (int r = b * BCSR_B; r < r_end; r++) {
+            for (int j = csr->row_ptr[r]; j < csr->row_ptr[r + 1]; j++) {
+                int bc = csr->col_indices[j] / BCSR_B;
+                if (seen[bc] != b) {
+                    seen[bc] = b;
+                    list[count++] = bc;
+                }
+            }
+        }
+        qsort(list, (size_t)count, sizeof(int), spmv_cmp_int);
+        for (int k = 0; k < count; k++) {
+            slot[list[k]] = ptr[b] + k;
+            ctx->col_indices[ptr[b] + k] = list[k];
+        }
+        for (int r = b * BCSR_B; r < r_end; r++) {
+            for (int j = csr->row_ptr[r]; j < csr->row_ptr[r + 1]; j++) {
+                int c = csr->col_indices[j];
+                size_t at = (size_t)slot[c / BCSR_B] * BCSR_B * BCSR_B + (size_t)(r % BCSR_B) * BCSR_B + c % BCSR_B;
+                ctx->values[at] += csr->values[j];
+            }
+        }
+    }
+    free(seen);
+    free(slot);
+    free(list);
+}
+
+// Multiplies once and compares y with scalar CSR on the source matrix; exits on a mismatch.
+static void spmv_validate(const spmv_ctx_t *ctx, const bench_csr_t *csr, int tid) {
+    spmv_multiply(ctx);
+    double err = 0.0, scale = 0.0;
+    for (int i = 0; i < csr->nrows; i++) {
+        double ref = 0.0;
+        for (int j = csr->row_ptr[i]; j < csr->row_ptr[i + 1]; j++) {
+            ref += csr->values[j] * ctx->x[csr->col_indices[j]];
+        }
+        double diff = fabs(ctx->y[i] - ref);
+        err = diff > err ? diff : err;
+        scale = fabs(ref) > scale ? fabs(ref) : scale;
+    }
+    double rel = scale > 0.0 ? err / scale : err;
+    if (!(rel <= SPMV_TOLERANCE)) {
+        fprintf(stderr, "Validation failed: --format %s differs from CSR by %.3e (relative)\n",
+                spmv_format_names[ctx->format], rel);
+        exit(1);
+    }
+    if (tid == 0) {
+        BENCH_PRINTF("Validation: %s/%s matches scalar CSR (max relative error %.1e)\n",
+                     spmv_format_names[ctx->format], bench_isa_names[ctx->isa], rel);
+    }
+}
+
+static void *spmv_setup(int tid, int argc, char **argv) {
+    spmv_ctx_t *ctx = (spmv_ctx_t*)calloc(1, sizeof(spmv_ctx_t));
+    bench_csr_t random_csr;
+    const bench_csr_t *csr = &spmv_matrix;
+    if (spmv_matrix.row_ptr == NULL) {
+        unsigned int seed = bench_parse_seed(argc, argv, DEFAULT_SEED) + (unsigned int)tid;
+        spmv_random_csr(&random_csr, spmv_rows(bench_parse_size(argc, argv, DEFAULT_BYTES)), seed);
+        spmv_reorder(&random_csr, tid == 0);
+        csr = &random_csr;
+    }
+    ctx->format = spmv_parse_format(argc, argv);
+    ctx->isa = spmv_parse_isa(argc, argv, ctx->format);
+    ctx->nrows = csr->nrows;
+    ctx->ncols = csr->ncols;
+    ctx->nnz = csr->nnz;
+    ctx->nthreads = bench_omp_enabled(argc, argv) ? omp_get_max_threads() : 1;
+
+    // 1. Setup the stored format from CSR (Compressed Sparse Row)
+    switch (ctx->format) {
+    case SPMV_CSR: spmv_to_csr(ctx, csr); break;
+    case SPMV_BCSR: spmv_to_bcsr(ctx, csr); break;
+    default:
+        spmv_to_sell(ctx, csr, ctx->format == SPMV_SELL ? (int)bench_parse_ull(argc, argv, "--sigma", DEFAULT_SIGMA) : 1);
+        break;
+    }
+
+    size_t xlen = ((size_t)ctx->ncols + BCSR_B - 1) / BCSR_B * BCSR_B;
+    size_t ylen = ((size_t)ctx->nrows + SELL_C - 1) / SELL_C * SELL_C;
+    double *x = (double*)bench_alloc(xlen * sizeof(double));
+    double *y = (double*)bench_alloc_output(ylen * sizeof(double));
+    // First touch: y by the multiply's partition (rows, or slots of its chunks), x split evenly by column.
+    size_t rows_per_unit = ctx->format == SPMV_CSR ? 1 : ctx->format == SPMV_BCSR ? BCSR_B : SELL_C;
+    #pragma omp parallel num_threads(ctx->nthreads)
+    {
+        int t = omp_get_thread_num();
+        size_t r0 = (size_t)ctx->part[t] * rows_per_unit, r1 = (size_t)ctx->part[t + 1] * rows_per_unit;
+        for (size_t i = r0; i < r1 && i < ylen; i++) {
+            y[i] = 0.0;
+        }
+        size_t c0 = xlen * (size_t)t / (size_t)ctx->nthreads, c1 = xlen * (size_t)(t + 1) / (size_t)ctx->nthreads;
+        for (size_t j = c0; j < c1; j++) {
+            // Varied so that validation catches misplaced columns; padding stays zero.
+            x[j] = j < (size_t)ctx->ncols ? 1.0 + (double)(j % 16) / 16.0 : 0.0;
+        }
+    }
+    ctx->x = x;
+    ctx->y = y;
+    ctx->pace = spmv_pace;
+
+    spmv_validate(ctx, csr, tid);
+    if (tid == 0) {
+        spmv_bytes = spmv_format_traffic(ctx);
+        spmv_fill = ctx->nnz ? (double)ctx->stored / ctx->nnz : 1.0;
+    }
+    if (csr == &random_csr) {
+        bench_csr_free(&random_csr);
+    }
+    return ctx;
+}
+
+static void spmv_run(void *arg, unsigned long long iters) {
+    spmv_ctx_t *ctx = (spmv_ctx_t*)arg;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        double burst = bench_now_sec();
         // SpMV Kernel
-        for (int i = 0; i < N; i++) {
-            double sum = 0.0;
-            for (int j = row_ptr[i]; j < row_ptr[i+1]; j++) {
-                // INDIRECT ACCESS: The bottleneck is fetching x[col_indices[j]]
-                sum += values[j] * x[col_indices[j]];
+        spmv_multiply(ctx);
+        if (bench_pace_enabled(&ctx->pace)) {
+            bench_pace_wait(&ctx->pace, burst, bench_now_sec());
+        }
+    }
+}
+
+static void spmv_reset(void *arg) {
+    bench_pace_reset(&((spmv_ctx_t*)arg)->pace);
+}
+
+static void spmv_finish(bench_results_t *res) {
+    // GFLOP/s over the 2 * nnz flops of a multiply, scaled to the traffic of the stored format. Under
+    // --threads work_per_iter already counts every worker's multiply, and s.value is the aggregate.
+    bench_summary_t s = bench_results_summarize(res);
+    double gbs = s.value * spmv_bytes * (res->threads > 0 ? res->threads : 1) / (res->work_per_iter * 1e9);
+    BENCH_PRINTF("Effective bandwidth: %f GB/s (%.0f bytes per multiply, %.3f stored entries per non-zero)\n", gbs,
+                 spmv_bytes, spmv_fill);
+    bench_results_add_metric(res, "effective_gbs", gbs);
+    bench_results_add_metric(res, "fill", spmv_fill);
+    bench_results_add_metric(res, "matrix_bandwidth", spmv_matrix_bandwidth);
+    bench_sweep_state.column = "GB/s";
+    bench_sweep_state.column_value = gbs;
+    bench_pace_report(&spmv_pace, res, spmv_workers);
+}
+
+static void spmv_teardown(void *arg) {
+    spmv_ctx_t *ctx = (spmv_ctx_t*)arg;
+    bench_pace_merge(&ctx->pace);
+    bench_free(ctx->values);
+    bench_free(ctx->col_indices);
+    bench_free(ctx->ptr);
+    if (ctx->perm) {
+        bench_free(ctx->perm);
+    }
+    bench_free(ctx->x);
+    bench_free(ctx->y);
+    free(ctx->part);
+    free(ctx);
+}
+
+static const bench_kernel_t spmv_kernel = { "SpMV", spmv_setup, spmv_run, spmv_teardown, spmv_reset, spmv_finish };
+
+// Parses --band, --alpha and --reorder; returns -1 when invalid.
+static int spmv_parse_locality(int argc, char **argv, const char *path) {
+    const char *band = bench_find_arg(argc, argv, "--band");
+    const char *alpha = bench_find_arg(argc, argv, "--alpha");
+    const char *reorder = bench_parse_string(argc, argv, "--reorder", "none");
+    spmv_band = band ? atoi(band) : 0;
+    spmv_alpha = alpha ? strtod(alpha, NULL) : 0.0;
+    if ((band || alpha) && path) {
+        fprintf(stderr, "--band and --alpha shape the random matrix and do not apply to --matrix\n");
+        return -1;
+    }
+    if (band && alpha) {
+        fprintf(stderr, "--band and --alpha are mutually exclusive\n");
+        return -1;
+    }
+    if ((band && spmv_band < 1) || (alpha && spmv_alpha < 1.0)) {
+        fprintf(stderr, "Invalid %s %s (expected %s)\n", band ? "--band" : "--alpha", band ? band : alpha,
+                band ? "columns >= 1" : "exponent >= 1");
+        return -1;
+    }
+    if (strcmp(reorder, "none") != 0 && strcmp(reorder, "rcm") != 0) {
+        fprintf(stderr, "Unknown --reorder %s (expected none or rcm)\n", reorder);
+        return -1;
+    }
+    spmv_rcm = strcmp(reorder, "rcm") == 0;
+    return 0;
+}
+
+static int spmv_main(int argc, char **argv, double t0) {
+    BENCH_PRINTF("SpMV start\n");
+
+    const char *path = bench_find_arg(argc, argv, "--matrix");
+    int format = spmv_parse_format(argc, argv);
+    int isa = format < 0 ? -1 : spmv_parse_isa(argc, argv, format);
+    if (isa < 0) {
+        return 1;
+    }
+    if (format == SPMV_SELL && bench_parse_ull(argc, argv, "--sigma", DEFAULT_SIGMA) == 0ULL) {
+        fprintf(stderr, "Invalid --sigma (expected rows >= 1)\n");
+        return 1;
+    }
+    if (spmv_parse_locality(argc, argv, path) != 0) {
+        return 1;
+    }
+    int nrows, ncols, nnz;
+    if (path) {
+        if (spmv_matrix.row_ptr == NULL) {
+            double start = bench_now_sec();
+            if (bench_mtx_read(path, &spmv_matrix) != 0) {
+                return 1;
             }
-            y[i] = sum;
+            BENCH_PRINTF("Read %s in %.3f s\n", path, bench_now_sec() - start);
+            if (spmv_rcm && spmv_matrix.nrows != spmv_matrix.ncols) {
+                fprintf(stderr, "--reorder rcm needs a square matrix (%s is %d x %d)\n", path, spmv_matrix.nrows,
+                        spmv_matrix.ncols);
+                return 1;
+            }
+            spmv_reorder(&spmv_matrix, 1);
         }
+        nrows = spmv_matrix.nrows;
+        ncols = spmv_matrix.ncols;
+        nnz = spmv_matrix.nnz;
+    } else {
+        nrows = ncols = spmv_rows(bench_parse_size(argc, argv, DEFAULT_BYTES));
+        nnz = nrows * NZ_PER_ROW;
+    }
+    if (path) {
+        BENCH_PRINTF("Matrix: %s, %d x %d, %d non-zeros (%.1f per row)\n", path, nrows, ncols, nnz,
+                     (double)nnz / nrows);
+    } else if (spmv_band > 0) {
+        BENCH_PRINTF("Matrix: random, band %d, %d x %d, %d non-zeros\n", spmv_band, nrows, ncols, nnz);
+    } else if (spmv_alpha > 0.0) {
+        BENCH_PRINTF("Matrix: random, power-law alpha %.2f, %d x %d, %d non-zeros\n", spmv_alpha, nrows, ncols, nnz);
+    } else {
+        BENCH_PRINTF("Matrix: random, %d x %d, %d non-zeros\n", nrows, ncols, nnz);
     }
+    if (format == SPMV_SELL) {
+        BENCH_PRINTF("Format: sell (C=%d, sigma=%llu), ISA %s\n", SELL_C,
+                     bench_parse_ull(argc, argv, "--sigma", DEFAULT_SIGMA), bench_isa_names[isa]);
+    } else {
+        BENCH_PRINTF("Format: %s, ISA %s\n", spmv_format_names[format], bench_isa_names[isa]);
+    }
+    BENCH_PRINTF("OpenMP threads: %d\n", bench_omp_enabled(argc, argv) ? omp_get_max_threads() : 1);
+    bench_results_t res;
+    bench_results_init(&res, "spmv", argc, argv);
+    res.working_set = (size_t)spmv_traffic(nrows, ncols, nnz);
+    // Two flops (multiply + add) per non-zero; padding and block fill do not count.
+    bench_results_set_rate(&res, 2.0 * (double)nnz * 1e-9, "GFLOP/s");
+    bench_results_add_metric(&res, "rows", nrows);
+    bench_results_add_metric(&res, "nnz", nnz);
+    bench_results_add_metric(&res, "isa_bits", bench_isa_bits[isa]);
+    // Pacing treats the whole working set as streamed once per iteration.
+    spmv_workers = bench_parse_threads(argc, argv) > 0 ? bench_parse_threads(argc, argv) : 1;
+    if (bench_pace_init(&spmv_pace, argc, argv, (double)res.working_set, spmv_workers) != 0) {
+        return 1;
+    }
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&spmv_kernel, &res, argc, argv, t0, DEFAULT_WARMUP, DEFAULT_ITERS);
+    }
+
+    void *ctx = spmv_setup(0, argc, argv);
+
+    // 2. The Loop
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
+    if (warmup_iters > 0ULL) {
+
+        BENCH_PRINTF("SpMV warmup start\n");
+
+        spmv_run(ctx, warmup_iters);
+    }
+
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, spmv_run, ctx);
+
+    BENCH_PRINTF("SpMV loop start\n");
+
+    spmv_reset(ctx);
+    BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
+    bench_results_run(&res, spmv_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
     BENCH_PRINTF("SpMV complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
-    
-    free(values);
-    free(col_indices);
-    free(row_ptr);
-    free(x);
-    free(y);
+    spmv_teardown(ctx);
+    spmv_finish(&res);
+    bench_results_report(&res);
+    bench_results_free(&res);
     return 0;
 }
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+    int rc = bench_sweep_requested(argc, argv) ? bench_sweep_main(spmv_main, argc, argv, t0)
+                                               : spmv_main(argc, argv, t0);
+    bench_csr_free(&spmv_matrix);
+    return rc;
+}
@@ -1,61 +1,503 @@
-/* 
- * STREAM triad benchmark.
- * Large arrays with the triad kernel to drive sustained DRAM bandwidth
- * and saturate the memory controllers.
+/*
+ * STREAM benchmark suite.
+ * Large arrays with the copy, scale, add and triad kernels, plus read-only,
+ * write-only and read-modify-write kernels in explicit SSE2/AVX2/AVX-512
+ * intrinsics, each with regular (write-allocate) or non-temporal stores, to
+ * drive sustained DRAM bandwidth and saturate the memory controllers. Passes
+ * run under OpenMP with the same static partition that first-touched the
+ * arrays.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <omp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "bench_args.h"
-// Array size (adjust based on system memory, keep it larger than L3 cache)
-#define N 20000000  // 20 million elements
+#include "bench_threads.h"
+#include "bench_sweep.h"
+#include "bench_isa.h"
+#include "bench_pace.h"
+// Working set: three arrays of 20 million doubles (keep it larger than L3 cache).
+// Override with --size <bytes> or sweep it with --sweep-bytes min:max:factor.
+#define DEFAULT_BYTES (3ULL * 20000000ULL * sizeof(double))
 #define DEFAULT_ITERS 1500ULL
+#define DEFAULT_WARMUP 15ULL
 
-double a[N], b[N], c[N];
-double scale = 3.0;
+enum { STREAM_COPY, STREAM_SCALE, STREAM_ADD, STREAM_TRIAD, STREAM_READ, STREAM_WRITE, STREAM_RMW, STREAM_NOPS };
 
-int main(int argc, char **argv) {
-    double t0 = bench_now_sec();
+static const char *const stream_op_names[STREAM_NOPS] = { "copy", "scale", "add", "triad", "read", "write", "rmw" };
+// Arrays read and written per element, and whether a regular store must first read the line (write-allocate).
+static const int stream_op_reads[STREAM_NOPS] = { 1, 1, 2, 2, 1, 0, 1 };
+static const int stream_op_writes[STREAM_NOPS] = { 1, 1, 1, 1, 0, 1, 1 };
+static const int stream_op_allocates[STREAM_NOPS] = { 1, 1, 1, 1, 0, 1, 0 };
+
+// Variant v = 2 * op + nt.
+#define STREAM_NVARIANTS (2 * STREAM_NOPS)
+
+typedef struct {
+    double min, max, sum;
+    unsigned long long passes;
+} stream_stats_t;
+
+typedef struct {
+    double *a, *b, *c;
+    size_t n;
+    double scale;
+    int nthreads;                              // OpenMP threads per pass (1 unless OMP_NUM_THREADS)
+    int isa;                                   // BENCH_ISA_* for read/write/rmw and streaming stores
+    double sink;                               // keeps the read kernel's sums live
+    int variants[STREAM_NVARIANTS];
+    int nvariants;
+    stream_stats_t stats[STREAM_NVARIANTS];
+    bench_pace_t pace;                         // --duty / --target-bw, one burst per iteration
+} stream_ctx_t;
+
+// Team-wide per-variant results, merged at teardown.
+typedef struct {
+    pthread_mutex_t lock;
+    double best_gbs[STREAM_NVARIANTS];        // sum over --threads workers
+    double avg_gbs[STREAM_NVARIANTS];
+    double min_s[STREAM_NVARIANTS], max_s[STREAM_NVARIANTS], sum_s[STREAM_NVARIANTS];
+    unsigned long long passes[STREAM_NVARIANTS];
+} stream_team_t;
+
+static stream_team_t stream_team = { PTHREAD_MUTEX_INITIALIZER };
+static bench_pace_t stream_pace;               // parsed once in stream_main, copied per worker
+static int stream_workers;
+
+// Elements per array for a working set of `bytes` (a, b and c together).
+static size_t stream_elements(size_t bytes) {
+    size_t n = bytes / (3 * sizeof(double));
+    return n ? n : 1;
+}
+
+// Bytes read from DRAM by one pass, including the write-allocate read of `a` that regular stores cause.
+static double stream_pass_read_bytes(int v, size_t n) {
+    int words = stream_op_reads[v / 2] + ((v % 2) ? 0 : stream_op_allocates[v / 2]);
+    return (double)words * sizeof(double) * (double)n;
+}
 
+// Bytes moved through DRAM by one pass.
+static double stream_pass_bytes(int v, size_t n) {
+    return stream_pass_read_bytes(v, n) + (double)stream_op_writes[v / 2] * sizeof(double) * (double)n;
+}
+
+/*
+ * Parses --kernel copy,scale,add,triad,read,write,rmw|all (default triad) and
+ * --stores temporal|nt|both (default temporal) into variants[].
+ * Returns the count, or 0 when invalid.
+ */
+static int stream_parse_variants(int argc, char **argv, int *variants) {
+    const char *kernels = bench_parse_string(argc, argv, "--kernel", "triad");
+    const char *stores = bench_parse_string(argc, argv, "--stores", "temporal");
+    int temporal = strcmp(stores, "temporal") == 0 || strcmp(stores, "both") == 0;
+    int nt = strcmp(stores, "nt") == 0 || strcmp(stores, "both") == 0;
+    if (!temporal && !nt) {
+        fprintf(stderr, "Unknown --stores %s (expected temporal, nt or both)\n", stores);
+        return 0;
+    }
+    int selected[STREAM_NOPS] = { 0 };
+    char list[128];
+    snprintf(list, sizeof(list), "%s", kernels);
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        int found = 0;
+        for (int op = 0; op < STREAM_NOPS; op++) {
+            if (strcmp(tok, "all") == 0 || strcmp(tok, stream_op_names[op]) == 0) {
+                selected[op] = found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown --kernel %s (expected a list of copy, scale, add, triad, read, write, rmw, or all)\n",
+                    tok);
+            return 0;
+        }
+    }
+    int count = 0;
+    for (int op = 0; op < STREAM_NOPS; op++) {
+        // The read kernel has no stores, so it runs once whatever --stores says.
+        if (selected[op] && (temporal || !stream_op_writes[op])) {
+            variants[count++] = 2 * op;
+        }
+        if (selected[op] && nt && stream_op_writes[op]) {
+            variants[count++] = 2 * op + 1;
+        }
+    }
+    return count;
+}
+
+// Static partition of [0, n) in whole cache lines, shared by first touch and every pass.
+static void stream_range(size_t n, int tid, int nthreads, size_t *lo, size_t *hi) {
+    size_t lines = (n + 7) / 8;
+    size_t per = lines / (size_t)nthreads, extra = lines % (size_t)nthreads;
+    size_t first = (size_t)tid * per + ((size_t)tid < extra ? (size_t)tid : extra);
+    size_t count = per + ((size_t)tid < extra ? 1 : 0);
+    *lo = first * 8 < n ? first * 8 : n;
+    *hi = (first + count) * 8 < n ? (first + count) * 8 : n;
+}
+
+static inline double stream_elem(int op, const double *b, const double *c, double s, size_t i) {
+    switch (op) {
+    case STREAM_COPY: return b[i];
+    case STREAM_SCALE: return s * b[i];
+    case STREAM_ADD: return b[i] + c[i];
+    default: return b[i] + s * c[i];
+    }
+}
+
+// All kernels write `a` and only read `b`/`c`, so --numa split keeps its meaning.
+static void stream_pass_temporal(int op, double *restrict a, const double *restrict b, const double *restrict c,
+                                 double s, size_t lo, size_t hi) {
+    switch (op) {
+    case STREAM_COPY:
+        for (size_t i = lo; i < hi; i++) a[i] = b[i];
+        break;
+    case STREAM_SCALE:
+        for (size_t i = lo; i < hi; i++) a[i] = s * b[i];
+        break;
+    case STREAM_ADD:
+        for (size_t i = lo; i < hi; i++) a[i] = b[i] + c[i];
+        break;
+    default:
+        for (size_t i = lo; i < hi; i++) a[i] = b[i] + s * c[i];
+        break;
+    }
+}
+
+/*
+ * Read-only, write-only and read-modify-write kernels, and the streaming-store
+ * copy/scale/add/triad, in explicit intrinsics, one copy per ISA (bench_isa.h)
+ * so that CPUID or --isa picks the vector width at runtime instead of -march.
+ * The streamed pointer is first aligned to a cache line; `nt` selects
+ * streaming stores. Streaming stores bypass the cache and skip the
+ * write-allocate read of `a`.
+ */
+typedef struct {
+    double (*read)(const double *b, size_t lo, size_t hi);
+    void (*write)(double *a, double x, size_t lo, size_t hi, int nt);
+    void (*rmw)(double *a, double x, size_t lo, size_t hi, int nt);
+    void (*nt)(int op, double *restrict a, const double *restrict b, const double *restrict c, double s, size_t lo,
+               size_t hi);
+} stream_isa_kernels_t;
+
+// No auto-vectorization inside, so -march=native cannot widen the scalar head and tail loops.
+#define STREAM_ISA_ATTR(tgt) __attribute__((target(tgt), optimize("no-tree-vectorize")))
+#define STREAM_ALIGN_HEAD(p, i, hi) for (; (i) < (hi) && ((uintptr_t)((p) + (i)) % 64) != 0; (i)++)
+
+#define STREAM_ISA_KERNELS(isa, tgt, vec_t, W, load, loadu, store, stream, set1, add, mul, zero)          \
+    STREAM_ISA_ATTR(tgt) static double stream_read_##isa(const double *b, size_t lo, size_t hi) { \
+        size_t i = lo;                                                                                \
+        double sum = 0.0;                                                                             \
+        STREAM_ALIGN_HEAD(b, i, hi) sum += b[i];                                                      \
+        vec_t s0 = zero(), s1 = zero(), s2 = zero(), s3 = zero();                                     \
+        for (; i + 4 * (W) <= hi; i += 4 * (W)) {                                                     \
+            s0 = add(s0, load(b + i));                                                                \
+            s1 = add(s1, load(b + i + (W)));                                                          \
+            s2 = add(s2, load(b + i + 2 * (W)));                                                      \
+            s3 = add(s3, load(b + i + 3 * (W)));                                                      \
+        }                                                                                             \
+        double lanes[W] __attribute__((aligned(64)));                                                 \
+        store(lanes, add(add(s0, s1), add(s2, s3)));                                                  \
+        for (int k = 0; k < (W); k++) sum += lanes[k];                                                \
+        for (; i < hi; i++) sum += b[i];                                                              \
+        return sum;                                                                                   \
+    }                                                                                                 \
+    STREAM_ISA_ATTR(tgt) static void stream_write_##isa(double *a, double x, size_t lo, size_t hi, int nt) { \
+        size_t i = lo;                                                                                \
+        STREAM_ALIGN_HEAD(a, i, hi) a[i] = x;                                                         \
+        size_t end = i + (hi - i) / (W) * (W);                                                        \
+        vec_t v = set1(x);                                                                            \
+        if (nt) {                                                                                     \
+            for (; i < end; i += (W)) stream(a + i, v);                                               \
+            _mm_sfence();                                                                             \
+        } else {                                                                                      \
+            for (; i < end; i += (W)) store(a + i, v);                                                \
+        }                                                                                             \
+        for (; i < hi; i++) a[i] = x;                                                                 \
+    }                                                                                                 \
+    STREAM_ISA_ATTR(tgt) static void stream_rmw_##isa(double *a, double x, size_t lo, size_t hi, int nt) { \
+        size_t i = lo;                                                                                \
+        STREAM_ALIGN_HEAD(a, i, hi) a[i] += x;                                                        \
+        size_t end = i + (hi - i) / (W) * (W);                                                        \
+        vec_t v = set1(x);                                                                            \
+        if (nt) {                                                                                     \
+            for (; i < end; i += (W)) stream(a + i, add(load(a + i), v));                             \
+            _mm_sfence();                                                                             \
+        } else {                                                                                      \
+            for (; i < end; i += (W)) store(a + i, add(load(a + i), v));                              \
+        }                                                                                             \
+        for (; i < hi; i++) a[i] += x;                                                                \
+    }                                                                                                 \
+    STREAM_ISA_ATTR(tgt) static void stream_nt_##isa(int op, double *restrict a, const double *restrict b,  \
+                                                     const double *restrict c, double s, size_t lo,      \
+                                                     size_t hi) {                                        \
+        size_t i = lo;                                                                                \
+        STREAM_ALIGN_HEAD(a, i, hi) a[i] = stream_elem(op, b, c, s, i);                               \
+        size_t end = i + (hi - i) / (W) * (W);                                                        \
+        vec_t vs = set1(s);                                                                           \
+        switch (op) {                                                                                 \
+        case STREAM_COPY:                                                                             \
+            for (; i < end; i += (W)) stream(a + i, loadu(b + i));                                    \
+            break;                                                                                    \
+        case STREAM_SCALE:                                                                            \
+            for (; i < end; i += (W)) stream(a + i, mul(vs, loadu(b + i)));                           \
+            break;                                                                                    \
+        case STREAM_ADD:                                                                              \
+            for (; i < end; i += (W)) stream(a + i, add(loadu(b + i), loadu(c + i)));                 \
+            break;                                                                                    \
+        default:                                                                                      \
+            for (; i < end; i += (W)) stream(a + i, add(loadu(b + i), mul(vs, loadu(c + i))));        \
+            break;                                                                                    \
+        }                                                                                             \
+        for (; i < hi; i++) a[i] = stream_elem(op, b, c, s, i);                                       \
+        _mm_sfence();                                                                                 \
+    }
+
+#if BENCH_HAVE_X86_ISA
+STREAM_ISA_KERNELS(sse2, "sse2", __m128d, 2, _mm_load_pd, _mm_loadu_pd, _mm_store_pd, _mm_stream_pd, _mm_set1_pd,
+                   _mm_add_pd, _mm_mul_pd, _mm_setzero_pd)
+STREAM_ISA_KERNELS(avx2, "avx2", __m256d, 4, _mm256_load_pd, _mm256_loadu_pd, _mm256_store_pd, _mm256_stream_pd,
+                   _mm256_set1_pd, _mm256_add_pd, _mm256_mul_pd, _mm256_setzero_pd)
+STREAM_ISA_KERNELS(avx512, "avx512f", __m512d, 8, _mm512_load_pd, _mm512_loadu_pd, _mm512_store_pd,
+                   _mm512_stream_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_mul_pd, _mm512_setzero_pd)
+
+static const stream_isa_kernels_t stream_isa_table[BENCH_ISA_COUNT] = {
+    { NULL, NULL, NULL, NULL },   // scalar: not provided
+    { stream_read_sse2, stream_write_sse2, stream_rmw_sse2, stream_nt_sse2 },
+    { stream_read_avx2, stream_write_avx2, stream_rmw_avx2, stream_nt_avx2 },
+    { stream_read_avx512, stream_write_avx512, stream_rmw_avx512, stream_nt_avx512 },
+};
+#else
+static const stream_isa_kernels_t stream_isa_table[BENCH_ISA_COUNT];
+#endif
+
+// Validates --isa for the selected kernels; returns the ISA or -1.
+static int stream_parse_isa(int argc, char **argv, const int *variants, int nvariants) {
+    int isa = bench_isa_select(argc, argv);
+    if (isa < 0) {
+        return -1;
+    }
+    for (int k = 0; k < nvariants; k++) {
+        if (variants[k] / 2 >= STREAM_READ && !stream_isa_table[isa].read) {
+            fprintf(stderr, "--kernel %s needs --isa sse2, avx2 or avx512 (have %s)\n",
+                    stream_op_names[variants[k] / 2], bench_isa_names[isa]);
+            return -1;
+        }
+        if (variants[k] % 2 && !stream_isa_table[isa].nt) {
+            fprintf(stderr, "--stores nt needs --isa sse2, avx2 or avx512 (have %s)\n", bench_isa_names[isa]);
+            return -1;
+        }
+    }
+    return isa;
+}
+
+static void stream_pass(stream_ctx_t *ctx, int v) {
+    const stream_isa_kernels_t *kern = &stream_isa_table[ctx->isa];
+    double sum = 0.0;
+    #pragma omp parallel num_threads(ctx->nthreads) reduction(+:sum)
+    {
+        size_t lo, hi;
+        stream_range(ctx->n, omp_get_thread_num(), omp_get_num_threads(), &lo, &hi);
+        int op = v / 2, nt = v % 2;
+        if (op == STREAM_READ) {
+            sum += kern->read(ctx->b, lo, hi);
+        } else if (op == STREAM_WRITE) {
+            kern->write(ctx->a, ctx->scale, lo, hi, nt);
+        } else if (op == STREAM_RMW) {
+            kern->rmw(ctx->a, ctx->scale, lo, hi, nt);
+        } else if (nt) {
+            kern->nt(op, ctx->a, ctx->b, ctx->c, ctx->scale, lo, hi);
+        } else {
+            stream_pass_temporal(op, ctx->a, ctx->b, ctx->c, ctx->scale, lo, hi);
+        }
+    }
+    ctx->sink += sum;
+}
+
+static void stream_reset(void *arg) {
+    stream_ctx_t *ctx = (stream_ctx_t*)arg;
+    memset(ctx->stats, 0, sizeof(ctx->stats));
+    bench_pace_reset(&ctx->pace);
+}
+
+static void *stream_setup(int tid, int argc, char **argv) {
+    (void)tid;
+    stream_ctx_t *ctx = (stream_ctx_t*)malloc(sizeof(stream_ctx_t));
+    size_t n = stream_elements(bench_parse_size(argc, argv, DEFAULT_BYTES));
+    ctx->a = (double*)bench_alloc_output(n * sizeof(double));
+    ctx->b = (double*)bench_alloc(n * sizeof(double));
+    ctx->c = (double*)bench_alloc(n * sizeof(double));
+    ctx->n = n;
+    ctx->scale = 3.0;
+    // With OMP_NUM_THREADS set, OpenMP splits one set; pinned --threads workers each stream their own.
+    ctx->nthreads = bench_omp_enabled(argc, argv) ? omp_get_max_threads() : 1;
+    ctx->nvariants = stream_parse_variants(argc, argv, ctx->variants);
+    ctx->isa = stream_parse_isa(argc, argv, ctx->variants, ctx->nvariants);
+    ctx->sink = 0.0;
+    ctx->pace = stream_pace;
+    stream_reset(ctx);
+
+    // Initialize arrays (first touch by the threads that will stream each slice)
+    #pragma omp parallel num_threads(ctx->nthreads)
+    {
+        size_t lo, hi;
+        stream_range(n, omp_get_thread_num(), omp_get_num_threads(), &lo, &hi);
+        for (size_t i = lo; i < hi; i++) {
+            ctx->a[i] = 1.0;
+            ctx->b[i] = 2.0;
+            ctx->c[i] = 3.0;
+        }
+    }
+    return ctx;
+}
+
+static void stream_run(void *arg, unsigned long long iters) {
+    stream_ctx_t *ctx = (stream_ctx_t*)arg;
+    for (unsigned long long iter = 0; iter < iters; iter++) {
+        double burst = bench_now_sec();
+        for (int k = 0; k < ctx->nvariants; k++) {
+            int v = ctx->variants[k];
+            double start = bench_now_sec();
+            stream_pass(ctx, v);
+            double dt = bench_now_sec() - start;
+            stream_stats_t *st = &ctx->stats[v];
+            if (st->passes == 0ULL || dt < st->min) st->min = dt;
+            if (dt > st->max) st->max = dt;
+            st->sum += dt;
+            st->passes++;
+        }
+        if (bench_pace_enabled(&ctx->pace)) {
+            bench_pace_wait(&ctx->pace, burst, bench_now_sec());
+        }
+    }
+}
+
+static void stream_teardown(void *arg) {
+    stream_ctx_t *ctx = (stream_ctx_t*)arg;
+    pthread_mutex_lock(&stream_team.lock);
+    for (int v = 0; v < STREAM_NVARIANTS; v++) {
+        const stream_stats_t *st = &ctx->stats[v];
+        if (st->passes == 0ULL) {
+            continue;
+        }
+        double bytes = stream_pass_bytes(v, ctx->n) * 1e-9;
+        stream_team.best_gbs[v] += bytes / st->min;
+        stream_team.avg_gbs[v] += bytes / (st->sum / (double)st->passes);
+        if (stream_team.passes[v] == 0ULL || st->min < stream_team.min_s[v]) stream_team.min_s[v] = st->min;
+        if (st->max > stream_team.max_s[v]) stream_team.max_s[v] = st->max;
+        stream_team.sum_s[v] += st->sum;
+        stream_team.passes[v] += st->passes;
+    }
+    pthread_mutex_unlock(&stream_team.lock);
+    bench_pace_merge(&ctx->pace);
+    bench_free(ctx->a);
+    bench_free(ctx->b);
+    bench_free(ctx->c);
+    free(ctx);
+}
+
+// Per-variant table and record fields (e.g. triad_nt_best_gbs); read/write split at the best pass.
+static void stream_finish(bench_results_t *res) {
+    size_t n = stream_elements(res->working_set);
+    BENCH_PRINTF("%-10s %12s %12s %12s %12s %12s %12s %12s\n", "Kernel", "Best GB/s", "Avg GB/s",
+                 "Read GB/s", "Write GB/s", "Min time", "Avg time", "Max time");
+    for (int v = 0; v < STREAM_NVARIANTS; v++) {
+        if (stream_team.passes[v] == 0ULL) {
+            continue;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%s%s", stream_op_names[v / 2], (v % 2) ? "_nt" : "");
+        double best = stream_team.best_gbs[v];
+        double read = best * stream_pass_read_bytes(v, n) / stream_pass_bytes(v, n);
+        BENCH_PRINTF("%-10s %12.3f %12.3f %12.3f %12.3f %12.6f %12.6f %12.6f\n", name, best, stream_team.avg_gbs[v],
+                     read, best - read, stream_team.min_s[v], stream_team.sum_s[v] / (double)stream_team.passes[v],
+                     stream_team.max_s[v]);
+        const char *suffix[4] = { "best_gbs", "avg_gbs", "read_gbs", "write_gbs" };
+        double values[4] = { best, stream_team.avg_gbs[v], read, best - read };
+        for (int k = 0; k < 4; k++) {
+            char key[48];
+            snprintf(key, sizeof(key), "%s_%s", name, suffix[k]);
+            bench_results_add_metric(res, key, values[k]);
+        }
+    }
+    bench_pace_report(&stream_pace, res, stream_workers);
+    memset(stream_team.passes, 0, sizeof(stream_team.passes));
+    memset(stream_team.best_gbs, 0, sizeof(stream_team.best_gbs));
+    memset(stream_team.avg_gbs, 0, sizeof(stream_team.avg_gbs));
+    memset(stream_team.max_s, 0, sizeof(stream_team.max_s));
+    memset(stream_team.sum_s, 0, sizeof(stream_team.sum_s));
+}
+
+static const bench_kernel_t stream_kernel = { "STREAM", stream_setup, stream_run, stream_teardown,
+                                              stream_reset, stream_finish };
+
+static int stream_main(int argc, char **argv, double t0) {
     BENCH_PRINTF("STREAM start\n");
 
-    // Initialize arrays
-    for (int i = 0; i < N; i++) {
-        a[i] = 1.0;
-        b[i] = 2.0;
-        c[i] = 3.0;
+    size_t n = stream_elements(bench_parse_size(argc, argv, DEFAULT_BYTES));
+    int variants[STREAM_NVARIANTS];
+    int nvariants = stream_parse_variants(argc, argv, variants);
+    int isa = nvariants > 0 ? stream_parse_isa(argc, argv, variants, nvariants) : -1;
+    if (isa < 0) {
+        return 1;
+    }
+    bench_results_t res;
+    bench_results_init(&res, "stream", argc, argv);
+    res.working_set = 3 * n * sizeof(double);
+    // DRAM traffic of every selected pass, including write-allocate reads for regular stores.
+    double bytes = 0.0;
+    for (int k = 0; k < nvariants; k++) {
+        bytes += stream_pass_bytes(variants[k], n);
+    }
+    bench_results_set_rate(&res, bytes * 1e-9, "GB/s");
+    stream_workers = bench_parse_threads(argc, argv) > 0 ? bench_parse_threads(argc, argv) : 1;
+    if (bench_pace_init(&stream_pace, argc, argv, bytes, stream_workers) != 0) {
+        return 1;
+    }
+    bench_results_add_metric(&res, "isa_bits", bench_isa_bits[isa]);
+    BENCH_PRINTF("ISA: %s (widest supported %s; applies to read, write, rmw and nt stores)\n", bench_isa_names[isa],
+                 bench_isa_names[bench_isa_detect()]);
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&stream_kernel, &res, argc, argv, t0, DEFAULT_WARMUP, DEFAULT_ITERS);
     }
 
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 15ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
+    void *ctx = stream_setup(0, argc, argv);
+    BENCH_PRINTF("OpenMP threads: %d\n", ((stream_ctx_t*)ctx)->nthreads);
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, DEFAULT_WARMUP);
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("STREAM warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            for (int i = 0; i < N; i++) {
-                a[i] = b[i] + scale * c[i];
-            }
-        }
+        stream_run(ctx, warmup_iters);
     }
 
-    double start_time = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, DEFAULT_ITERS, stream_run, ctx);
 
     BENCH_PRINTF("STREAM loop start\n");
 
+    stream_reset(ctx);
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        for (int i = 0; i < N; i++) {
-            a[i] = b[i] + scale * c[i];
-        }
-    }
+    bench_results_run(&res, stream_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
-    double seconds = bench_now_sec() - start_time;
     BENCH_PRINTF("STREAM complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", seconds);
+    stream_teardown(ctx);
+    stream_finish(&res);
+    bench_results_report(&res);
+    bench_results_free(&res);
 
     return 0;
 }
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+    if (bench_sweep_requested(argc, argv)) {
+        return bench_sweep_main(stream_main, argc, argv, t0);
+    }
+    return stream_main(argc, argv, t0);
+}
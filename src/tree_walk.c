@@ -1,21 +1,38 @@
 /* 
  * Tree-walk benchmark.
  * Random BST searches to stress pointer chasing, branch behavior,
- * and cache miss latency.
+ * and cache miss latency. Nodes live in an arena, laid out (--layout) in
+ * insertion order, shuffled, breadth-first, van Emde Boas order, or rebuilt
+ * as a B-tree of cache-line nodes; every layout holds the same keys and
+ * returns the same search results. Keys come from an inline xorshift
+ * generator per thread; --batch G advances G searches in lockstep and
+ * prefetches each one's next node, and with OMP_NUM_THREADS set OpenMP
+ * threads search the shared tree together.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
 #include "bench_args.h"
+#include "bench_threads.h"
 typedef struct Node {
     int value;
     struct Node *left;
     struct Node *right;
 } Node;
 
+// Nodes handed out in allocation order from one block.
+typedef struct {
+    Node *nodes;
+    int count;
+    int capacity;
+} Arena;
+
 // Create a new node
-Node* newNode(int value) {
-    Node* node = (Node*)malloc(sizeof(Node));
+Node* newNode(Arena* arena, int value) {
+    Node* node = &arena->nodes[arena->count++];
     node->value = value;
     node->left = NULL;
     node->right = NULL;
@@ -23,12 +40,12 @@ Node* newNode(int value) {
 }
 
 // Insert (Standard BST)
-Node* insert(Node* node, int value) {
-    if (node == NULL) return newNode(value);
+Node* insert(Arena* arena, Node* node, int value) {
+    if (node == NULL) return newNode(arena, value);
     if (value < node->value)
-        node->left = insert(node->left, value);
+        node->left = insert(arena, node->left, value);
     else if (value > node->value)
-        node->right = insert(node->right, value);
+        node->right = insert(arena, node->right, value);
     return node;
 }
 
@@ -47,57 +64,474 @@ int search(Node* root, int key) {
     return 0; // Not found
 }
 
-#define NODES 1000000
+// B-tree node: one 64-byte cache line, up to 7 sorted keys and 8 children (-1 for none).
+#define BTREE_KEYS 7
+typedef struct {
+    int nkeys;
+    int keys[BTREE_KEYS];
+    int child[BTREE_KEYS + 1];
+} BNode;
+
+int searchBTree(const BNode* nodes, int key) {
+    int index = 0;
+    while (index >= 0) {
+        const BNode* b = &nodes[index];
+        int i = 0;
+        while (i < b->nkeys && b->keys[i] < key) i++;
+        if (i < b->nkeys && b->keys[i] == key) return 1;
+        index = b->child[i];
+    }
+    return 0;
+}
+
+#define NODES 1000000 // override with --nodes
 #define DEFAULT_SEED 1u
 #define DEFAULT_ITERS 80000000ULL
+#define DEFAULT_WARMUP 8000ULL
+#define WALK_CHECKS 100000   // searches compared against the insertion-order tree
+#define WALK_MAX_BATCH 64
 
-int main(int argc, char **argv) {
-    double t0 = bench_now_sec();
+enum { WALK_INSERTION, WALK_SHUFFLED, WALK_BFS, WALK_VEB, WALK_BTREE, WALK_LAYOUTS };
 
-    BENCH_PRINTF("Tree walk start\n");
+static const char *const walk_layout_names[WALK_LAYOUTS] = { "insertion", "shuffled", "bfs", "veb", "btree" };
 
-    srand(bench_parse_seed(argc, argv, DEFAULT_SEED));
-    Node *root = NULL;
+typedef struct {
+    Node *root;
+    BNode *bnodes;       // WALK_BTREE only
+    void *block;         // arena allocation (bench_alloc)
+    int layout;
+    int count;           // distinct keys
+    int height;          // levels of the BST, or of the B-tree
+    long found_count;
+    unsigned int seed;   // tree construction stream
+    int batch;           // searches in flight per thread
+    int nthreads;        // OpenMP threads per run (1 unless OMP_NUM_THREADS)
+    uint64_t *rng;       // key stream of each OpenMP thread, 64 bytes apart
+} walk_ctx_t;
+
+static int walk_layout;
+static int walk_nodes;
+static int walk_batch;
+
+// xorshift64* key in [0, 2^31): a few inline ALU ops, no libc call or shared state.
+static inline int walk_key(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (int)((x * 0x2545F4914F6CDD1DULL) >> 33);
+}
+
+// 64-byte aligned arena block from bench_alloc (so --pages and --numa apply); *block is what to free.
+static void *walk_arena_alloc(size_t bytes, void **block) {
+    *block = bench_alloc(bytes + 64);
+    return (void*)(((uintptr_t)*block + 63) & ~(uintptr_t)63);
+}
+
+static int walk_height(const Node* node) {
+    if (node == NULL) return 0;
+    int l = walk_height(node->left), r = walk_height(node->right);
+    return 1 + (l > r ? l : r);
+}
+
+typedef struct {
+    const Node **order;
+    int n;
+} walk_order_t;
+
+static void walk_veb(walk_order_t *o, const Node *node, int levels);
+
+// Lays out, in van Emde Boas order, every subtree hanging `top` levels below `node`.
+static void walk_veb_bottom(walk_order_t *o, const Node *node, int depth, int top, int levels) {
+    if (node == NULL) return;
+    if (depth == top) {
+        walk_veb(o, node, levels - top);
+        return;
+    }
+    walk_veb_bottom(o, node->left, depth + 1, top, levels);
+    walk_veb_bottom(o, node->right, depth + 1, top, levels);
+}
+
+// The first `levels` levels under `node`: the top half recursively, then each bottom subtree.
+static void walk_veb(walk_order_t *o, const Node *node, int levels) {
+    if (node == NULL || levels <= 0) return;
+    if (levels == 1) {
+        o->order[o->n++] = node;
+        return;
+    }
+    int top = (levels + 1) / 2;
+    walk_veb(o, node, top);
+    walk_veb_bottom(o, node, 0, top, levels);
+}
+
+// Copies the tree into a new arena in `order`, remapping child pointers.
+static Node* walk_relayout(const Arena* src, const Node** order, Node* dst) {
+    int *slot = (int*)malloc((size_t)src->count * sizeof(int));
+    for (int i = 0; i < src->count; i++) {
+        slot[order[i] - src->nodes] = i;
+    }
+    for (int i = 0; i < src->count; i++) {
+        const Node* n = order[i];
+        dst[i].value = n->value;
+        dst[i].left = n->left ? &dst[slot[n->left - src->nodes]] : NULL;
+        dst[i].right = n->right ? &dst[slot[n->right - src->nodes]] : NULL;
+    }
+    Node* root = &dst[slot[0]];   // the first insertion is the root
+    free(slot);
+    return root;
+}
+
+static void walk_inorder(const Node* node, int* keys, int* n) {
+    while (node != NULL) {
+        walk_inorder(node->left, keys, n);
+        keys[(*n)++] = node->value;
+        node = node->right;
+    }
+}
+
+/*
+ * Bulk-loads sorted keys into a B-tree, nodes numbered breadth-first. A
+ * range that needs h levels (more than 8^(h-1) - 1 keys) gets the fewest
+ * separators whose children, each at most 8^(h-1) - 1 keys, can hold the
+ * rest, split near-equally, so the nodes stay well filled. Returns the
+ * node count.
+ */
+static int walk_build_btree(const int* keys, int n, BNode* nodes, int* height) {
+    typedef struct { int lo, hi, depth; } range_t;
+    range_t *queue = (range_t*)malloc((size_t)(n + 1) * sizeof(range_t));
+    int head = 0, tail = 0;
+    queue[tail++] = (range_t){ 0, n, 1 };
+    *height = 0;
+    while (head < tail) {
+        range_t r = queue[head];
+        BNode* b = &nodes[head++];
+        int count = r.hi - r.lo;
+        *height = r.depth > *height ? r.depth : *height;
+        for (int i = 0; i <= BTREE_KEYS; i++) b->child[i] = -1;
+        if (count <= BTREE_KEYS) {
+            b->nkeys = count;
+            memcpy(b->keys, keys + r.lo, (size_t)count * sizeof(int));
+            continue;
+        }
+        long long below = BTREE_KEYS;   // capacity of a child subtree
+        while ((below + 1) * (BTREE_KEYS + 1) - 1 < count) below = (below + 1) * (BTREE_KEYS + 1) - 1;
+        int k = 1;
+        while ((k + 1) * below < count - k) k++;
+        b->nkeys = k;
+        int rest = count - k, lo = r.lo;
+        for (int i = 0; i <= k; i++) {
+            int size = rest / (k + 1) + (i < rest % (k + 1));
+            b->child[i] = tail;
+            queue[tail++] = (range_t){ lo, lo + size, r.depth + 1 };
+            lo += size;
+            if (i < k) b->keys[i] = keys[lo++];
+        }
+    }
+    free(queue);
+    return tail;
+}
+
+static int walk_contains(const walk_ctx_t* ctx, int key) {
+    return ctx->layout == WALK_BTREE ? searchBTree(ctx->bnodes, key) : search(ctx->root, key);
+}
+
+static void *walk_setup(int tid, int argc, char **argv) {
+    walk_ctx_t *ctx = (walk_ctx_t*)calloc(1, sizeof(walk_ctx_t));
+    ctx->seed = bench_parse_seed(argc, argv, DEFAULT_SEED) + (unsigned int)tid;
+    ctx->layout = walk_layout;
+    ctx->batch = walk_batch;
+    ctx->nthreads = bench_omp_enabled(argc, argv) ? omp_get_max_threads() : 1;
+    ctx->rng = (uint64_t*)aligned_alloc(64, (size_t)ctx->nthreads * 64);
+    for (int t = 0; t < ctx->nthreads; t++) {
+        // splitmix64 of (seed, worker, thread): distinct, never-zero states.
+        uint64_t z = ((uint64_t)ctx->seed << 32 | (uint32_t)t) + 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        ctx->rng[t * 8] = z ? z : 1;
+    }
 
     // 1. Build a Random Tree
     // Random insertion creates an unbalanced tree (deeper paths), 
     // which is good for stressing the walk.
-    for (int i = 0; i < NODES; i++) {
-        root = insert(root, rand());
+    Arena arena = { NULL, 0, walk_nodes };
+    void *block = NULL;
+    arena.nodes = (Node*)walk_arena_alloc((size_t)walk_nodes * sizeof(Node), &block);
+    Node *root = NULL;
+    for (int i = 0; i < walk_nodes; i++) {
+        root = insert(&arena, root, rand_r(&ctx->seed));
+    }
+    ctx->count = arena.count;
+    ctx->height = walk_height(root);
+    if (ctx->layout == WALK_INSERTION) {
+        ctx->root = root;
+        ctx->block = block;
+        return ctx;
+    }
+
+    // 2. Lay it out again (or as a B-tree) and check it against the original.
+    if (ctx->layout == WALK_BTREE) {
+        int *keys = (int*)malloc((size_t)arena.count * sizeof(int));
+        int n = 0;
+        walk_inorder(root, keys, &n);
+        // Build in a scratch array of the worst case (a key per node), then copy to a fitted arena.
+        BNode *scratch = (BNode*)malloc((size_t)(n + 1) * sizeof(BNode));
+        int nb = walk_build_btree(keys, n, scratch, &ctx->height);
+        ctx->bnodes = (BNode*)walk_arena_alloc((size_t)nb * sizeof(BNode), &ctx->block);
+        memcpy(ctx->bnodes, scratch, (size_t)nb * sizeof(BNode));
+        free(scratch);
+        free(keys);
+    } else {
+        walk_order_t o = { (const Node**)malloc((size_t)arena.count * sizeof(Node*)), 0 };
+        unsigned int shuffle_seed = ctx->seed ^ 0x9E3779B9u;
+        switch (ctx->layout) {
+        case WALK_SHUFFLED:
+            for (int i = 0; i < arena.count; i++) o.order[o.n++] = &arena.nodes[i];
+            for (int i = arena.count - 1; i > 0; i--) {
+                int j = rand_r(&shuffle_seed) % (i + 1);
+                const Node *tmp = o.order[i];
+                o.order[i] = o.order[j];
+                o.order[j] = tmp;
+            }
+            break;
+        case WALK_BFS:
+            o.order[o.n++] = root;
+            for (int head = 0; head < o.n; head++) {
+                if (o.order[head]->left) o.order[o.n++] = o.order[head]->left;
+                if (o.order[head]->right) o.order[o.n++] = o.order[head]->right;
+            }
+            break;
+        default:
+            walk_veb(&o, root, ctx->height);
+            break;
+        }
+        Node *dst = (Node*)walk_arena_alloc((size_t)arena.count * sizeof(Node), &ctx->block);
+        ctx->root = walk_relayout(&arena, o.order, dst);
+        free(o.order);
     }
+    unsigned int check_seed = ctx->seed ^ 0x85EBCA6Bu;
+    for (int i = 0; i < WALK_CHECKS; i++) {
+        // Alternate stored keys (hits) and random keys (mostly misses).
+        int key = i % 2 ? arena.nodes[rand_r(&check_seed) % arena.count].value : rand_r(&check_seed);
+        if (walk_contains(ctx, key) != search(root, key)) {
+            fprintf(stderr, "Layout %s disagrees with the insertion-order tree on key %d\n",
+                    walk_layout_names[ctx->layout], key);
+            exit(1);
+        }
+    }
+    bench_free(block);
+    return ctx;
+}
+
+/*
+ * `n` searches with up to `batch` in flight: each round moves every live
+ * search one level and prefetches its next node, so the misses of
+ * different searches overlap. A finished lane starts the next key.
+ */
+static long walk_search_bst(const walk_ctx_t *ctx, unsigned long long n, uint64_t *rng) {
+    const Node *cur[WALK_MAX_BATCH];
+    int key[WALK_MAX_BATCH];
+    unsigned long long started = 0;
+    long found = 0;
+    int live = 0;
+    while (live < ctx->batch && started < n) {
+        key[live] = walk_key(rng);
+        cur[live++] = ctx->root;
+        started++;
+    }
+    while (live > 0) {
+        for (int g = 0; g < live; g++) {
+            const Node *c = cur[g];
+            if (key[g] != c->value) {
+                c = key[g] < c->value ? c->left : c->right;
+                if (c != NULL) {
+                    cur[g] = c;
+                    __builtin_prefetch(c);
+                    continue;
+                }
+            } else {
+                found++;
+            }
+            if (started < n) {
+                key[g] = walk_key(rng);
+                cur[g] = ctx->root;
+                started++;
+            } else {
+                live--;
+                cur[g] = cur[live];
+                key[g] = key[live];
+                g--;
+            }
+        }
+    }
+    return found;
+}
+
+// As walk_search_bst, on B-tree node indices.
+static long walk_search_btree(const walk_ctx_t *ctx, unsigned long long n, uint64_t *rng) {
+    const BNode *nodes = ctx->bnodes;
+    int cur[WALK_MAX_BATCH];
+    int key[WALK_MAX_BATCH];
+    unsigned long long started = 0;
+    long found = 0;
+    int live = 0;
+    while (live < ctx->batch && started < n) {
+        key[live] = walk_key(rng);
+        cur[live++] = 0;
+        started++;
+    }
+    while (live > 0) {
+        for (int g = 0; g < live; g++) {
+            const BNode *b = &nodes[cur[g]];
+            int i = 0;
+            while (i < b->nkeys && b->keys[i] < key[g]) i++;
+            if (i < b->nkeys && b->keys[i] == key[g]) {
+                found++;
+            } else if (b->child[i] >= 0) {
+                cur[g] = b->child[i];
+                __builtin_prefetch(&nodes[cur[g]]);
+                continue;
+            }
+            if (started < n) {
+                key[g] = walk_key(rng);
+                cur[g] = 0;
+                started++;
+            } else {
+                live--;
+                cur[g] = cur[live];
+                key[g] = key[live];
+                g--;
+            }
+        }
+    }
+    return found;
+}
+
+// `n` searches from one key stream, one at a time or `batch` in flight.
+static long walk_search(const walk_ctx_t *ctx, unsigned long long n, uint64_t *rng) {
+    if (ctx->batch > 1) {
+        return ctx->layout == WALK_BTREE ? walk_search_btree(ctx, n, rng) : walk_search_bst(ctx, n, rng);
+    }
+    long found = 0;
+    for (unsigned long long iter = 0; iter < n; iter++) {
+        int key = walk_key(rng);
+        found += walk_contains(ctx, key);
+    }
+    return found;
+}
 
-    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, 8000ULL);
-    unsigned long long iterations = bench_parse_iterations(argc, argv, DEFAULT_ITERS);
-    long found_count = 0;
+/*
+ * One iteration is `batch` searches on every OpenMP thread, so a harness
+ * sample of a single iteration still keeps all lanes busy. A single thread
+ * runs without a parallel region.
+ */
+static void walk_run(void *arg, unsigned long long iters) {
+    walk_ctx_t *ctx = (walk_ctx_t*)arg;
+    unsigned long long n = iters * (unsigned long long)ctx->batch;
+    if (ctx->nthreads == 1) {
+        ctx->found_count += walk_search(ctx, n, &ctx->rng[0]);
+        return;
+    }
+    long found = 0;
+    #pragma omp parallel num_threads(ctx->nthreads) reduction(+:found)
+    {
+        uint64_t rng = ctx->rng[omp_get_thread_num() * 8];
+        found += walk_search(ctx, n, &rng);
+        ctx->rng[omp_get_thread_num() * 8] = rng;
+    }
+    ctx->found_count += found;
+}
+
+static void walk_teardown(void *arg) {
+    walk_ctx_t *ctx = (walk_ctx_t*)arg;
+    bench_free(ctx->block);
+    free(ctx->rng);
+    free(ctx);
+}
+
+static const bench_kernel_t walk_kernel = { "Tree walk", walk_setup, walk_run, walk_teardown };
+
+// Parses --layout, --nodes and --batch; returns -1 when invalid.
+static int walk_parse(int argc, char **argv) {
+    const char *layout = bench_parse_string(argc, argv, "--layout", "insertion");
+    walk_layout = -1;
+    for (int l = 0; l < WALK_LAYOUTS; l++) {
+        if (strcmp(layout, walk_layout_names[l]) == 0) {
+            walk_layout = l;
+        }
+    }
+    if (walk_layout < 0) {
+        fprintf(stderr, "Unknown --layout %s (expected insertion, shuffled, bfs, veb or btree)\n", layout);
+        return -1;
+    }
+    unsigned long long nodes = bench_parse_ull(argc, argv, "--nodes", NODES);
+    if (nodes < 1 || nodes > 200000000ULL) {
+        fprintf(stderr, "Invalid --nodes %llu (expected 1 to 200000000)\n", nodes);
+        return -1;
+    }
+    walk_nodes = (int)nodes;
+    walk_batch = (int)bench_parse_ull(argc, argv, "--batch", 1ULL);
+    if (walk_batch < 1 || walk_batch > WALK_MAX_BATCH) {
+        fprintf(stderr, "Invalid --batch %d (expected 1 to %d searches in flight)\n", walk_batch, WALK_MAX_BATCH);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double t0 = bench_now_sec();
+
+    BENCH_PRINTF("Tree walk start\n");
+
+    if (walk_parse(argc, argv) != 0) {
+        return 1;
+    }
+    bench_results_t res;
+    bench_results_init(&res, "tree_walk", argc, argv);
+    bench_results_set_rate(&res, walk_batch * 1e-6, "Msearch/s");
+    // Same default search count for every --batch.
+    unsigned long long default_iters = DEFAULT_ITERS / (unsigned long long)walk_batch;
+    unsigned long long default_warmup = (DEFAULT_WARMUP + walk_batch - 1) / (unsigned long long)walk_batch;
+    bench_results_add_metric(&res, "nodes", walk_nodes);
+    bench_results_add_metric(&res, "node_bytes", walk_layout == WALK_BTREE ? sizeof(BNode) : sizeof(Node));
+    bench_results_add_metric(&res, "batch", walk_batch);
+
+    if (bench_parse_threads(argc, argv) > 0) {
+        return bench_threads_main(&walk_kernel, &res, argc, argv, t0, default_warmup, default_iters);
+    }
+
+    walk_ctx_t *ctx = (walk_ctx_t*)walk_setup(0, argc, argv);
+    BENCH_PRINTF("Layout: %s, %d keys, height %d\n", walk_layout_names[ctx->layout], ctx->count, ctx->height);
+    bench_results_add_metric(&res, "height", ctx->height);
+    BENCH_PRINTF("OpenMP threads: %d, %d searches in flight each\n", ctx->nthreads, ctx->batch);
+    bench_results_set_rate(&res, ctx->nthreads * walk_batch * 1e-6, "Msearch/s");
+
+    unsigned long long warmup_iters = bench_parse_warmup_iterations(argc, argv, default_warmup);
 
     // 2. The Walk Loop
     if (warmup_iters > 0ULL) {
 
         BENCH_PRINTF("Tree walk warmup start\n");
 
-        for (unsigned long long iter = 0; iter < warmup_iters; iter++) {
-            int key = rand();
-            found_count += search(root, key);
-        }
-        found_count = 0;
+        walk_run(ctx, warmup_iters);
     }
 
-    double start = bench_now_sec();
+    unsigned long long iterations = bench_resolve_iterations(argc, argv, default_iters, walk_run, ctx);
+    ctx->found_count = 0;
 
     BENCH_PRINTF("Tree walk loop start\n");
 
     BENCH_EPRINTF("LOOP_START_REL %f\n", bench_now_sec() - t0);
-    for (unsigned long long iter = 0; iter < iterations; iter++) {
-        int key = rand();
-        found_count += search(root, key);
-    }
+    bench_results_run(&res, walk_run, ctx, iterations);
     BENCH_EPRINTF("LOOP_END_REL %f\n", bench_now_sec() - t0);
 
-    BENCH_PRINTF("Searches completed. Found: %ld\n", found_count);
+    BENCH_PRINTF("Searches completed. Found: %ld\n", ctx->found_count);
     BENCH_PRINTF("Tree walk complete\n");
 
-    BENCH_PRINTF("Loop iterations: %llu\n", iterations);
-    BENCH_PRINTF("Loop time: %f seconds\n", bench_now_sec() - start);
-    
+    bench_results_report(&res);
+    bench_results_free(&res);
+
+    walk_teardown(ctx);
     return 0;
 }